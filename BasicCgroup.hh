@@ -0,0 +1,268 @@
+#pragma once
+#ifndef __BASICCGROUP_HH__
+#define __BASICCGROUP_HH__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "CgroupBackend.hh"
+#include "CgroupBackendV1.hh"
+#include "CgroupBackendV2.hh"
+#include "CgroupFile.hh"
+
+namespace mdsd {
+
+/*
+ * A cgroup seen through its concrete backend, CgroupBackendV1 or
+ * CgroupBackendV2.
+ *
+ * Both backends are final, so every call made here is resolved at compile
+ * time and the interface file names come from the constexpr tables of the
+ * backend. Files are found in the fd cache by CgroupControllerFile type,
+ * so a cached read or write is an atomic load and a pread() or pwrite().
+ * The virtual interface of CgroupBackend stays for everything else and
+ * forwards to this class where it is implemented here (e.g. SetLimits()).
+ *
+ * The backend type is known once per process (see CgroupContext), hot
+ * loops switch on it once with DispatchBackend() and then run without
+ * virtual calls.
+ */
+template <typename Backend>
+class BasicCgroup
+{
+public:
+    static constexpr CgroupBackendType Type = Backend::Type;
+    static_assert(sizeof(Backend::FileNames) / sizeof(Backend::FileNames[0]) == CGROUP_CONTROLLER_FILE_LAST,
+                  "FileNames does not match the CgroupControllerFile enum");
+
+    explicit BasicCgroup(Backend &backend) : backend(backend) {}
+
+    static constexpr const char *FileName(int fileType) { return Backend::FileNames[fileType]; }
+
+    /* Copies of FileNames for the fd cache keys, built on first use */
+    static const std::string *FileNameStrings()
+    {
+        static const std::vector<std::string> names(std::begin(Backend::FileNames), std::end(Backend::FileNames));
+        return names.data();
+    }
+
+    Backend &GetBackend() { return backend; }
+
+    /* Cached fd of interface file fileType, opened in the hierarchy of
+       controller on first use. Only valid under backend.UseFiles(). */
+    CgroupResult<int> TryGetFileFd(int controller, int fileType, int flags)
+    {
+        int fd = backend.fileCache.LookupFile(fileType, flags);
+        if (fd >= 0)
+            return fd;
+
+        if (!backend.IsControllerUsable(controller))
+            return CgroupError(CGROUP_ERR_NO_CONTROLLER, ENOENT, "open");
+
+        fd = backend.fileCache.OpenFile(fileType, flags,
+                                        backend.GetPathOfController(controller, FileNameStrings()[fileType]));
+        if (fd < 0)
+            return CgroupError::FromErrno(errno, "open");
+
+        return fd;
+    }
+
+    void InvalidateFile(int fileType, int flags) { backend.fileCache.InvalidateFile(fileType, flags); }
+
+    CgroupResult<size_t> TryReadFile(int controller, int fileType, char *buf, size_t size)
+    {
+        CgroupFileCache::Use use(backend.fileCache);
+        auto fd = TryGetFileFd(controller, fileType, O_RDONLY);
+        if (!fd)
+            return fd.Error();
+
+        ssize_t n = pread(*fd, buf, size, 0);
+        if (n < 0 && CgroupBackend::IsStaleFdError(errno)) {
+            InvalidateFile(fileType, O_RDONLY);
+            fd = TryGetFileFd(controller, fileType, O_RDONLY);
+            if (!fd)
+                return fd.Error();
+            n = pread(*fd, buf, size, 0);
+        }
+
+        if (n < 0)
+            return CgroupError::FromErrno(errno, "read");
+
+        return size_t(n);
+    }
+
+    CgroupResult<void> TryWriteFile(int controller, int fileType, const char *buf, size_t size)
+    {
+        CgroupFileCache::Use use(backend.fileCache);
+        auto fd = TryGetFileFd(controller, fileType, O_WRONLY);
+        if (!fd)
+            return fd.Error();
+
+        ssize_t n = pwrite(*fd, buf, size, 0);
+        if (n < 0 && CgroupBackend::IsStaleFdError(errno)) {
+            InvalidateFile(fileType, O_WRONLY);
+            fd = TryGetFileFd(controller, fileType, O_WRONLY);
+            if (!fd)
+                return fd.Error();
+            n = pwrite(*fd, buf, size, 0);
+        }
+
+        if (n < 0)
+            return CgroupError::FromErrno(errno, "write");
+
+        return CgroupResult<void>();
+    }
+
+    /* Typed access to an interface file of CgroupFiles, through the fd cache */
+    template <typename File>
+    typename File::Value Read()
+    {
+        char buf[File::BufSize];
+        auto n = TryReadFile(File::Controller, File::Type, buf, sizeof(buf));
+        if (!n)
+            backend.ThrowFileError(n.Error(), File::Controller, FileNameStrings()[File::Type]);
+
+        typename File::Value value;
+        if (!File::Parse(buf, *n, value))
+            throw CGroupBaseException("Invalid value '" + std::string(buf, *n) + "' for '" + FileName(File::Type) + "'");
+        return value;
+    }
+
+    template <typename File>
+    void Write(typename File::Value value)
+    {
+        char buf[File::BufSize];
+        size_t n = File::Format(value, Type, buf);
+        auto written = TryWriteFile(File::Controller, File::Type, buf, n);
+        if (!written)
+            backend.ThrowFileError(written.Error(), File::Controller, FileNameStrings()[File::Type], buf, n);
+    }
+
+    template <typename File>
+    CgroupResult<typename File::Value> TryRead()
+    {
+        char buf[File::BufSize];
+        auto n = TryReadFile(File::Controller, File::Type, buf, sizeof(buf));
+        if (!n)
+            return n.Error();
+
+        typename File::Value value;
+        if (!File::Parse(buf, *n, value))
+            return CgroupError(CGROUP_ERR_INVALID, EINVAL, "parse");
+        return value;
+    }
+
+    template <typename File>
+    CgroupResult<void> TryWrite(typename File::Value value)
+    {
+        char buf[File::BufSize];
+        size_t n = File::Format(value, Type, buf);
+        return TryWriteFile(File::Controller, File::Type, buf, n);
+    }
+
+    void SetLimits(const LimitSet &limits)
+    {
+        limits.Validate();
+        if (limits.cpuQuota)
+            backend.ValidateCPUCfsQuota(*limits.cpuQuota);
+        if (limits.cpuPeriod)
+            backend.ValidateCPUCfsPeiod(*limits.cpuPeriod);
+
+        CgroupLimitPlan plan;
+        backend.PlanLimits(limits, plan);
+        ApplyLimitPlan(plan);
+    }
+
+    /* Writes plan in order, files already written are restored to their
+       previous value if a later write fails. A previous value is not read
+       for the last write, nor when PlanLimits() already read it. */
+    void ApplyLimitPlan(const CgroupLimitPlan &plan)
+    {
+        std::vector<std::string> previous(plan.size());
+        CgroupResult<void> result;
+        bool readFailed = false;
+        size_t i = 0;
+
+        for (; i < plan.size(); i++) {
+            const CgroupLimitWrite &write = plan[i];
+            if (write.hasPrevious) {
+                previous[i] = write.previous;
+            } else if (i + 1 < plan.size()) {
+                char buf[CGROUP_NUM_BUF_LEN];
+                auto n = TryReadFile(write.controller, write.fileType, buf, sizeof(buf));
+                if (!n) {
+                    result = n.Error();
+                    readFailed = true;
+                    break;
+                }
+                const char *eol = static_cast<const char *>(memchr(buf, '\n', *n));
+                previous[i].assign(buf, eol ? eol - buf : *n);
+            }
+
+            result = TryWriteFile(write.controller, write.fileType, write.value.data(), write.value.size());
+            if (!result)
+                break;
+        }
+        if (result)
+            return;
+
+        const CgroupLimitWrite &failed = plan[i];
+        if (readFailed)
+            CGROUP_ERROR("Failed to read the previous value of '" << FileName(failed.fileType) << "', rolling back "
+                         << i << " writes, errno:" << result.Error().error);
+        else
+            CGROUP_ERROR("Failed to set '" << FileName(failed.fileType) << "' to '" << failed.value << "', rolling back "
+                         << i << " writes, errno:" << result.Error().error);
+
+        /* the failed entry may have been read but not written */
+        for (size_t k = i; k-- > 0; ) {
+            auto restored = TryWriteFile(plan[k].controller, plan[k].fileType, previous[k].data(), previous[k].size());
+            if (!restored)
+                CGROUP_ERROR("Failed to restore '" << FileName(plan[k].fileType) << "' to '" << previous[k]
+                             << "', errno:" << restored.Error().error);
+        }
+
+        if (readFailed)
+            backend.ThrowFileError(result.Error(), failed.controller, FileNameStrings()[failed.fileType]);
+        backend.ThrowFileError(result.Error(), failed.controller, FileNameStrings()[failed.fileType],
+                               failed.value.data(), failed.value.size());
+    }
+
+    void SetCpuCfsQuota(long long quota) { backend.SetCpuCfsQuota(quota); }
+    long long GetCpuCfsQuota() { return backend.GetCpuCfsQuota(); }
+
+    const std::vector<CgroupSampleFile> &GetSampleFiles() { return backend.GetSampleFiles(); }
+    void ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample)
+    {
+        backend.ParseSampleFile(fileType, buf, len, sample);
+    }
+
+private:
+    Backend &backend;
+};
+
+/* Calls fn with the BasicCgroup of backend, type is the backend type of the process */
+template <typename Fn>
+inline void DispatchBackend(CgroupBackendType type, CgroupBackend &backend, Fn &&fn)
+{
+    switch (type)
+    {
+        case CGROUP_BACKEND_TYPE_V1:
+            fn(BasicCgroup<CgroupBackendV1>(static_cast<CgroupBackendV1 &>(backend)));
+            break;
+        case CGROUP_BACKEND_TYPE_V2:
+            fn(BasicCgroup<CgroupBackendV2>(static_cast<CgroupBackendV2 &>(backend)));
+            break;
+        default:
+            throw CGroupBaseException("Unknown cgroup backend type " + std::to_string(type));
+    }
+}
+
+} // namespace mdsd
+
+#endif // __BASICCGROUP_HH__
@@ -2,6 +2,7 @@
 #include "CgroupBackend.hh"
 #include "CgroupBackendV2.hh"
 #include "CgroupBackendV1.hh"
+#include "WorkerPool.hh"
 
 
 #include <unistd.h>
@@ -11,10 +12,16 @@
 #include <iostream>
 
 #include <exception>
+#include <errno.h>
 
 // for file open/read
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace mdsd;
 
@@ -33,6 +40,201 @@ void Cgroup::SetOwner(uid_t uid, gid_t gid)
     backend->SetOwner(uid, gid, CGROUP_CONTROLLER_LAST);
 }
 
+#define CGROUP_MIGRATE_ROUNDS 8
+
+size_t Cgroup::MigrateAll(Cgroup &from, Cgroup &to, CgroupTaskErrors &errors)
+{
+    std::vector<pid_t> pids;
+    CgroupTaskErrors roundErrors;
+    size_t moved = 0;
+
+    for (int round = 0; round < CGROUP_MIGRATE_ROUNDS; round++)
+    {
+        from.backend->GetTasks(pids);
+        roundErrors.clear();
+        if (pids.empty())
+            break;
+
+        size_t n = to.backend->AddTasks(pids, roundErrors);
+        moved += n;
+
+        /* only failures left, another round would not do better */
+        if (n == 0)
+            break;
+    }
+
+    /* the failures of the last round are the processes left behind */
+    for (const auto &error : roundErrors)
+        if (error.error != ESRCH)
+            errors.push_back(error);
+
+    CGROUP_DEBUG("Migrated " << moved << " processes from '" << from.backend->GetRelativeBasePath()
+                 << "' to '" << to.backend->GetRelativeBasePath() << "'");
+    return moved;
+}
+
+#define CGROUP_TERMINATE_MAX_EVENTS 64
+#define CGROUP_TERMINATE_MAX_DELAY_MS 50 /* between two listings of the groups without notification */
+
+void Cgroup::Terminate(std::chrono::milliseconds timeout)
+{
+    std::vector<std::string> errors;
+
+    if (TerminateAll({ this }, timeout, errors) == 0)
+        throw CGroupBaseException(errors[0]);
+}
+
+static std::string TerminateError(const CgroupError &error, const char *what, Cgroup *cgroup)
+{
+    return "errno:" + std::to_string(error.error) + ", cannot " + error.op + " " + what +
+           " '" + cgroup->backend->GetRelativeBasePath() + "'";
+}
+
+/*
+ * Waits for the killed groups to have no process left. Groups with a
+ * populated fd (cgroup.events on v2) are woken through epoll, the other
+ * ones are listed again with a growing delay. Returns the groups that
+ * are empty, errors are set for the others.
+ */
+static std::vector<size_t> WaitEmpty(const std::vector<Cgroup *> &cgroups, const std::vector<size_t> &killed,
+                                     std::chrono::steady_clock::time_point deadline, std::vector<std::string> &errors)
+{
+    std::vector<size_t> empty;
+    std::vector<size_t> listed;
+    std::vector<CgroupFileCache::Use> uses;   /* keep the populated fds in the epoll set open */
+    size_t watched = 0;
+
+    /* false once the group is empty or failed */
+    auto populated = [&](size_t i) {
+        auto res = cgroups[i]->backend->TryIsPopulated();
+        if (res && *res)
+            return true;
+        if (res || res.Error().code == CGROUP_ERR_NOT_FOUND)
+            empty.push_back(i);
+        else
+            errors[i] = TerminateError(res.Error(), "check the tasks of", cgroups[i]);
+        return false;
+    };
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    /* the read of populated() arms the fd, a change after it is reported */
+    for (size_t i : killed)
+    {
+        if (!populated(i))
+            continue;
+
+        struct epoll_event event = {};
+        event.events = EPOLLPRI;
+        event.data.u64 = i;
+        uses.push_back(cgroups[i]->backend->UseFiles());
+        int fd = epollFd >= 0 ? cgroups[i]->backend->GetPopulatedFd() : -1;
+        if (fd >= 0 && epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0)
+            watched++;
+        else
+            listed.push_back(i);
+    }
+
+    auto delay = std::chrono::milliseconds(1);
+    while (watched || !listed.empty())
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            break;
+
+        auto wait = listed.empty() ? remaining : std::min(remaining, delay);
+        struct epoll_event events[CGROUP_TERMINATE_MAX_EVENTS];
+        int n = 0;
+        if (watched)
+            n = epoll_wait(epollFd, events, CGROUP_TERMINATE_MAX_EVENTS, wait.count());
+        else
+            std::this_thread::sleep_for(wait);
+
+        for (int k = 0; k < n; k++)
+        {
+            size_t i = events[k].data.u64;
+            if (populated(i))
+                continue;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, cgroups[i]->backend->GetPopulatedFd(), NULL);
+            watched--;
+        }
+
+        if (!listed.empty()) {
+            listed.erase(std::remove_if(listed.begin(), listed.end(), [&](size_t i) { return !populated(i); }),
+                         listed.end());
+            delay = std::min(delay * 2, std::chrono::milliseconds(CGROUP_TERMINATE_MAX_DELAY_MS));
+        }
+    }
+
+    if (epollFd >= 0)
+        close(epollFd);
+
+    /* whatever is neither empty nor failed timed out */
+    std::vector<char> done(cgroups.size());
+    for (size_t i : empty)
+        done[i] = 1;
+    for (size_t i : killed)
+        if (!done[i] && errors[i].empty())
+            errors[i] = "tasks of '" + cgroups[i]->backend->GetRelativeBasePath() + "' still running after timeout";
+
+    return empty;
+}
+
+size_t Cgroup::TerminateAll(const std::vector<Cgroup *> &cgroups, std::chrono::milliseconds timeout,
+                            std::vector<std::string> &errors, WorkerPool *pool)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<size_t> killed;
+
+    errors.assign(cgroups.size(), std::string());
+
+    /* every group is killed first so that they all drain at the same time */
+    for (size_t i = 0; i < cgroups.size(); i++)
+    {
+        auto res = cgroups[i]->backend->TryKill();
+        if (res || res.Error().code == CGROUP_ERR_NOT_FOUND)
+            killed.push_back(i);
+        else
+            errors[i] = TerminateError(res.Error(), "kill the tasks of", cgroups[i]);
+    }
+
+    std::vector<size_t> empty = WaitEmpty(cgroups, killed, deadline, errors);
+
+    /* each job writes its own entry of errors */
+    std::atomic<size_t> removed(0);
+    auto remove = [&cgroups, &errors, &removed](size_t i) {
+        try {
+            cgroups[i]->backend->Remove();
+            removed++;
+        }
+        catch (const std::exception &e) {
+            errors[i] = e.what();
+        }
+    };
+
+    for (size_t i : empty) {
+        if (pool)
+            pool->Submit([&remove, i] { remove(i); });
+        else
+            remove(i);
+    }
+    if (pool)
+        pool->Wait();
+
+    CGROUP_DEBUG("Terminated " << removed.load() << " of " << cgroups.size() << " groups");
+    return removed.load();
+}
+
+pid_t Cgroup::Spawn(const std::string &path, const std::vector<std::string> &args)
+{
+    std::vector<char *> argv;
+    for (const auto &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(NULL);
+
+    return backend->Spawn(path.c_str(), argv.data());
+}
+
 std::shared_ptr<CgroupBackend> Cgroup::GetCgroupBackend()
 {
     return this->backend;
@@ -42,24 +244,51 @@ void Cgroup::SetCPULimitInPercentage(unsigned int cpu, unsigned int softquota)
 {
     CGROUP_DEBUG("CPU: cpu=" << cpu << " softquota=" << softquota);
 
+    LimitSet limits;
+    AddCPULimitInPercentage(limits, cpu, softquota);
+    backend->SetLimits(limits);
+}
+
+void Cgroup::SetMemoryLimitInMB(float memory, unsigned int softquota)
+{
+    CGROUP_DEBUG("MEM: memory=" << memory << " softquota=" << softquota);
+
+    LimitSet limits;
+    AddMemoryLimitInMB(limits, memory, softquota);
+    backend->SetLimits(limits);
+}
+
+void Cgroup::SetLimits(const LimitSet &limits)
+{
+    CGROUP_DEBUG("Limits:" << limits.ToString());
+
+    backend->SetLimits(limits);
+}
+
+void Cgroup::AddCPULimitInPercentage(LimitSet &limits, unsigned int cpu, unsigned int softquota)
+{
     unsigned long long period = 100;
     unsigned long long hard = cpu * (1 + double(softquota)/100); // hard
 
+    /* without a soft quota the shares go back to the default, so that a
+       reconcile resets the ones of a quota dropped from the config */
     if (softquota > 0) {
-        backend->SetCpuShares(cpu); // soft
+        limits.cpuShares = cpu; // soft
+    } else {
+        limits.cpuShares = CGROUP_CPU_SHARES_DEFAULT;
     }
 
-    backend->SetCpuCfsQuota(hard * 1000);
-    backend->SetCpuCfsPeriod(period * 1000);
+    limits.cpuQuota = hard * 1000;
+    limits.cpuPeriod = period * 1000;
 }
 
-void Cgroup::SetMemoryLimitInMB(float memory, unsigned int softquota)
+void Cgroup::AddMemoryLimitInMB(LimitSet &limits, float memory, unsigned int softquota)
 {
-    CGROUP_DEBUG("MEM: memory=" << memory << " softquota=" << softquota);
-
     auto hard = memory * (1 + double(softquota)/100);
 
-    backend->SetMemoryHardLimit(CGROUP_MEM_MB_TO_KB(hard));
+    limits.memoryHardLimit = CGROUP_MEM_MB_TO_KB(hard);
     if (softquota > 0)
-        backend->SetMemorySoftLimit(CGROUP_MEM_MB_TO_KB(memory));
+        limits.memorySoftLimit = CGROUP_MEM_MB_TO_KB(memory);
+    else
+        limits.memorySoftLimit = CGROUP_MEMORY_PARAM_UNLIMITED;
 }
@@ -2,13 +2,20 @@
 #ifndef __CGROUP_HH__
 #define __CGROUP_HH__
 
+#include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 #include "CgroupBackend.hh"
 #include "CgroupDef.hh"
+#include "LimitSet.hh"
 
 namespace mdsd {
 
+#define CGROUP_TERMINATE_TIMEOUT_MS 5000
+
+class WorkerPool;
+
 class Cgroup
 {
 public:
@@ -17,7 +24,31 @@ public:
 
     void SetCPULimitInPercentage(unsigned int cpu, unsigned int softquota = 0);
     void SetMemoryLimitInMB(float memory, unsigned int softquota = 0);
+    void SetLimits(const LimitSet &limits);
+
+    /* Fill a LimitSet the same way the setters above would write it */
+    static void AddCPULimitInPercentage(LimitSet &limits, unsigned int cpu, unsigned int softquota = 0);
+    static void AddMemoryLimitInMB(LimitSet &limits, float memory, unsigned int softquota = 0);
     void SetOwner(uid_t uid, gid_t gid);
+
+    /* Move every process of from into to, repeating while from gets new
+       ones, returns the number of processes moved. Processes that exit
+       meanwhile are not reported in errors. */
+    static size_t MigrateAll(Cgroup &from, Cgroup &to, CgroupTaskErrors &errors);
+
+    /* Kill every process of the group and of its descendants, wait until
+       they are gone and remove the group with its descendants. Throws when
+       processes are left after timeout. */
+    void Terminate(std::chrono::milliseconds timeout = std::chrono::milliseconds(CGROUP_TERMINATE_TIMEOUT_MS));
+    /* Terminate() of many groups against a single deadline: all of them are
+       killed before any is waited for, then removed on pool when given
+       (not from a job of pool). errors[i] is left empty when cgroups[i]
+       was removed. Returns the number of groups removed. */
+    static size_t TerminateAll(const std::vector<Cgroup *> &cgroups, std::chrono::milliseconds timeout,
+                               std::vector<std::string> &errors, WorkerPool *pool = nullptr);
+
+    /* Execute path with args (args[0] included) inside this cgroup, returns the pid */
+    pid_t Spawn(const std::string &path, const std::vector<std::string> &args);
     std::shared_ptr<CgroupBackend> GetCgroupBackend();
     std::shared_ptr<CgroupBackend> backend;
 
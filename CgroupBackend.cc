@@ -1,4 +1,6 @@
 #include "CgroupBackend.hh"
+#include "CgroupContext.hh"
+#include "CgroupTree.hh"
 #include "EnumToString.hh"
 
 #include <unistd.h>
@@ -19,8 +21,13 @@
 // for file open/read
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <signal.h>
 
 #include <algorithm> 
+#include <charconv>
 #include <functional> 
 #include <cctype>
 #include <locale>
@@ -31,29 +38,29 @@ using namespace std;
 using namespace boost::algorithm;
 namespace fs = std::experimental::filesystem;
 
-std::string CgroupBackend::backendControllerFileMap[CGROUP_BACKEND_TYPE_LAST][CGROUP_CONTROLLER_FILE_LAST];
 /* this should match the enum CgroupController */
 CGROUP_ENUM_DECL(CgroupBackendType);
 CGROUP_ENUM_IMPL(CgroupBackendType, CGROUP_BACKEND_TYPE_LAST, "none", "cgroup2", "cgroup");
 
-CgroupBackend::CgroupBackend(CgroupBackendType type, const std::string &placement)
-    : backendType(type)
+const std::string CgroupBackend::CGROUP_ROOT_PATH = "/sys/fs/cgroup/";
+
+CgroupBackend::CgroupBackend(CgroupBackendType type, const std::string &placement,
+                             const std::shared_ptr<const CgroupContext> &context, const std::string *fileNames)
+    : backendType(type), context(context), fileNames(fileNames)
 {
-    backenName = CgroupBackendTypeTypeToString(backendType);
     // this->Init();
 }
 
 void CgroupBackend::Init()
 {
     if (!this->Available())
-        throw std::runtime_error(this->backenName + " not found, make sure your have mounted " + this->backenName + " on your system");
-    
-    this->DetectMounts();
+        throw std::runtime_error(GetBackendName() + " not found, make sure your have mounted " + GetBackendName() + " on your system");
 }
 
+/* not kept in the backend, there is one per cgroup */
 std::string CgroupBackend::GetBackendName()
 {
-    return backenName;
+    return CgroupBackendTypeTypeToString(backendType);
 }
 
 CgroupBackendType CgroupBackend::GetBackendType()
@@ -61,9 +68,9 @@ CgroupBackendType CgroupBackend::GetBackendType()
     return backendType;
 }
 
-std::string CgroupBackend::GetControllerFileName(int controllerFileType)
+const std::string& CgroupBackend::GetControllerFileName(int controllerFileType)
 {
-    return CgroupBackend::backendControllerFileMap[this->backendType][controllerFileType];
+    return this->fileNames[controllerFileType];
 }
 
 std::string CgroupBackend::GetRelativePlacement(const std::string& placement)
@@ -71,84 +78,10 @@ std::string CgroupBackend::GetRelativePlacement(const std::string& placement)
     return replace_all_copy(placement, this->CGROUP_ROOT_PATH, "");
 }
 
-/* We're looking for one 'cgroup' fs mount */
+/* The mounts were looked at once by the context */
 bool CgroupBackend::Available()
 {
-    bool ret = false;
-    FILE *mounts = NULL;
-    struct mntent entry;
-    char buf[CGROUP_MAX_VAL];
-    std::string contStr;
-
-    if (!(mounts = fopen(PROC_MOUNTS_PATH, "r")))
-        return false;
-    try
-    {    
-        while (getmntent_r(mounts, &entry, buf, sizeof(buf)) != NULL)
-        {
-            if (strcmp(entry.mnt_type, this->backenName.c_str()) != 0)
-                continue;
-
-            if (this->backendType == CGROUP_BACKEND_TYPE_V2)
-            {
-                /* Systemd uses cgroup v2 for process tracking but no controller is
-                * available. We should consider this configuration as cgroup v2 is
-                * not available. */
-                std::string contFile = std::string(entry.mnt_dir) + "/cgroup.controllers";
-                contStr = FileReadAll(contFile);
-            
-                if (contStr == "")
-                    continue;
-            }
-
-            ret = true;
-            break;
-        }
-    }
-    catch(const std::exception& e)
-    {
-        CGROUP_ERROR(e.what());
-    }
-
-    if (mounts)
-        fclose(mounts);
-    return ret;
-}
-
-
-// virtual
-int CgroupBackend::DetectMounts()
-{
-    FILE *mounts = NULL;
-    struct mntent entry;
-    char buf[CGROUP_MAX_VAL];
-    int ret = -1;
-    size_t i;
-
-    mounts = fopen(PROC_MOUNTS_PATH, "r");
-    if (mounts == NULL) {
-        CGROUP_ERROR("errno=" << errno <<" Unable to open " << PROC_MOUNTS_PATH);
-        return -1;
-    }
-
-    try
-    {
-        while (getmntent_r(mounts, &entry, buf, sizeof(buf)) != NULL)
-        {
-            if(this->DetectMounts(entry.mnt_type, entry.mnt_opts, entry.mnt_dir) < 0)
-                break;
-        }
-
-        ret = 0;
-    }
-    catch(const std::exception& e)
-    {
-        CGROUP_ERROR(e.what());
-    }
-
-    if (mounts)
-        fclose(mounts);
-    return ret;
+    return context && context->GetBackendType() == this->backendType;
 }
 
 /*
@@ -184,6 +117,9 @@ void CgroupBackend::DetectPlacement(pid_t pid, const std::string &path)
 
         this->DetectPlacement(path, controllers, selfpath);
     }
+
+    // placement may have moved, cached fds would point to the old group
+    InvalidateFileCache();
 }
 
 bool CgroupBackend::HasEmptyTasks(int controller)
@@ -191,6 +127,230 @@ bool CgroupBackend::HasEmptyTasks(int controller)
     return true;
 }
 
+/*
+ * The kernel takes one pid per write, but the fd of each file is opened
+ * once (and cached) for the whole batch. A pid is attached once it went
+ * into every file, the first error is reported otherwise.
+ */
+size_t CgroupBackend::WriteTasks(const std::vector<std::pair<int, std::string>> &files, const pid_t *pids,
+                                 size_t count, CgroupTaskErrors &errors)
+{
+    auto use = UseFiles();
+    std::vector<int> fds;
+    for (const auto &file : files)
+        fds.push_back(GetCgroupFileFd(file.first, file.second, O_WRONLY));
+
+    size_t attached = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        char buf[CGROUP_NUM_BUF_LEN];
+        auto res = std::to_chars(buf, buf + sizeof(buf), pids[i]);
+        int error = 0;
+
+        for (int fd : fds)
+            if (pwrite(fd, buf, res.ptr - buf, 0) < 0 && !error)
+                error = errno;
+
+        if (error)
+            errors.push_back({ pids[i], error });
+        else
+            attached++;
+    }
+
+    return attached;
+}
+
+/* Appends the pids of a cgroup.procs or tasks fd, returns 0 or the errno of the read */
+static int ReadPids(int fd, std::vector<pid_t> &pids)
+{
+    std::vector<char> content(CGROUP_STAT_BUF_LEN);
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(fd, &content[len], content.size() - len)) > 0) {
+        len += n;
+        if (len == content.size())
+            content.resize(content.size() * 2);
+    }
+    if (n < 0)
+        return errno;
+
+    const char *cur = content.data();
+    const char *end = cur + len;
+    while (cur < end)
+    {
+        pid_t pid;
+        auto res = std::from_chars(cur, end, pid);
+        if (res.ec == std::errc())
+            pids.push_back(pid);
+        cur = res.ptr + 1;
+    }
+    return 0;
+}
+
+/* Not through the fd cache, v1 keeps the pid list of an open file for a second */
+void CgroupBackend::ReadTasks(const std::string &path, std::vector<pid_t> &pids)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            throw CGroupFileNotFoundException("File '" + path + "' not found");
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot open '" + path + "'");
+    }
+
+    int err = ReadPids(fd, pids);
+    close(fd);
+    if (err)
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot read '" + path + "'");
+}
+
+/* path without its leading '/', empty for the root of the hierarchy */
+static std::string RelativeToRoot(const std::string &path)
+{
+    size_t start = path.find_first_not_of('/');
+    return start == std::string::npos ? std::string() : path.substr(start);
+}
+
+CgroupResult<size_t> CgroupBackend::SignalTree(int controller, const std::string &path, int signal)
+{
+    std::string relative = RelativeToRoot(path);
+    int rootFd = context->GetRootFd(controller);
+    if (rootFd < 0)
+        return CgroupError(CGROUP_ERR_NO_CONTROLLER, ENOENT, "open");
+    /* never every process of the hierarchy */
+    if (relative.empty())
+        return CgroupError(CGROUP_ERR_INVALID, EINVAL, "signal");
+
+    auto tree = CgroupTree::Snapshot(rootFd, relative);
+    if (!tree)
+        return tree.Error();
+
+    const std::string &procs = GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_PROCS);
+    std::vector<pid_t> pids;
+    size_t found = 0;
+
+    for (size_t i = 0; i < tree.Value().Size(); i++)
+    {
+        std::string file = tree.Value().GetPath(i) + "/" + procs;
+        int fd = openat(rootFd, file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT)
+                continue;
+            return CgroupError::FromErrno(errno, "open");
+        }
+
+        pids.clear();
+        int err = ReadPids(fd, pids);
+        close(fd);
+        if (err == ENODEV)
+            continue;
+        if (err)
+            return CgroupError::FromErrno(err, "read");
+
+        found += pids.size();
+        if (signal)
+            for (pid_t pid : pids)
+                kill(pid, signal);  /* ESRCH when it exited meanwhile */
+    }
+
+    return found;
+}
+
+int CgroupBackend::GetPopulatedFd()
+{
+    return -1;
+}
+
+/*
+ * Only async-signal-safe calls in the child, the parent may be
+ * multi-threaded. exec failures are reported through errorFd, which is
+ * close-on-exec so the parent reads EOF once exec succeeded.
+ */
+void CgroupBackend::SpawnExec(const char *path, char *const argv[], int errorFd)
+{
+    execve(path, argv, environ);
+
+    int err = errno;
+    if (write(errorFd, &err, sizeof(err)) < 0)
+        _exit(127);
+    _exit(127);
+}
+
+pid_t CgroupBackend::SpawnWaitExec(pid_t pid, int errorFd, const char *path)
+{
+    int err;
+    ssize_t n;
+
+    while ((n = read(errorFd, &err, sizeof(err))) < 0 && errno == EINTR)
+        ;
+    close(errorFd);
+
+    if (n == sizeof(err)) {
+        waitpid(pid, NULL, 0);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot execute '" + std::string(path) + "'");
+    }
+
+    return pid;
+}
+
+pid_t CgroupBackend::Spawn(const char *path, char *const argv[])
+{
+    int gate[2], error[2];
+
+    if (pipe2(gate, O_CLOEXEC) < 0)
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot create pipe");
+    if (pipe2(error, O_CLOEXEC) < 0) {
+        int err = errno;
+        close(gate[0]);
+        close(gate[1]);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot create pipe");
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char c;
+        ssize_t n;
+
+        /* wait until the parent placed us, EOF means it gave up */
+        close(gate[1]);
+        close(error[0]);
+        while ((n = read(gate[0], &c, 1)) < 0 && errno == EINTR)
+            ;
+        if (n != 1)
+            _exit(127);
+        SpawnExec(path, argv, error[1]);
+    }
+
+    int err = errno;
+    close(gate[0]);
+    close(error[1]);
+    if (pid < 0) {
+        close(gate[1]);
+        close(error[0]);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot fork");
+    }
+
+    try {
+        AddTask(pid);
+    } catch (const CGroupBaseException &e) {
+        close(gate[1]);
+        close(error[0]);
+        waitpid(pid, NULL, 0);
+        throw;
+    }
+
+    if (write(gate[1], "g", 1) != 1) {
+        err = errno;
+        close(gate[1]);
+        close(error[0]);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot release spawned task");
+    }
+    close(gate[1]);
+
+    return SpawnWaitExec(pid, error[0], path);
+}
+
 // should be probably virtual pure
 void CgroupBackend::SetOwner(uid_t uid, gid_t gid, int controllers)
 {
@@ -214,6 +374,66 @@ void CgroupBackend::SetOwner(uid_t uid, gid_t gid, int controllers)
     }
 }
 
+bool CgroupBackend::HasOwner(uid_t uid, gid_t gid)
+{
+    struct stat st;
+
+    if (stat(GetBasePath().c_str(), &st) < 0)
+        return false;
+
+    return st.st_uid == uid && st.st_gid == gid;
+}
+
+unsigned long long CgroupBackend::GetCgroupId()
+{
+    struct stat st;
+
+    if (stat(GetBasePath().c_str(), &st) < 0)
+        return 0;
+
+    return st.st_ino;
+}
+
+/* Interface files are regular files, child groups the only directories */
+void CgroupBackend::ListChildren(const std::string &path, std::vector<std::string> &names)
+{
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        if (errno == ENOENT)
+            return;
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot list '" + path + "'");
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        names.push_back(entry->d_name);
+    }
+    closedir(dir);
+}
+
+/* cgroupfs refuses to unlink interface files, groups go with rmdir, children first */
+std::uintmax_t CgroupBackend::RemoveTree(int controller, const std::string &path)
+{
+    std::string relative = RelativeToRoot(path);
+
+    /* never the root of the hierarchy */
+    int rootFd = context->GetRootFd(controller);
+    if (relative.empty() || rootFd < 0)
+        return 0;
+
+    auto tree = CgroupTree::Snapshot(rootFd, relative);
+    if (!tree)
+        ThrowError(tree.Error(), "'" + path + "'");
+
+    auto removed = tree.Value().Remove(rootFd);
+    if (!removed)
+        ThrowError(removed.Error(), "'" + path + "'");
+
+    return *removed;
+}
 
 int CgroupBackend::DetectControllers(int controllers, int alreadyDetected)
 {
@@ -222,19 +442,21 @@ int CgroupBackend::DetectControllers(int controllers, int alreadyDetected)
 
 void CgroupBackend::SetCgroupValueU64(int controller, const std::string& key, unsigned long long int value)
 {
-    auto strval = std::to_string(value);
-    SetCgroupValueStr(controller, key, strval);
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    WriteCgroupFile(controller, key, buf, res.ptr - buf);
 }
 
 void CgroupBackend::SetCgroupValueI64(int controller, const std::string& key, long long int value)
 {
-    auto strval = std::to_string(value);
-    SetCgroupValueStr(controller, key, strval);
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    WriteCgroupFile(controller, key, buf, res.ptr - buf);
 }
 
 void CgroupBackend::SetCgroupValueStr(int controller, const std::string& key, const std::string& value)
 {
-    SetCgroupValueRaw(GetPathOfController(controller, key), value);
+    WriteCgroupFile(controller, key, value.data(), value.size());
 }
 
 void CgroupBackend::SetCgroupValueRaw(const std::string &path, const std::string& value)
@@ -247,19 +469,45 @@ void CgroupBackend::SetCgroupValueRaw(const std::string &path, const std::string
         throw CGroupBaseException("Invalid value '" + value + "' for '" + (tmp + 1) + "'");
 }
 
-unsigned long long int CgroupBackend::GetCgroupValueU64(int controller, const std::string &key)
+unsigned long long int CgroupBackend::GetCgroupValueU64(int controller, const std::string &key,
+                                                       unsigned long long int maxValue)
 {
-    return std::stoull(GetCgroupValueStr(controller, key));
+    char buf[CGROUP_NUM_BUF_LEN];
+    unsigned long long int value;
+    ssize_t n = ReadCgroupFile(controller, key, buf, sizeof(buf));
+
+    const char *cur = buf;
+    if (!ParseValueU64(cur, buf + n, value, maxValue))
+        throw CGroupBaseException("Invalid value '" + std::string(buf, n) + "' for '" + key + "'");
+
+    return value;
 }
 
-long long int CgroupBackend::GetCgroupValueI64(int controller, const std::string &key)
+long long int CgroupBackend::GetCgroupValueI64(int controller, const std::string &key,
+                                               long long int maxValue)
 {
-    return std::stoll(GetCgroupValueStr(controller, key));
+    char buf[CGROUP_NUM_BUF_LEN];
+    long long int value;
+    ssize_t n = ReadCgroupFile(controller, key, buf, sizeof(buf));
+
+    const char *cur = buf;
+    if (!ParseValueI64(cur, buf + n, value, maxValue))
+        throw CGroupBaseException("Invalid value '" + std::string(buf, n) + "' for '" + key + "'");
+
+    return value;
 }
 
 std::string CgroupBackend::GetCgroupValueStr(int controller, const std::string &key)
 {
-    return GetCgroupValueRaw(GetPathOfController(controller, key));
+    std::string value = ReadCgroupFileAll(controller, key);
+
+    /* Only the first line is relevant, and the terminating '\n' has
+       sometimes harmful effects to the caller */
+    auto eol = value.find('\n');
+    if (eol != std::string::npos)
+        value.resize(eol);
+
+    return value;
 }
 
 std::string CgroupBackend::GetCgroupValueRaw(const std::string &path)
@@ -275,6 +523,252 @@ std::string CgroupBackend::GetCgroupValueRaw(const std::string &path)
     return value;
 }
 
+int CgroupBackend::GetCgroupFileFd(int controller, const std::string &key, int flags)
+{
+    auto fd = TryGetCgroupFileFd(controller, key, flags);
+    if (!fd) {
+        /* throws the controller exception if that was the cause */
+        std::string path = GetPathOfController(controller, key);
+        if (fd.Error().error == ENOENT)
+            throw CGroupFileNotFoundException("File '" + path + "' not found");
+        ThrowError(fd.Error(), "'" + path + "'");
+    }
+
+    return *fd;
+}
+
+CgroupResult<int> CgroupBackend::TryGetCgroupFileFd(int controller, const std::string &key, int flags)
+{
+    int fd = fileCache.Lookup(controller, key, flags);
+    if (fd >= 0)
+        return fd;
+
+    if (!IsControllerUsable(controller))
+        return CgroupError(CGROUP_ERR_NO_CONTROLLER, ENOENT, "open");
+
+    fd = fileCache.Open(controller, key, flags, GetPathOfController(controller, key));
+    if (fd < 0)
+        return CgroupError::FromErrno(errno, "open");
+
+    return fd;
+}
+
+ssize_t CgroupBackend::ReadCgroupFile(int controller, const std::string &key, char *buf, size_t size)
+{
+    auto n = TryReadCgroupFile(controller, key, buf, size);
+    if (!n)
+        ThrowFileError(n.Error(), controller, key);
+
+    return *n;
+}
+
+CgroupResult<size_t> CgroupBackend::TryReadCgroupFile(int controller, const std::string &key, char *buf, size_t size)
+{
+    auto use = UseFiles();
+    auto fd = TryGetCgroupFileFd(controller, key, O_RDONLY);
+    if (!fd)
+        return fd.Error();
+
+    ssize_t n = pread(*fd, buf, size, 0);
+    if (n < 0 && IsStaleFdError(errno)) {
+        fileCache.Invalidate(controller, key, O_RDONLY);
+        fd = TryGetCgroupFileFd(controller, key, O_RDONLY);
+        if (!fd)
+            return fd.Error();
+        n = pread(*fd, buf, size, 0);
+    }
+
+    if (n < 0)
+        return CgroupError::FromErrno(errno, "read");
+
+    return size_t(n);
+}
+
+std::string CgroupBackend::ReadCgroupFileAll(int controller, const std::string &key)
+{
+    char buf[CGROUP_MAX_VAL];
+    ssize_t n = ReadCgroupFile(controller, key, buf, sizeof(buf));
+    std::string output(buf, n);
+
+    /* Rarely needed: continue from where the first read stopped */
+    if (n == sizeof(buf)) {
+        auto use = UseFiles();
+        int fd = GetCgroupFileFd(controller, key, O_RDONLY);
+        while ((n = pread(fd, buf, sizeof(buf), output.size())) > 0)
+            output.append(buf, n);
+
+        if (n < 0)
+            throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot read '" + key + "'");
+    }
+
+    return output;
+}
+
+void CgroupBackend::WriteCgroupFile(int controller, const std::string &key, const char *buf, size_t size)
+{
+    auto result = TryWriteCgroupFile(controller, key, buf, size);
+    if (!result)
+        ThrowFileError(result.Error(), controller, key, buf, size);
+}
+
+CgroupResult<void> CgroupBackend::TryWriteCgroupFile(int controller, const std::string &key, const char *buf, size_t size)
+{
+    auto use = UseFiles();
+    auto fd = TryGetCgroupFileFd(controller, key, O_WRONLY);
+    if (!fd)
+        return fd.Error();
+
+    ssize_t n = pwrite(*fd, buf, size, 0);
+    if (n < 0 && IsStaleFdError(errno)) {
+        fileCache.Invalidate(controller, key, O_WRONLY);
+        fd = TryGetCgroupFileFd(controller, key, O_WRONLY);
+        if (!fd)
+            return fd.Error();
+        n = pwrite(*fd, buf, size, 0);
+    }
+
+    if (n < 0)
+        return CgroupError::FromErrno(errno, "write");
+
+    return CgroupResult<void>();
+}
+
+CgroupResult<unsigned long long> CgroupBackend::TryGetCgroupValueU64(int controller, const std::string &key,
+                                                                    unsigned long long maxValue)
+{
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto n = TryReadCgroupFile(controller, key, buf, sizeof(buf));
+    if (!n)
+        return n.Error();
+
+    unsigned long long value;
+    const char *cur = buf;
+    if (!ParseValueU64(cur, buf + *n, value, maxValue))
+        return CgroupError(CGROUP_ERR_INVALID, EINVAL, "parse");
+
+    return value;
+}
+
+CgroupResult<long long> CgroupBackend::TryGetCgroupValueI64(int controller, const std::string &key,
+                                                           long long maxValue)
+{
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto n = TryReadCgroupFile(controller, key, buf, sizeof(buf));
+    if (!n)
+        return n.Error();
+
+    long long value;
+    const char *cur = buf;
+    if (!ParseValueI64(cur, buf + *n, value, maxValue))
+        return CgroupError(CGROUP_ERR_INVALID, EINVAL, "parse");
+
+    return value;
+}
+
+CgroupResult<void> CgroupBackend::TrySetCgroupValueU64(int controller, const std::string &key, unsigned long long value)
+{
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return TryWriteCgroupFile(controller, key, buf, res.ptr - buf);
+}
+
+CgroupResult<void> CgroupBackend::TrySetCgroupValueI64(int controller, const std::string &key, long long value)
+{
+    char buf[CGROUP_NUM_BUF_LEN];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return TryWriteCgroupFile(controller, key, buf, res.ptr - buf);
+}
+
+void CgroupBackend::ThrowError(const CgroupError &error, const std::string &what)
+{
+    std::string message = "errno:" + std::to_string(error.error) + ", cannot " + error.op + " " + what;
+
+    switch (error.code)
+    {
+        case CGROUP_ERR_NOT_FOUND:
+            throw CGroupFileNotFoundException(message);
+        case CGROUP_ERR_NO_CONTROLLER:
+            throw CGroupControllerNotFoundException(message);
+        default:
+            throw CGroupBaseException(message);
+    }
+}
+
+void CgroupBackend::ThrowFileError(const CgroupError &error, int controller, const std::string &key,
+                                   const char *value, size_t size)
+{
+    if (error.code == CGROUP_ERR_NO_CONTROLLER)
+        GetPathOfController(controller, key);   /* throws the original exception */
+
+    if (!value)
+        ThrowError(error, "'" + key + "'");
+
+    if (error.error == EINVAL)
+        throw CGroupBaseException("Invalid value '" + std::string(value, size) + "' for '" + key + "'");
+
+    ThrowError(error, "'" + std::string(value, size) + "' to '" + key + "'");
+}
+
+void CgroupBackend::AddTask(pid_t pid, unsigned int taskflags)
+{
+    auto result = TryAddTask(pid, taskflags);
+    if (!result)
+        ThrowError(result.Error(), "task " + std::to_string(pid) + " of '" + GetBasePath() + "'");
+}
+
+void CgroupBackend::MakeGroup(unsigned int flags)
+{
+    auto result = TryMakeGroup(flags);
+    if (!result)
+        ThrowError(result.Error(), "cgroup '" + GetBasePath() + "'");
+}
+
+void CgroupBackend::InvalidateFileCache()
+{
+    fileCache.Clear();
+}
+
+void CgroupBackend::InvalidateCgroupFile(int controller, const std::string &key, int flags)
+{
+    fileCache.Invalidate(controller, key, flags);
+}
+
+/*
+ * Parse one space separated numeric token starting at cur and move cur
+ * past it. The "max" keyword used by cgroup v2 limits is read as maxValue.
+ */
+template <typename T>
+static bool ParseValueToken(const char *&cur, const char *end, T &value, T maxValue)
+{
+    while (cur < end && (*cur == ' ' || *cur == '\t'))
+        cur++;
+
+    if (end - cur >= 3 && strncmp(cur, "max", 3) == 0) {
+        value = maxValue;
+        cur += 3;
+        return true;
+    }
+
+    auto res = std::from_chars(cur, end, value);
+    if (res.ec != std::errc())
+        return false;
+
+    cur = res.ptr;
+    return true;
+}
+
+bool CgroupBackend::ParseValueU64(const char *&cur, const char *end, unsigned long long int &value,
+                                  unsigned long long int maxValue)
+{
+    return ParseValueToken(cur, end, value, maxValue);
+}
+
+bool CgroupBackend::ParseValueI64(const char *&cur, const char *end, long long int &value,
+                                  long long int maxValue)
+{
+    return ParseValueToken(cur, end, value, maxValue);
+}
+
 std::string CgroupBackend::FileReadAll(const std::string &path)
 {
     std::string output;
@@ -304,6 +798,15 @@ void CgroupBackend::FileWriteStr(const std::string &path, const std::string &buf
     file.close();
 }
 
+/* One read of a flat keyed file into a stack buffer and one parsing pass */
+size_t CgroupBackend::ReadStatFile(int controller, const std::string &key, const CgroupStatParser &parser, void *out)
+{
+    char buf[CGROUP_STAT_BUF_LEN];
+    ssize_t n = ReadCgroupFile(controller, key, buf, sizeof(buf));
+
+    return parser.Parse(buf, n, out);
+}
+
 std::string CgroupBackend::serialize_fileperms(const fs::perms &p)
 {
     std::stringstream buf;
@@ -354,6 +857,42 @@ unsigned long long CgroupBackend::GetCpuShares()
 }
 
 
+// Limits
+
+void CgroupBackend::GetLimits(const LimitSet &wanted, LimitSet &current)
+{
+    if (wanted.cpuQuota)
+        current.cpuQuota = GetCpuCfsQuota();
+    if (wanted.cpuPeriod)
+        current.cpuPeriod = GetCpuCfsPeriod();
+    if (wanted.cpuShares)
+        current.cpuShares = GetCpuShares();
+    if (wanted.memoryHardLimit)
+        current.memoryHardLimit = GetMemoryHardLimit();
+    if (wanted.memorySoftLimit)
+        current.memorySoftLimit = GetMemorySoftLimit();
+    if (wanted.memSwapHardLimit)
+        current.memSwapHardLimit = GetMemSwapHardLimit();
+}
+
+bool CgroupBackend::ReconcileLimits(const LimitSet &limits)
+{
+    LimitSet wanted = limits;
+    if (wanted.cpuShares && *wanted.cpuShares == CGROUP_CPU_SHARES_DEFAULT)
+        wanted.cpuShares = GetDefaultCpuShares();
+
+    LimitSet current;
+    GetLimits(wanted, current);
+
+    LimitSet diff = wanted.Diff(current);
+    if (diff.Empty())
+        return false;
+
+    CGROUP_DEBUG("Reconcile limits:" << diff.ToString());
+    SetLimits(diff);
+    return true;
+}
+
 // Memory
 
 void CgroupBackend::SetMemory(unsigned long long kb)
@@ -367,6 +906,16 @@ int CgroupBackend::GetMemoryStat(unsigned long long *cache,
                         unsigned long long *inactiveFile,
                         unsigned long long *unevictable)
 {
+    CgroupMemoryStat stat;
+    GetMemoryStat(stat);
+
+    *cache = stat.cache >> 10;
+    *activeAnon = stat.activeAnon >> 10;
+    *inactiveAnon = stat.inactiveAnon >> 10;
+    *activeFile = stat.activeFile >> 10;
+    *inactiveFile = stat.inactiveFile >> 10;
+    *unevictable = stat.unevictable >> 10;
+
     return 0;
 }
 
@@ -408,4 +957,60 @@ unsigned long long CgroupBackend::GetMemSwapHardLimit()
 unsigned long long CgroupBackend::GetMemSwapUsage()
 {
     return GetCgroupValueU64(CGROUP_CONTROLLER_MEMORY, GetControllerFileName(CGROUP_CONTROLLER_FILE_MEMORY_SWAP_USAGE)) >> 10;
-}
\ No newline at end of file
+}
+
+// Pids
+
+unsigned long long CgroupBackend::GetPidsCurrent()
+{
+    return GetCgroupValueU64(CGROUP_CONTROLLER_PIDS, GetControllerFileName(CGROUP_CONTROLLER_FILE_PIDS_CURRENT));
+}
+
+
+// Events
+
+int CgroupBackend::OpenEventControl(int controller, int fileType)
+{
+    throw CGroupBaseException("cgroup.event_control is not supported by " + GetBackendName());
+}
+
+
+// Pressure
+
+/* PSI files are core cgroup files on v2, they need no controller */
+int CgroupBackend::GetPressureController(int fileType)
+{
+    return CGROUP_CONTROLLER_NONE;
+}
+
+void CgroupBackend::GetPressure(int fileType, CgroupPressure &pressure)
+{
+    const std::string &key = GetControllerFileName(fileType);
+    char buf[CGROUP_MAX_VAL];
+    ssize_t n = ReadCgroupFile(GetPressureController(fileType), key, buf, sizeof(buf));
+
+    if (!ParsePressure(buf, n, pressure))
+        throw CGroupBaseException("Invalid '" + key + "' data.");
+}
+
+int CgroupBackend::OpenPressureTrigger(int fileType, const std::string &trigger)
+{
+    std::string path = GetPathOfController(GetPressureController(fileType), GetControllerFileName(fileType));
+
+    int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            throw CGroupFileNotFoundException("File '" + path + "' not found");
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot open '" + path + "'");
+    }
+
+    /* the kernel wants the terminating NUL */
+    if (write(fd, trigger.c_str(), trigger.size() + 1) < 0) {
+        int err = errno;
+        close(fd);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot register trigger '"
+                        + trigger + "' on '" + path + "'");
+    }
+
+    return fd;
+}
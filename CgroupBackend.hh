@@ -5,6 +5,10 @@
 #include <memory>
 #include <string>
 #include "CgroupDef.hh"
+#include "CgroupFileCache.hh"
+#include "CgroupResult.hh"
+#include "LimitSet.hh"
+#include "CgroupStat.hh"
 
 #include <experimental/filesystem> // TODO: remove 'experimental'
 #include <boost/algorithm/string.hpp>
@@ -14,6 +18,8 @@ namespace fs = std::experimental::filesystem;
 
 namespace mdsd {
 
+class CgroupContext;
+
 typedef enum {
     CGROUP_CONTROLLER_NONE = 0,
     CGROUP_CONTROLLER_CPU,
@@ -49,9 +55,34 @@ enum {
     CGROUP_CONTROLLER_FILE_MEMORY_SWAP_HARD_LIMIT,
     CGROUP_CONTROLLER_FILE_MEMORY_SWAP_SOFT_LIMIT,
 
+    CGROUP_CONTROLLER_FILE_MEMORY_STAT,
+    CGROUP_CONTROLLER_FILE_CPU_STAT,
+
+    CGROUP_CONTROLLER_FILE_IO_STAT,
+    CGROUP_CONTROLLER_FILE_IO_SERVICED,
+    CGROUP_CONTROLLER_FILE_PIDS_CURRENT,
+
+    CGROUP_CONTROLLER_FILE_CPU_PRESSURE,
+    CGROUP_CONTROLLER_FILE_MEMORY_PRESSURE,
+    CGROUP_CONTROLLER_FILE_IO_PRESSURE,
+
+    CGROUP_CONTROLLER_FILE_MEMORY_EVENTS,
+    CGROUP_CONTROLLER_FILE_MEMORY_SWAP_EVENTS,
+    CGROUP_CONTROLLER_FILE_PIDS_EVENTS,
+    CGROUP_CONTROLLER_FILE_CGROUP_EVENTS,
+
+    CGROUP_CONTROLLER_FILE_CGROUP_CONTROLLERS,
+    CGROUP_CONTROLLER_FILE_CGROUP_SUBTREE_CONTROL,
+    CGROUP_CONTROLLER_FILE_CGROUP_EVENT_CONTROL,
+
+    CGROUP_CONTROLLER_FILE_CGROUP_KILL,
+    CGROUP_CONTROLLER_FILE_FREEZER_STATE,
+
     CGROUP_CONTROLLER_FILE_LAST,
 } CgroupControllerFile;
 
+static_assert(CGROUP_CONTROLLER_FILE_LAST <= CGROUP_FILE_CACHE_SLOTS, "CgroupFileCache has a slot per file type");
+
 typedef enum {
     CGROUP_NONE = 0, /* create subdir under each cgroup if possible. */
     CGROUP_MEM_HIERACHY = 1 << 0, /* call SetMemoryUseHierarchy
@@ -115,46 +146,155 @@ public:
     CGroupMemoryException(const std::string& message): CGroupBaseException(message) {}
 };
 
+/* A pid AddTasks() could not attach, error is the errno of the write */
+struct CgroupTaskError {
+    pid_t pid;
+    int error;
+};
+typedef std::vector<CgroupTaskError> CgroupTaskErrors;
+
+/* An interface file read by a usage sample and the CgroupSampleField it fills */
+struct CgroupSampleFile {
+    unsigned int field;
+    int controller;
+    int fileType;
+    size_t bufSize;
+};
+
+/* An interface file watched by CgroupEventWatcher. Changes are notified
+   through inotify, or on v1 through an eventfd registered with
+   cgroup.event_control when eventControl is set. */
+struct CgroupEventFile {
+    int controller;
+    int fileType;
+    bool eventControl;
+};
+
 class CgroupBackend
 {
 public:
-    CgroupBackend(CgroupBackendType type, const std::string &placement);
+    CgroupBackend(CgroupBackendType type, const std::string &placement,
+                  const std::shared_ptr<const CgroupContext> &context, const std::string *fileNames);
     ~CgroupBackend() {};
 
     virtual void Init();
     virtual bool Available();
-    virtual int DetectMounts();
 
     virtual std::string GetBackendName();
     virtual CgroupBackendType GetBackendType();
+    const std::shared_ptr<const CgroupContext> &GetContext() const { return context; }
 
-    virtual int DetectMounts(const char *mntType, const char *mntOpts, const char *mntDir)  = 0;
     virtual void DetectPlacement(pid_t pid = -1, const std::string &path = "");
     virtual int DetectPlacement(const std::string &path, const std::string &controllers, const std::string &selfpath)  = 0;
     virtual int ValidatePlacement()  = 0;
 
-    virtual void AddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS) = 0;
+    /* Throwing wrapper of TryAddTask() */
+    void AddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual CgroupResult<void> TryAddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS) = 0;
     virtual bool HasEmptyTasks(int controller = CGROUP_CONTROLLER_NONE);
+    /* Attach many pids through one fd per hierarchy, failures are appended
+       to errors instead of thrown. Returns the number of pids attached. */
+    virtual size_t AddTasks(const pid_t *pids, size_t count, CgroupTaskErrors &errors,
+                            unsigned int taskflags = CGROUP_TASK_PROCESS) = 0;
+    size_t AddTasks(const std::vector<pid_t> &pids, CgroupTaskErrors &errors,
+                    unsigned int taskflags = CGROUP_TASK_PROCESS)
+    {
+        return AddTasks(pids.data(), pids.size(), errors, taskflags);
+    }
+    /* Processes (or threads) of the group, sorted */
+    virtual void GetTasks(std::vector<pid_t> &pids, unsigned int taskflags = CGROUP_TASK_PROCESS) = 0;
+    /* Run path in this cgroup, the child is placed in the cgroup before it
+       execs (fork, AddTask, then let the child go), returns its pid */
+    virtual pid_t Spawn(const char *path, char *const argv[]);
+    /* SIGKILL every process of the group and of its descendants, forks
+       racing with it included: cgroup.kill on v2, the freezer on v1.
+       Returns once the signals are sent, see TryIsPopulated(). */
+    virtual CgroupResult<void> TryKill() = 0;
+    /* Whether a process is left in the group or one of its descendants */
+    virtual CgroupResult<bool> TryIsPopulated() = 0;
+    /* fd that gets EPOLLPRI when TryIsPopulated() may have changed, -1 when
+       there is no such notification (v1). Owned by the fd cache, valid
+       while a UseFiles() is alive. */
+    virtual int GetPopulatedFd();
 
     virtual void SetOwner(uid_t uid, gid_t gid, int controllers = CGROUP_CONTROLLER_NONE);
+    /* true when the group directory is owned by uid:gid already */
+    virtual bool HasOwner(uid_t uid, gid_t gid);
+    /* Inode of the group directory, which is the kernel cgroup id on v2
+       (on v1 the one of the first hierarchy), 0 when it does not exist */
+    virtual unsigned long long GetCgroupId();
+    /* Names of the child groups, sorted */
+    virtual void GetChildren(std::vector<std::string> &names) = 0;
     virtual void Remove() = 0;
-    virtual void MakeGroup(unsigned int flags = CGROUP_NONE) = 0;
+    /* Throwing wrapper of TryMakeGroup() */
+    void MakeGroup(unsigned int flags = CGROUP_NONE);
+    virtual CgroupResult<void> TryMakeGroup(unsigned int flags = CGROUP_NONE) = 0;
 
 
     virtual int DetectControllers(int controllers, int alreadyDetected = CGROUP_CONTROLLER_NONE);
     virtual bool HasController(int controller = CGROUP_CONTROLLER_NONE) = 0;
     virtual std::string GetPathOfController(int controller, const std::string &key) = 0;
+    /* Whether GetPathOfController() works for controller, i.e. it is
+       mounted (and on v1 placed) */
+    virtual bool IsControllerUsable(int controller) = 0;
 
     void SetCgroupValueU64(int controller, const std::string &key, unsigned long long int value);
     void SetCgroupValueI64(int controller, const std::string &key, long long int value);
     void SetCgroupValueStr(int controller, const std::string &key, const std::string& value);
     void SetCgroupValueRaw(const std::string &path, const std::string& value);
 
-    unsigned long long int GetCgroupValueU64(int controller, const std::string &key);
-    long long int GetCgroupValueI64(int controller, const std::string &key);
+    /* Numeric accessors use stack buffers only; "max" is read as maxValue */
+    unsigned long long int GetCgroupValueU64(int controller, const std::string &key,
+                                             unsigned long long int maxValue = CGROUP_PARAM_MAX);
+    long long int GetCgroupValueI64(int controller, const std::string &key,
+                                    long long int maxValue = LLONG_MAX);
     std::string GetCgroupValueStr(int controller, const std::string &key);
     std::string GetCgroupValueRaw(const std::string &path);
 
+    /* Cached fd access to interface files, see CgroupFileCache. An fd
+       returned by GetCgroupFileFd() must only be used under UseFiles(). */
+    CgroupFileCache::Use UseFiles() { return CgroupFileCache::Use(fileCache); }
+    int GetCgroupFileFd(int controller, const std::string &key, int flags);
+    ssize_t ReadCgroupFile(int controller, const std::string &key, char *buf, size_t size);
+    std::string ReadCgroupFileAll(int controller, const std::string &key);
+    void WriteCgroupFile(int controller, const std::string &key, const char *buf, size_t size);
+    void InvalidateFileCache();
+
+    /* Same as above without exceptions, for loops that expect failures */
+    CgroupResult<int> TryGetCgroupFileFd(int controller, const std::string &key, int flags);
+    CgroupResult<size_t> TryReadCgroupFile(int controller, const std::string &key, char *buf, size_t size);
+    CgroupResult<void> TryWriteCgroupFile(int controller, const std::string &key, const char *buf, size_t size);
+    CgroupResult<unsigned long long> TryGetCgroupValueU64(int controller, const std::string &key,
+                                                          unsigned long long maxValue = CGROUP_PARAM_MAX);
+    CgroupResult<long long> TryGetCgroupValueI64(int controller, const std::string &key,
+                                                 long long maxValue = LLONG_MAX);
+    CgroupResult<void> TrySetCgroupValueU64(int controller, const std::string &key, unsigned long long value);
+    CgroupResult<void> TrySetCgroupValueI64(int controller, const std::string &key, long long value);
+
+    /* Throws the exception a throwing method would have thrown for error,
+       what names the object, e.g. "'cpu.max'" */
+    [[noreturn]] static void ThrowError(const CgroupError &error, const std::string &what);
+    /* Same for an access to the interface file key, value is what was written */
+    [[noreturn]] void ThrowFileError(const CgroupError &error, int controller, const std::string &key,
+                                     const char *value = NULL, size_t size = 0);
+    void InvalidateCgroupFile(int controller, const std::string &key, int flags);
+
+    /* Usage sampling split in reads that can be batched and parsing */
+    virtual const std::vector<CgroupSampleFile> &GetSampleFiles() = 0;
+    virtual void ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample) = 0;
+
+    /* Files with event counters and states, and how to parse them */
+    virtual const std::vector<CgroupEventFile> &GetEventFiles() = 0;
+    virtual void ParseEventFile(int fileType, const char *buf, size_t len, CgroupEventCounters &counters) = 0;
+    /* Returns an eventfd signalled on changes of an eventControl file, and
+       once more when the cgroup is removed. The caller owns the fd. */
+    virtual int OpenEventControl(int controller, int fileType);
+
+    static bool ParseValueU64(const char *&cur, const char *end, unsigned long long int &value,
+                              unsigned long long int maxValue = CGROUP_PARAM_MAX);
+    static bool ParseValueI64(const char *&cur, const char *end, long long int &value,
+                              long long int maxValue = LLONG_MAX);
+
     std::string FileReadAll(const std::string &path);
     void FileWriteStr(const std::string &path, const std::string &buffer);
 
@@ -163,13 +303,30 @@ public:
     
     virtual void SetCpuShares(unsigned long long shares);
     virtual unsigned long long GetCpuShares();
+    /* cpu.shares or cpu.weight of a new group */
+    virtual unsigned long long GetDefaultCpuShares() = 0;
 
     virtual void SetCpuCfsPeriod(unsigned long long cfs_period) = 0;
     virtual void SetCpuCfsQuota(long long cfs_quota) = 0;
     virtual unsigned long long GetCpuCfsPeriod() = 0;
     virtual long long GetCpuCfsQuota() = 0;
 
+    /* Apply several limits writing each interface file at most once, in an
+       order the kernel accepts. Files already written are restored to their
+       previous value if a later write fails. */
+    /* Implemented by BasicCgroup<Backend>::SetLimits() */
+    virtual void SetLimits(const LimitSet &limits) = 0;
+    /* Current value of every limit set in wanted */
+    virtual void GetLimits(const LimitSet &wanted, LimitSet &current);
+    /* SetLimits() of the limits that differ from the current ones only,
+       returns false when there was nothing to write */
+    virtual bool ReconcileLimits(const LimitSet &limits);
+
+    virtual void GetCpuStat(CgroupCpuStat &stat) = 0;
+
     virtual void SetMemory(unsigned long long kb);
+    virtual void GetMemoryStat(CgroupMemoryStat &stat) = 0;
+    /* Legacy accessor, values in KB */
     virtual int GetMemoryStat(unsigned long long *cache,
                          unsigned long long *activeAnon,
                          unsigned long long *inactiveAnon,
@@ -185,27 +342,61 @@ public:
     virtual unsigned long long GetMemSwapHardLimit();
     virtual unsigned long long GetMemSwapUsage();
 
+    virtual void GetIoStat(CgroupIoStat &stat) = 0;
+    virtual unsigned long long GetPidsCurrent();
+
+    /* Pressure stall information, fileType is one of CGROUP_CONTROLLER_FILE_*_PRESSURE */
+    virtual void GetPressure(int fileType, CgroupPressure &pressure);
+    /* Register a PSI trigger such as "some 150000 1000000" (stall and window
+       in usec), returns a new fd that gets POLLPRI when the trigger fires.
+       The caller owns the fd, closing it removes the trigger. Without
+       CAP_SYS_RESOURCE the window must be a multiple of 2s. */
+    virtual int OpenPressureTrigger(int fileType, const std::string &trigger);
+
 // helpers
     virtual std::string GetBasePath(int controller = CGROUP_CONTROLLER_NONE) = 0;
     virtual std::string GetRelativeBasePath(int controller = CGROUP_CONTROLLER_NONE) = 0;
-    virtual std::string GetControllerFileName(int controllerFileType);
+    virtual const std::string& GetControllerFileName(int controllerFileType);
     virtual std::string GetRelativePlacement(const std::string& placement);
 
 protected:
+    template <typename Backend> friend class BasicCgroup;
 
     virtual std::string serialize_fileperms(const fs::perms &p);
     virtual std::string GetControllerName(int controller) = 0;
 
     virtual void SetMemoryLimitInKB(const std::string &keylimit, unsigned long long kb) = 0;
+    virtual void PlanLimits(const LimitSet &limits, CgroupLimitPlan &plan) = 0;
+    virtual int GetPressureController(int fileType);
+    size_t WriteTasks(const std::vector<std::pair<int, std::string>> &files, const pid_t *pids, size_t count,
+                      CgroupTaskErrors &errors);
+    void ReadTasks(const std::string &path, std::vector<pid_t> &pids);
+    /* Sends signal to every process of the group at path, relative to the
+       hierarchy of controller, and of its descendants, signal 0 only counts
+       them. Returns the number of processes found. */
+    CgroupResult<size_t> SignalTree(int controller, const std::string &path, int signal);
+    void ListChildren(const std::string &path, std::vector<std::string> &names);
+    /* Removes the group at path, relative to the hierarchy of controller,
+       with all its descendants, see CgroupTree */
+    std::uintmax_t RemoveTree(int controller, const std::string &path);
+    /* The kernel returns ENODEV on an fd whose cgroup has been removed behind our back */
+    static bool IsStaleFdError(int err) { return err == ENODEV || err == ENOENT; }
+    [[noreturn]] static void SpawnExec(const char *path, char *const argv[], int errorFd);
+    static pid_t SpawnWaitExec(pid_t pid, int errorFd, const char *path);
+    size_t ReadStatFile(int controller, const std::string &key, const CgroupStatParser &parser, void *out);
     virtual unsigned long long GetMemoryLimitInKB(const std::string &keylimit) = 0;
 
 protected:
     const CgroupBackendType backendType = CGROUP_BACKEND_NONE;
-    std::string backenName;
-    const char* PROC_MOUNTS_PATH = "/proc/mounts";
-    const std::string CGROUP_ROOT_PATH = "/sys/fs/cgroup/";
+    static const std::string CGROUP_ROOT_PATH;
+
+    /* mounts and controllers, shared by every backend of the process */
+    const std::shared_ptr<const CgroupContext> context;
+
+    /* indexed by CgroupControllerFile, see BasicCgroup<Backend>::FileNameStrings() */
+    const std::string *fileNames;
 
-    static std::string backendControllerFileMap[CGROUP_BACKEND_TYPE_LAST][CGROUP_CONTROLLER_FILE_LAST];
+    CgroupFileCache fileCache;
 };
 
 } // namespace mdsd
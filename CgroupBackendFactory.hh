@@ -6,6 +6,7 @@
 #include <string>
 #include "Cgroup.hh"
 #include "CgroupBackend.hh"
+#include "CgroupContext.hh"
 
 namespace mdsd {
 
@@ -18,6 +19,8 @@ public:
     CgroupBackendType DetectMountedCgroupBackend();
     std::shared_ptr<CgroupBackend> GetCgroupBackend(const std::string& path);
     std::shared_ptr<Cgroup> GetCgroup(const std::string& path);
+    /* Lighter than a Cgroup when only interface files are needed */
+    CgroupHandle GetHandle(const std::string& path, unsigned int controllers = CGROUP_CONTROLLER_NONE);
 private:
     
 };
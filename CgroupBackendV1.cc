@@ -1,5 +1,5 @@
 #include "CgroupBackendV1.hh"
-#include "EnumToString.hh"
+#include "BasicCgroup.hh"
 
 #include <unistd.h>
 #include <mntent.h>
@@ -19,39 +19,54 @@
 // for file open/read
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <signal.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iterator>
 #include <functional>
 #include <cctype>
 #include <locale>
+#include <thread>
 
 using namespace mdsd;
 using namespace std;
 namespace fs = std::experimental::filesystem;
 
-/* this should match the enum CgroupController */
-CGROUP_ENUM_DECL(CgroupV1Controller);
-CGROUP_ENUM_IMPL(CgroupV1Controller,
-              CGROUP_CONTROLLER_LAST,
-              "", "cpu", "cpuacct", "cpuset", "memory", "devices",
-              "freezer", "blkio", "net_cls", "pids", "rdma", "perf_event", "name=systemd"
-);
-
-CGROUP_ENUM_IMPL(CgroupV1ControllerFile,
-              CGROUP_CONTROLLER_FILE_LAST,
-              "tasks", "cgroup.threads",
-              "cpuacct.usage", "cpu.shares", "cpu.cfs_period_us", "cpu.cfs_quota_us",
-              "memory.usage_in_bytes", "memory.limit_in_bytes", "memory.soft_limit_in_bytes",
-              "memory.memsw.usage_in_bytes", "memory.memsw.limit_in_bytes", "memory.memsw.soft_limit_in_bytes",
-);
-
-CgroupBackendV1::CgroupBackendV1(const std::string &placement)
-    : placement(placement), CgroupBackend(CGROUP_BACKEND_TYPE_V1, placement)
-{
-    for (size_t i = 0; i < CGROUP_CONTROLLER_FILE_LAST; i++) {
-        backendControllerFileMap[GetBackendType()][i] = CgroupV1ControllerFileTypeToString(i);
-    }
+static const CgroupStatKey memoryStatKeys[] = {
+    CGROUP_STAT_KEY("cache", CgroupMemoryStat, cache),
+    CGROUP_STAT_KEY("rss", CgroupMemoryStat, rss),
+    CGROUP_STAT_KEY("pgfault", CgroupMemoryStat, pgfault),
+    CGROUP_STAT_KEY("pgmajfault", CgroupMemoryStat, pgmajfault),
+    CGROUP_STAT_KEY("inactive_anon", CgroupMemoryStat, inactiveAnon),
+    CGROUP_STAT_KEY("active_anon", CgroupMemoryStat, activeAnon),
+    CGROUP_STAT_KEY("inactive_file", CgroupMemoryStat, inactiveFile),
+    CGROUP_STAT_KEY("active_file", CgroupMemoryStat, activeFile),
+    CGROUP_STAT_KEY("unevictable", CgroupMemoryStat, unevictable),
+};
+static const CgroupStatParser memoryStatParser(memoryStatKeys, sizeof(memoryStatKeys) / sizeof(memoryStatKeys[0]));
+
+static const CgroupStatKey cpuStatKeys[] = {
+    CGROUP_STAT_KEY("nr_periods", CgroupCpuStat, nrPeriods),
+    CGROUP_STAT_KEY("nr_throttled", CgroupCpuStat, nrThrottled),
+    CGROUP_STAT_KEY_DIV("throttled_time", CgroupCpuStat, throttledUsec, 1000),
+};
+static const CgroupStatParser cpuStatParser(cpuStatKeys, sizeof(cpuStatKeys) / sizeof(cpuStatKeys[0]));
+
+/* oom_kill is there since 4.13 */
+static const CgroupStatKey oomControlKeys[] = {
+    CGROUP_EVENT_KEY("under_oom", CGROUP_EVENT_UNDER_OOM),
+    CGROUP_EVENT_KEY("oom_kill", CGROUP_EVENT_MEMORY_OOM_KILL),
+};
+static const CgroupStatParser oomControlParser(oomControlKeys, sizeof(oomControlKeys) / sizeof(oomControlKeys[0]));
+
+CgroupBackendV1::CgroupBackendV1(const std::string &placement, const std::shared_ptr<const CgroupContext> &context)
+    : placement(placement),
+      CgroupBackend(CGROUP_BACKEND_TYPE_V1, placement, context, BasicCgroup<CgroupBackendV1>::FileNameStrings())
+{
 }
 
 std::string CgroupBackendV1::GetBasePath(int controller)
@@ -62,8 +77,8 @@ std::string CgroupBackendV1::GetBasePath(int controller)
         base = fs::path(CGROUP_ROOT_PATH);
         base /= GetRelativePlacement(this->placement);
     } else {
-        base = fs::path(this->controllers[controller].mountPoint);
-        base /= this->controllers[controller].placement;
+        base = fs::path(context->GetMountPoint(controller));
+        base /= GetPlacement(controller);
     }
     
     return base;
@@ -76,7 +91,7 @@ std::string CgroupBackendV1::GetRelativeBasePath(int controller)
     {
         path = GetRelativePlacement(this->placement);
     } else {
-        path = this->controllers[controller].placement;
+        path = GetPlacement(controller);
     }
     
     return path;
@@ -85,7 +100,39 @@ std::string CgroupBackendV1::GetRelativeBasePath(int controller)
 
 std::string CgroupBackendV1::GetControllerName(int controller)
 {
-    return CgroupV1ControllerTypeToString(controller);
+    return cgroupV1Controllers.Name(controller);
+}
+
+const std::string &CgroupBackendV1::GetPlacement(int controller) const
+{
+    static const std::string none;
+    uint8_t index = this->controllerPlacement[controller];
+
+    return index ? this->placements[index - 1] : none;
+}
+
+void CgroupBackendV1::SetPlacement(int controller, const std::string &path)
+{
+    if (path.empty()) {
+        this->controllerPlacement[controller] = 0;
+        return;
+    }
+
+    auto it = std::find(this->placements.begin(), this->placements.end(), path);
+    if (it == this->placements.end())
+        it = this->placements.insert(it, path);
+    this->controllerPlacement[controller] = it - this->placements.begin() + 1;
+}
+
+bool CgroupBackendV1::Enabled(int controller) const
+{
+    const std::string &path = GetPlacement(controller);
+    return path != "" && path != "/";
+}
+
+bool CgroupBackendV1::PlacementExist(int controller)
+{
+    return fs::exists(GetBasePath(controller));
 }
 
 
@@ -99,96 +146,41 @@ void CgroupBackendV1::Init()
    
     for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++) {
         auto controllerName = GetControllerName(i);
-        this->controllers[i].controller = static_cast<CgroupController>(i);
-        auto mountPoint = this->controllers[i].mountPoint;
 
         // TODO: handle the case with "cpu,cpuacct"
         if (starts_with(this->placement, controllerName)) {
-            this->controllers[i].placement = replace_all_copy(this->placement, controllerName, "");
-            // CGROUP_DEBUG("controller=" + controllerName +" placement=" + this->controllers[i].placement + " mountPoint=" + mountPoint);
             // strip cgroup root path and controller name from placement
-            this->placement = this->controllers[i].placement;
+            SetPlacement(i, replace_all_copy(this->placement, controllerName, ""));
+            this->placement = GetPlacement(i);
         }
     }
 
     // CGROUP_DEBUG("this->placement=" << this->placement );
 }
 
-int CgroupBackendV1::ResolveMountLink(const char *mntDir, const std::string& typeStr,
-                            CgroupBackendV1Controller *controller)
-{
-    return 0;
-}
-
-int CgroupBackendV1::MountOptsMatchController(const std::string &mntOpts, const std::string& typeStr)
-{
-    std::vector<std::string> optList;
-    split(optList, mntOpts, is_any_of(","));
-
-    auto result = std::find(std::begin(optList), std::end(optList), typeStr);
-
-    return result != std::end(optList);
-}
-
-int CgroupBackendV1::DetectMounts(const char *mntType, const char *mntOpts, const char *mntDir)
-{
-    if (strcmp(mntType, GetBackendName().c_str()) != 0)
-        return 0;
-
-    for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
-    {
-         auto typestr = GetControllerName(i);
-
-        if (MountOptsMatchController(std::string(mntOpts), typestr)) {
-            /* Note that the lines in /proc/mounts have the same
-             * order than the mount operations, and that there may
-             * be duplicates due to bind mounts. This means
-             * that the same mount point may be processed more than
-             * once. We need to save the results of the last one,
-             * and we need to be careful to release the memory used
-             * by previous processing. */
-            auto controller = &this->controllers[i];
-
-            controller->linkPoint = "";
-            controller->mountPoint = std::string(mntDir);
-
-            /* If it is a co-mount it has a filename like "cpu,cpuacct"
-             * and we must identify the symlink path */
-            if (ResolveMountLink(mntDir, typestr, controller) < 0)
-                return -1;
-        }
-    }
-
-    // this->mountPoint = std::string(mntDir);
-    // CGROUP_DEBUG("mountPoint=" << mountPoint);
-
-    return 0;
-}
-
 int CgroupBackendV1::DetectPlacement(const std::string &path,
     const std::string &controllers,
     const std::string &selfpath)
 {
     // CGROUP_DEBUG("path=%s controllers=%s selfpath=%s\n", path.c_str(), controllers.c_str(), selfpath.c_str());
+   unsigned int mounted = cgroupV1Controllers.FindAll(controllers, ',');
    for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
    {
-        auto typestr = GetControllerName(i);
-        if (MountOptsMatchController(controllers, typestr) &&
-            !this->controllers[i].mountPoint.empty() &&
-            this->controllers[i].placement.empty()) {
+        if ((mounted & (1 << i)) &&
+            HasController(i) &&
+            GetPlacement(i).empty()) {
             /*
              * selfpath == "/" + path == "" -> "/"
              * selfpath == "/libvirt.service" + path == "" -> "/libvirt.service"
              * selfpath == "/libvirt.service" + path == "foo" -> "/libvirt.service/foo"
              */
             if (i == CGROUP_CONTROLLER_SYSTEMD) {
-                this->controllers[i].placement = selfpath;
+                SetPlacement(i, selfpath);
             } else {
                 fs::path buildPath = selfpath;
                 buildPath /= path;
-                this->controllers[i].placement = buildPath;
+                SetPlacement(i, buildPath);
             }
-            // this->controllers[i].Print();
         }
     }
     return 0;
@@ -199,17 +191,17 @@ int CgroupBackendV1::ValidatePlacement()
     return 0;
 }
 
-void CgroupBackendV1::AddTask(pid_t pid, unsigned int taskflags)
+CgroupResult<void> CgroupBackendV1::TryAddTask(pid_t pid, unsigned int taskflags)
 {
     for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++) {
         /* Skip over controllers not mounted */
         if (!HasController(i))
             continue;
         
-        if (!this->controllers[i].PlacementExist())
+        if (!PlacementExist(i))
             continue;
 
-        if (!this->controllers[i].Enabled())
+        if (!Enabled(i))
             continue;
 
         /* We must never add tasks in systemd's hierarchy
@@ -218,33 +210,193 @@ void CgroupBackendV1::AddTask(pid_t pid, unsigned int taskflags)
         if (i == CGROUP_CONTROLLER_SYSTEMD && !(taskflags & CGROUP_TASK_SYSTEMD))
             continue;
 
-        SetCgroupValueI64(i, "tasks", pid);
+        auto result = TrySetCgroupValueI64(i, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_THREADS), pid);
+        if (!result)
+            return result;
     }
+
+    return CgroupResult<void>();
 }
 
+/* Controllers the tasks of the group live in, one per hierarchy since
+   co-mounted controllers such as cpu,cpuacct share their directory */
+void CgroupBackendV1::GetHierarchies(unsigned int taskflags, std::vector<int> &controllers)
+{
+    std::vector<std::pair<dev_t, ino_t>> seen;
+
+    for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++) {
+        if (!HasController(i) || !Enabled(i))
+            continue;
+
+        if (i == CGROUP_CONTROLLER_SYSTEMD && !(taskflags & CGROUP_TASK_SYSTEMD))
+            continue;
+
+        struct stat st;
+        if (stat(GetBasePath(i).c_str(), &st) < 0)
+            continue;
+
+        std::pair<dev_t, ino_t> id(st.st_dev, st.st_ino);
+        if (std::find(seen.begin(), seen.end(), id) != seen.end())
+            continue;
+
+        seen.push_back(id);
+        controllers.push_back(i);
+    }
+}
+
+/* cgroup.procs moves the whole thread group, tasks a single thread */
+size_t CgroupBackendV1::AddTasks(const pid_t *pids, size_t count, CgroupTaskErrors &errors, unsigned int taskflags)
+{
+    const std::string &key = GetControllerFileName((taskflags & CGROUP_TASK_THREAD) ?
+        CGROUP_CONTROLLER_FILE_CGROUP_THREADS : CGROUP_CONTROLLER_FILE_CGROUP_PROCS);
+    std::vector<std::pair<int, std::string>> files;
+    std::vector<int> hierarchies;
+
+    GetHierarchies(taskflags, hierarchies);
+    for (int controller : hierarchies)
+        files.emplace_back(controller, key);
+
+    return WriteTasks(files, pids, count, errors);
+}
+
+/* A task may be in some hierarchies of the group only, report all of them */
+void CgroupBackendV1::GetTasks(std::vector<pid_t> &pids, unsigned int taskflags)
+{
+    const std::string &key = GetControllerFileName((taskflags & CGROUP_TASK_THREAD) ?
+        CGROUP_CONTROLLER_FILE_CGROUP_THREADS : CGROUP_CONTROLLER_FILE_CGROUP_PROCS);
+    std::vector<int> hierarchies;
+
+    pids.clear();
+    GetHierarchies(taskflags, hierarchies);
+    for (int controller : hierarchies)
+        ReadTasks(GetPathOfController(controller, key), pids);
+
+    std::sort(pids.begin(), pids.end());
+    pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+}
+
+/* The pid list of a tasks file is built once per open file and kept for
+   a second, so it cannot be read through the fd cache */
 bool CgroupBackendV1::HasEmptyTasks(int controller)
 {
-    if (GetCgroupValueStr(controller, "tasks") == "")
-        return false;
+    std::string path = GetPathOfController(controller, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_PROCS));
+
+    return GetCgroupValueRaw(path).empty();
+}
+
+CgroupResult<size_t> CgroupBackendV1::SignalHierarchies(const std::vector<int> &hierarchies, int signal)
+{
+    size_t found = 0;
+
+    for (int controller : hierarchies) {
+        auto n = SignalTree(controller, GetPlacement(controller), signal);
+        if (!n && n.Error().code != CGROUP_ERR_NOT_FOUND)
+            return n;
+        found += n.ValueOr(0);
+    }
+
+    return found;
+}
+
+/* freezer.state reads FREEZING until every task of the subtree is frozen */
+CgroupResult<bool> CgroupBackendV1::Freeze()
+{
+    const std::string &key = GetControllerFileName(CGROUP_CONTROLLER_FILE_FREEZER_STATE);
+    auto written = TryWriteCgroupFile(CGROUP_CONTROLLER_FREEZER, key, "FROZEN", 6);
+    if (!written)
+        return written.Error();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CGROUP_FREEZE_TIMEOUT_MS);
+    auto delay = std::chrono::microseconds(100);
+    char buf[CGROUP_NUM_BUF_LEN];
+
+    for (;;) {
+        auto n = TryReadCgroupFile(CGROUP_CONTROLLER_FREEZER, key, buf, sizeof(buf));
+        if (!n)
+            return n.Error();
+        if (std::string_view(buf, *n).substr(0, 6) == "FROZEN")
+            return true;
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+
+        std::this_thread::sleep_for(delay);
+        delay = std::min(delay * 2, std::chrono::microseconds(10000));
+    }
+}
+
+CgroupResult<void> CgroupBackendV1::Thaw()
+{
+    return TryWriteCgroupFile(CGROUP_CONTROLLER_FREEZER,
+                              GetControllerFileName(CGROUP_CONTROLLER_FILE_FREEZER_STATE), "THAWED", 6);
+}
+
+/*
+ * There is no cgroup.kill on v1. Frozen tasks cannot fork, so one pass of
+ * signals reaches them all, they die once thawed. Without the freezer the
+ * passes are repeated until one finds nobody.
+ */
+CgroupResult<void> CgroupBackendV1::TryKill()
+{
+    std::vector<int> hierarchies;
+    GetHierarchies(CGROUP_TASK_PROCESS, hierarchies);
+
+    bool freezer = HasController(CGROUP_CONTROLLER_FREEZER) && Enabled(CGROUP_CONTROLLER_FREEZER);
+    bool frozen = false;
+    if (freezer) {
+        auto res = Freeze();
+        if (!res && res.Error().code != CGROUP_ERR_NOT_FOUND)
+            return res.Error();
+        frozen = res.ValueOr(false);
+    }
+
+    CgroupResult<void> result;
+    for (int round = 0; round < (frozen ? 1 : CGROUP_KILL_ROUNDS); round++) {
+        auto n = SignalHierarchies(hierarchies, SIGKILL);
+        if (!n) {
+            result = n.Error();
+            break;
+        }
+        if (*n == 0)
+            break;
+    }
+
+    if (freezer) {
+        auto thawed = Thaw();
+        if (!thawed && thawed.Error().code != CGROUP_ERR_NOT_FOUND && result)
+            result = thawed;
+    }
+
+    CGROUP_DEBUG("Killed the tasks of '" << this->placement << "'" << (frozen ? " (frozen)" : ""));
+    return result;
+}
+
+/* No populated notification on v1, the groups of every hierarchy are listed */
+CgroupResult<bool> CgroupBackendV1::TryIsPopulated()
+{
+    std::vector<int> hierarchies;
+    GetHierarchies(CGROUP_TASK_PROCESS, hierarchies);
 
-    return true;
+    auto n = SignalHierarchies(hierarchies, 0);
+    if (!n)
+        return n.Error();
+    return *n != 0;
 }
 
 void CgroupBackendV1::Remove()
 {
+    InvalidateFileCache();
+
     for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
     {
-        auto controller = this->controllers[i];
         if (!this->HasController(i))
             continue;
         /* Don't delete the root group, if we accidentally
             ended up in it for some reason */
-        if (controller.placement == "/" || controller.placement == "")
-            return;
+        if (!Enabled(i))
+            continue;
 
-        fs::path grppath = this->GetBasePath(i);
-        std::uintmax_t n = fs::remove_all(grppath);
-        CGROUP_DEBUG("Deleted " << n << " files or directories here " << grppath);
+        std::uintmax_t n = RemoveTree(i, GetPlacement(i));
+        CGROUP_DEBUG("Deleted " << n << " groups here " << fs::path(this->GetBasePath(i)));
     }
 }
 
@@ -253,16 +405,47 @@ void CgroupBackendV1::SetOwner(uid_t uid, gid_t gid, int controllers)
 {
     for (size_t controller = CGROUP_CONTROLLER_CPU; controller < CGROUP_CONTROLLER_LAST; controller++)
     {
-        if (this->controllers->Enabled())
+        if (this->HasController(controller) && Enabled(controller))
             CgroupBackend::SetOwner(uid, gid, controller);
     }
 }
-void CgroupBackendV1::MakeGroup(unsigned int flags)
+bool CgroupBackendV1::HasOwner(uid_t uid, gid_t gid)
+{
+    std::vector<int> hierarchies;
+    struct stat st;
+
+    GetHierarchies(CGROUP_TASK_PROCESS, hierarchies);
+    for (int controller : hierarchies)
+        if (stat(GetBasePath(controller).c_str(), &st) < 0 || st.st_uid != uid || st.st_gid != gid)
+            return false;
+
+    return !hierarchies.empty();
+}
+
+/* A child may exist in some hierarchies only */
+void CgroupBackendV1::GetChildren(std::vector<std::string> &names)
 {
+    std::vector<int> hierarchies;
+
+    names.clear();
+    GetHierarchies(CGROUP_TASK_PROCESS, hierarchies);
+    for (int controller : hierarchies)
+        ListChildren(GetBasePath(controller), names);
+
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+}
+
+/* Creates the group in every hierarchy it is placed in, the first error is returned */
+CgroupResult<void> CgroupBackendV1::TryMakeGroup(unsigned int flags)
+{
+    CgroupResult<void> result;
+
+    // a re-created group has new interface files
+    InvalidateFileCache();
+
     for (size_t controller = CGROUP_CONTROLLER_CPU; controller < CGROUP_CONTROLLER_LAST; controller++)
     {
-        auto cont = this->controllers[controller];
-        // CGROUP_DEBUG("trying to create controller path of " << controller << " mounted=" << cont.mountPoint);
         // Skip over controllers that aren't mounted
         if (!this->HasController(controller))
             continue;
@@ -274,34 +457,34 @@ void CgroupBackendV1::MakeGroup(unsigned int flags)
             continue;
 
         // Skip over controllers that aren't enabled
-        if (!this->controllers[controller].Enabled())
+        if (!Enabled(controller))
             continue;
 
-        try
-        {
-            auto path = fs::path(GetPathOfController(controller, ""));
+        std::string path = GetBasePath(controller);
 
-            // CGROUP_DEBUG("Make group " << path << " perms:"  << static_cast<int>(fs::perms::all));
+        // CGROUP_DEBUG("Make group " << path << " perms:"  << static_cast<int>(fs::perms::all));
 
-            auto fstatus = fs::status(path);
-
-            if (!fs::exists(fstatus) && !fs::create_directory(path))
-                throw CGroupFileNotFoundException(std::to_string(errno) + "Failed to create v1 cgroup " + path.string());
-
-        } catch (CGroupBaseException ex) {
-            CGROUP_ERROR("failed to enable '" << GetControllerName(controller) << "' controller, error:" << ex.what());
+        if (mkdir(path.c_str(), 0777) < 0 && errno != EEXIST) {
+            CgroupError error = CgroupError::FromErrno(errno, "create");
+            CGROUP_ERROR("failed to enable '" << GetControllerName(controller) << "' controller, errno:" << error.error);
+            if (result)
+                result = error;
         }
     }
+
+    return result;
 }
 
 int CgroupBackendV1::DetectControllers(int controllers, int alreadyDetected)
 {
+    InvalidateFileCache();
+
     for (size_t i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
     {
         bool enableController = controllers & (1 << i);
 
         if (enableController) {
-            this->controllers[i].placement = this->placement;
+            SetPlacement(i, this->placement);
         }
     }
     return 0;
@@ -309,7 +492,12 @@ int CgroupBackendV1::DetectControllers(int controllers, int alreadyDetected)
 
 bool CgroupBackendV1::HasController(int controller)
 {
-    return this->controllers[controller].mountPoint != "";
+    return context->HasController(controller);
+}
+
+bool CgroupBackendV1::IsControllerUsable(int controller)
+{
+    return (controller == CGROUP_CONTROLLER_NONE || HasController(controller)) && Enabled(controller);
 }
 
 std::string CgroupBackendV1::GetPathOfController(int controller, const std::string &key)
@@ -317,7 +505,7 @@ std::string CgroupBackendV1::GetPathOfController(int controller, const std::stri
     if (controller != CGROUP_CONTROLLER_NONE && !HasController(controller))
         throw CGroupControllerNotFoundException("Controller '" + GetControllerName(controller) + "' is not available");
 
-    if (!this->controllers[controller].Enabled())
+    if (!Enabled(controller))
         throw CGroupControllerNotFoundException(GetBackendName() + " controller '" +
                 GetControllerName(controller) + "' is not enabled for group");
 
@@ -334,23 +522,34 @@ void CgroupBackendV1::SetCpuCfsPeriod(unsigned long long cfs_period)
 {
     this->ValidateCPUCfsPeiod(cfs_period);
 
-    SetCgroupValueU64(CGROUP_CONTROLLER_CPU, "cpu.cfs_period_us", cfs_period);
+    SetCgroupValueU64(CGROUP_CONTROLLER_CPU, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_PERIOD), cfs_period);
 }
 
 void CgroupBackendV1::SetCpuCfsQuota(long long cfs_quota)
 {
     this->ValidateCPUCfsQuota(cfs_quota);
-    SetCgroupValueU64(CGROUP_CONTROLLER_CPU, "cpu.cfs_quota_us", cfs_quota);
+    SetCgroupValueI64(CGROUP_CONTROLLER_CPU, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA), cfs_quota);
 }
 
 unsigned long long CgroupBackendV1::GetCpuCfsPeriod()
 {
-    return GetCgroupValueU64(CGROUP_CONTROLLER_CPU, "cpu.cfs_period_us");
+    return GetCgroupValueU64(CGROUP_CONTROLLER_CPU, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_PERIOD));
 }
 
+/* cpu.cfs_quota_us reads -1 when unlimited */
 long long CgroupBackendV1::GetCpuCfsQuota()
 {
-    return GetCgroupValueU64(CGROUP_CONTROLLER_CPU, "cpu.cfs_quota_us");
+    return GetCgroupValueI64(CGROUP_CONTROLLER_CPU, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA));
+}
+
+/* cpuacct.usage is in ns and lives in the cpuacct hierarchy, if enabled */
+void CgroupBackendV1::GetCpuStat(CgroupCpuStat &stat)
+{
+    ReadStatFile(CGROUP_CONTROLLER_CPU, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_STAT), cpuStatParser, &stat);
+
+    if (HasController(CGROUP_CONTROLLER_CPUACCT) && Enabled(CGROUP_CONTROLLER_CPUACCT))
+        stat.usageUsec = GetCgroupValueU64(CGROUP_CONTROLLER_CPUACCT,
+                            GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_USAGE)) / 1000;
 }
 
 
@@ -368,13 +567,13 @@ void CgroupBackendV1::MemoryInit()
     memoryUnlimitedKB = CGROUP_MEMORY_PARAM_UNLIMITED;
     try
     {
-        CgroupBackendV1 rootGroup("/");
+        CgroupBackendV1 rootGroup("/", context);
         unsigned long long int mem_unlimited = 0ULL;
 
         if (!HasController(CGROUP_CONTROLLER_MEMORY))
             return;
 
-        mem_unlimited = rootGroup.GetCgroupValueU64(CGROUP_CONTROLLER_MEMORY, "memory.limit_in_bytes");
+        mem_unlimited = BasicCgroup<CgroupBackendV1>(rootGroup).Read<CgroupFiles::MemoryMax>();
         memoryUnlimitedKB = mem_unlimited >> 10;
     }
     catch(const std::exception& e)
@@ -383,6 +582,11 @@ void CgroupBackendV1::MemoryInit()
     }
 }
 
+void CgroupBackendV1::GetMemoryStat(CgroupMemoryStat &stat)
+{
+    ReadStatFile(CGROUP_CONTROLLER_MEMORY, GetControllerFileName(CGROUP_CONTROLLER_FILE_MEMORY_STAT), memoryStatParser, &stat);
+}
+
 void CgroupBackendV1::SetMemoryLimitInKB(const std::string &keylimit, unsigned long long kb)
 {
     unsigned long long maxkb = CGROUP_MEMORY_PARAM_UNLIMITED;
@@ -409,3 +613,249 @@ unsigned long long CgroupBackendV1::GetMemoryLimitInKB(const std::string &keylim
 }
 
 
+
+
+////// IO //////
+
+void CgroupBackendV1::GetIoStat(CgroupIoStat &stat)
+{
+    char buf[CGROUP_STAT_BUF_LEN];
+    ssize_t n;
+
+    n = ReadCgroupFile(CGROUP_CONTROLLER_BLKIO, GetControllerFileName(CGROUP_CONTROLLER_FILE_IO_STAT), buf, sizeof(buf));
+    ParseBlkioV1(buf, n, stat.rbytes, stat.wbytes);
+
+    n = ReadCgroupFile(CGROUP_CONTROLLER_BLKIO, GetControllerFileName(CGROUP_CONTROLLER_FILE_IO_SERVICED), buf, sizeof(buf));
+    ParseBlkioV1(buf, n, stat.rios, stat.wios);
+}
+
+
+////// Pressure //////
+
+/* Kernels booted with psi=1 and cgroup v1 psi support expose the PSI
+   files in the cpuacct, memory and blkio hierarchies */
+int CgroupBackendV1::GetPressureController(int fileType)
+{
+    switch (fileType)
+    {
+        case CGROUP_CONTROLLER_FILE_CPU_PRESSURE:
+            return CGROUP_CONTROLLER_CPUACCT;
+        case CGROUP_CONTROLLER_FILE_MEMORY_PRESSURE:
+            return CGROUP_CONTROLLER_MEMORY;
+        case CGROUP_CONTROLLER_FILE_IO_PRESSURE:
+            return CGROUP_CONTROLLER_BLKIO;
+    }
+
+    return CGROUP_CONTROLLER_NONE;
+}
+
+
+////// Sampling //////
+
+const std::vector<CgroupSampleFile> &CgroupBackendV1::GetSampleFiles()
+{
+    static const std::vector<CgroupSampleFile> files = {
+        { CGROUP_SAMPLE_MEMORY_USAGE, CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_USAGE, CGROUP_NUM_BUF_LEN },
+        { CGROUP_SAMPLE_MEMORY_STAT, CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_STAT, CGROUP_STAT_BUF_LEN },
+        { CGROUP_SAMPLE_CPU_STAT, CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_STAT, CGROUP_NUM_BUF_LEN * 4 },
+        { CGROUP_SAMPLE_CPU_STAT, CGROUP_CONTROLLER_CPUACCT, CGROUP_CONTROLLER_FILE_CPU_USAGE, CGROUP_NUM_BUF_LEN },
+        { CGROUP_SAMPLE_IO_STAT, CGROUP_CONTROLLER_BLKIO, CGROUP_CONTROLLER_FILE_IO_STAT, CGROUP_STAT_BUF_LEN },
+        { CGROUP_SAMPLE_IO_STAT, CGROUP_CONTROLLER_BLKIO, CGROUP_CONTROLLER_FILE_IO_SERVICED, CGROUP_STAT_BUF_LEN },
+        { CGROUP_SAMPLE_PIDS_CURRENT, CGROUP_CONTROLLER_PIDS, CGROUP_CONTROLLER_FILE_PIDS_CURRENT, CGROUP_NUM_BUF_LEN },
+    };
+
+    return files;
+}
+
+void CgroupBackendV1::ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample)
+{
+    const char *end = buf + len;
+    unsigned long long value;
+
+    switch (fileType)
+    {
+        case CGROUP_CONTROLLER_FILE_MEMORY_USAGE:
+            if (ParseValueU64(buf, end, value))
+                sample.memoryUsage = value >> 10;
+            break;
+        case CGROUP_CONTROLLER_FILE_MEMORY_STAT:
+            memoryStatParser.Parse(buf, len, &sample.memoryStat);
+            break;
+        case CGROUP_CONTROLLER_FILE_CPU_STAT:
+            cpuStatParser.Parse(buf, len, &sample.cpuStat);
+            break;
+        case CGROUP_CONTROLLER_FILE_CPU_USAGE:
+            if (ParseValueU64(buf, end, value))
+                sample.cpuStat.usageUsec = value / 1000;
+            break;
+        case CGROUP_CONTROLLER_FILE_IO_STAT:
+            ParseBlkioV1(buf, len, sample.ioStat.rbytes, sample.ioStat.wbytes);
+            break;
+        case CGROUP_CONTROLLER_FILE_IO_SERVICED:
+            ParseBlkioV1(buf, len, sample.ioStat.rios, sample.ioStat.wios);
+            break;
+        case CGROUP_CONTROLLER_FILE_PIDS_CURRENT:
+            if (ParseValueU64(buf, end, value))
+                sample.pidsCurrent = value;
+            break;
+    }
+}
+
+
+////// Events //////
+
+/* memory.oom_control does not raise inotify events, OOMs are notified
+   through cgroup.event_control. The kernel only notifies pids.events on
+   the default hierarchy and v1 has no equivalent of cgroup.events. */
+const std::vector<CgroupEventFile> &CgroupBackendV1::GetEventFiles()
+{
+    static const std::vector<CgroupEventFile> files = {
+        { CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_EVENTS, true },
+    };
+
+    return files;
+}
+
+void CgroupBackendV1::ParseEventFile(int fileType, const char *buf, size_t len, CgroupEventCounters &counters)
+{
+    switch (fileType)
+    {
+        case CGROUP_CONTROLLER_FILE_MEMORY_EVENTS:
+            oomControlParser.Parse(buf, len, &counters);
+            break;
+    }
+}
+
+int CgroupBackendV1::OpenEventControl(int controller, int fileType)
+{
+    std::string path = GetPathOfController(controller, GetControllerFileName(fileType));
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            throw CGroupFileNotFoundException("File '" + path + "' not found");
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot open '" + path + "'");
+    }
+
+    int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd < 0) {
+        int err = errno;
+        close(fd);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot create eventfd");
+    }
+
+    /* "<event_fd> <fd of the watched file>", the kernel only needs fd while registering */
+    try {
+        SetCgroupValueRaw(GetPathOfController(controller, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_EVENT_CONTROL)),
+                          std::to_string(efd) + " " + std::to_string(fd));
+    } catch (const CGroupBaseException &e) {
+        close(fd);
+        close(efd);
+        throw;
+    }
+
+    close(fd);
+    return efd;
+}
+
+
+////// Limits //////
+
+static std::string FormatMemoryLimitV1(unsigned long long kb)
+{
+    if (kb == CGROUP_MEMORY_PARAM_UNLIMITED)
+        return "-1";
+
+    return std::to_string(kb << 10);
+}
+
+/* quota/period ratio, -1 stands for an unlimited quota */
+static double CpuCfsRatio(long long quota, unsigned long long period)
+{
+    if (quota < 0 || quota == CGROUP_CPU_QUOTA_UNLIMITED)
+        return HUGE_VAL;
+
+    return double(quota) / period;
+}
+
+unsigned long long CgroupBackendV1::GetDefaultCpuShares()
+{
+    return 1024;
+}
+
+void CgroupBackendV1::SetLimits(const LimitSet &limits)
+{
+    BasicCgroup<CgroupBackendV1>(*this).SetLimits(limits);
+}
+
+/*
+ * The kernel rejects a cfs quota/period ratio above the parent's one and a
+ * memory.limit_in_bytes above memory.memsw.limit_in_bytes, so when both
+ * files of a pair change the write that keeps the intermediate state the
+ * most restrictive goes first.
+ */
+void CgroupBackendV1::PlanLimits(const LimitSet &limits, CgroupLimitPlan &plan)
+{
+    if (limits.cpuShares)
+        plan.push_back({ CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_SHARES,
+                         std::to_string(*limits.cpuShares == CGROUP_CPU_SHARES_DEFAULT ?
+                                        GetDefaultCpuShares() : *limits.cpuShares) });
+
+    CgroupLimitWrite quota(CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA);
+    CgroupLimitWrite period(CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_CFS_PERIOD);
+    if (limits.cpuQuota)
+        quota.value = std::to_string(*limits.cpuQuota);
+    if (limits.cpuPeriod)
+        period.value = std::to_string(*limits.cpuPeriod);
+
+    if (limits.cpuQuota && limits.cpuPeriod) {
+        long long curQuota = GetCpuCfsQuota();
+        unsigned long long curPeriod = GetCpuCfsPeriod();
+        quota.SetPrevious(std::to_string(curQuota));
+        period.SetPrevious(std::to_string(curPeriod));
+
+        if (CpuCfsRatio(curQuota, *limits.cpuPeriod) <= CpuCfsRatio(*limits.cpuQuota, curPeriod)) {
+            plan.push_back(period);
+            plan.push_back(quota);
+        } else {
+            plan.push_back(quota);
+            plan.push_back(period);
+        }
+    } else if (limits.cpuQuota) {
+        plan.push_back(quota);
+    } else if (limits.cpuPeriod) {
+        plan.push_back(period);
+    }
+
+    if (limits.memorySoftLimit)
+        plan.push_back({ CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_SOFT_LIMIT,
+                         FormatMemoryLimitV1(*limits.memorySoftLimit) });
+
+    CgroupLimitWrite hard(CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_HARD_LIMIT);
+    CgroupLimitWrite swap(CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_SWAP_HARD_LIMIT);
+    if (limits.memoryHardLimit)
+        hard.value = FormatMemoryLimitV1(*limits.memoryHardLimit);
+    if (limits.memSwapHardLimit)
+        swap.value = FormatMemoryLimitV1(*limits.memSwapHardLimit);
+
+    if (limits.memoryHardLimit && limits.memSwapHardLimit) {
+        if (*limits.memSwapHardLimit < *limits.memoryHardLimit)
+            throw CGroupMemoryException("Memory+swap limit '" + std::to_string(*limits.memSwapHardLimit)
+                        + "' must not be lower than memory limit '" + std::to_string(*limits.memoryHardLimit) + "'");
+
+        unsigned long long curSwap = GetMemSwapHardLimit();
+        swap.SetPrevious(FormatMemoryLimitV1(curSwap));
+
+        if (*limits.memoryHardLimit > curSwap) {
+            plan.push_back(swap);
+            plan.push_back(hard);
+        } else {
+            plan.push_back(hard);
+            plan.push_back(swap);
+        }
+    } else if (limits.memoryHardLimit) {
+        plan.push_back(hard);
+    } else if (limits.memSwapHardLimit) {
+        plan.push_back(swap);
+    }
+}
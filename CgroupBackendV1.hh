@@ -5,47 +5,55 @@
 #include <memory>
 #include <string>
 #include "CgroupBackend.hh"
+#include "CgroupContext.hh"
 
 namespace mdsd {
 
-struct _CgroupBackendV1Controller {
-    std::string mountPoint;
-    std::string linkPoint;
-    std::string placement;
-    CgroupController controller;
-
-    bool PlacementExist() { 
-        fs::path path(mountPoint);
-        path /= placement;
-        return fs::exists(path);
-    }
-
-    bool Enabled() { return placement != "" && placement != "/"; }
-    void Print() { CGROUP_DEBUG("controller=" << controller<< " mountPoint="<<mountPoint << " placement=" << placement); }
-};
-typedef struct _CgroupBackendV1Controller CgroupBackendV1Controller;
-
-class CgroupBackendV1 : public CgroupBackend
+class CgroupBackendV1 final : public CgroupBackend
 {
 public:
-    CgroupBackendV1(const std::string &placement);
+    static constexpr CgroupBackendType Type = CGROUP_BACKEND_TYPE_V1;
+    /* this should match the CgroupControllerFile enum, "" when there is no such file */
+    static constexpr const char *FileNames[] = {
+        "cgroup.procs", "tasks",
+        "cpuacct.usage", "cpu.shares", "cpu.cfs_period_us", "cpu.cfs_quota_us",
+        "memory.usage_in_bytes", "memory.limit_in_bytes", "memory.soft_limit_in_bytes",
+        "memory.memsw.usage_in_bytes", "memory.memsw.limit_in_bytes", "memory.memsw.soft_limit_in_bytes",
+        "memory.stat", "cpu.stat",
+        "blkio.throttle.io_service_bytes", "blkio.throttle.io_serviced", "pids.current",
+        "cpu.pressure", "memory.pressure", "io.pressure",
+        "memory.oom_control", "", "pids.events", "",
+        "", "", "cgroup.event_control",
+        "", "freezer.state",
+    };
+
+    CgroupBackendV1(const std::string &placement,
+                    const std::shared_ptr<const CgroupContext> &context = CgroupContext::Get());
     ~CgroupBackendV1() {};
 
     virtual void Init();
-    virtual int DetectMounts(const char *mntType, const char *mntOpts, const char *mntDir);
     virtual int DetectPlacement(const std::string &path, const std::string &controllers, const std::string &selfpath);
     virtual int ValidatePlacement();
     
-    virtual void AddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual CgroupResult<void> TryAddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS);
     virtual bool HasEmptyTasks(int controller = CGROUP_CONTROLLER_NONE);
+    using CgroupBackend::AddTasks;
+    virtual size_t AddTasks(const pid_t *pids, size_t count, CgroupTaskErrors &errors,
+                            unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual void GetTasks(std::vector<pid_t> &pids, unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual CgroupResult<void> TryKill();
+    virtual CgroupResult<bool> TryIsPopulated();
 
     virtual void Remove();
-    virtual void MakeGroup(unsigned int flags = CGROUP_NONE);
+    virtual CgroupResult<void> TryMakeGroup(unsigned int flags = CGROUP_NONE);
     virtual void SetOwner(uid_t uid, gid_t gid, int controllers);
+    virtual bool HasOwner(uid_t uid, gid_t gid);
+    virtual void GetChildren(std::vector<std::string> &names);
 
     virtual int DetectControllers(int controllers, int alreadyDetected = CGROUP_CONTROLLER_NONE);
     virtual bool HasController(int controller = 0);
     virtual std::string GetPathOfController(int controller, const std::string &key);
+    virtual bool IsControllerUsable(int controller);
 
     virtual void SetCpuCfsPeriod(unsigned long long cfs_period);
     virtual unsigned long long GetCpuCfsPeriod();
@@ -53,23 +61,56 @@ public:
     virtual void SetCpuCfsQuota(long long cfs_quota);
     virtual long long GetCpuCfsQuota();
 
+    virtual unsigned long long GetDefaultCpuShares();
+    virtual void SetLimits(const LimitSet &limits);
+
+    virtual void GetCpuStat(CgroupCpuStat &stat);
+    using CgroupBackend::GetMemoryStat;
+    virtual void GetMemoryStat(CgroupMemoryStat &stat);
+    virtual void GetIoStat(CgroupIoStat &stat);
+
+    virtual const std::vector<CgroupSampleFile> &GetSampleFiles();
+    virtual void ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample);
+
+    virtual const std::vector<CgroupEventFile> &GetEventFiles();
+    virtual void ParseEventFile(int fileType, const char *buf, size_t len, CgroupEventCounters &counters);
+    virtual int OpenEventControl(int controller, int fileType);
+
 // helpers
     virtual std::string GetBasePath(int controller = CGROUP_CONTROLLER_NONE);
     virtual std::string GetRelativeBasePath(int controller = CGROUP_CONTROLLER_NONE);
 
 protected:
+    template <typename Backend> friend class BasicCgroup;
+
     virtual void SetMemoryLimitInKB(const std::string &keylimit, unsigned long long kb);
     virtual unsigned long long GetMemoryLimitInKB(const std::string &keylimit);
+    virtual void PlanLimits(const LimitSet &limits, CgroupLimitPlan &plan);
     void MemoryInit();
-    int ResolveMountLink(const char *mntDir, const std::string& typeStr, CgroupBackendV1Controller *controller);
-    int MountOptsMatchController(const std::string &mntOpts, const std::string& typeStr);
+    void GetHierarchies(unsigned int taskflags, std::vector<int> &controllers);
+    /* freezer.state, Freeze() is false when the group is still FREEZING
+       after CGROUP_FREEZE_TIMEOUT_MS */
+    CgroupResult<bool> Freeze();
+    CgroupResult<void> Thaw();
+    /* SignalTree() in every hierarchy of the group */
+    CgroupResult<size_t> SignalHierarchies(const std::vector<int> &hierarchies, int signal);
+
+    const std::string &GetPlacement(int controller) const;
+    void SetPlacement(int controller, const std::string &path);
+    /* Placed below the root of the hierarchy */
+    bool Enabled(int controller) const;
+    bool PlacementExist(int controller);
 
     virtual std::string GetControllerName(int controller);
+    virtual int GetPressureController(int fileType);
 
 private:
     std::string placement;
     unsigned long long int memoryUnlimitedKB = CGROUP_MEMORY_PARAM_UNLIMITED;
-    CgroupBackendV1Controller controllers[CGROUP_CONTROLLER_LAST];
+    /* Placement in each hierarchy, as 1 + index in placements or 0 when
+       not placed. Groups mostly have the same one in every hierarchy. */
+    std::vector<std::string> placements;
+    uint8_t controllerPlacement[CGROUP_CONTROLLER_LAST] = {};
 };
 
 } // namespace mdsd
@@ -1,5 +1,5 @@
 #include "CgroupBackendV2.hh"
-#include "EnumToString.hh"
+#include "BasicCgroup.hh"
 
 #include <unistd.h>
 #include <mntent.h>
@@ -18,9 +18,17 @@
 #include <stdlib.h>
 // for file open/read
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <linux/sched.h>    /* clone3 */
+#include <signal.h>
 
 #include <algorithm> 
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <functional> 
 #include <cctype>
 #include <locale>
@@ -28,33 +36,66 @@
 using namespace mdsd;
 namespace fs = std::experimental::filesystem;
 
-/* this should match the enum CgroupController */
-CGROUP_ENUM_DECL(CgroupV2Controller);
-CGROUP_ENUM_IMPL(CgroupV2Controller,
-              CGROUP_CONTROLLER_LAST,
-              "", "cpu", "cpuacct", "cpuset", "memory", "devices",
-              "freezer", "io", "net_cls", "pids", "rdma", "perf_event", "name=systemd"
-);
-
-CGROUP_ENUM_IMPL(CgroupV2ControllerFile,
-              CGROUP_CONTROLLER_FILE_LAST,
-              "cgroup.procs", "cgroup.threads",
-              "cpu.stat", "cpu.weight", "cpu.max", "cpu.max",
-              "memory.current", "memory.max", "memory.high",
-              "memory.swap.current", "memory.swap.max", "memory.swap.high",
-);
-
-CgroupBackendV2::CgroupBackendV2(const std::string &placement)
-    : placement(placement), CgroupBackend(CGROUP_BACKEND_TYPE_V2, placement)
-{
-    for (size_t i = 0; i < CGROUP_CONTROLLER_FILE_LAST; i++) {
-        backendControllerFileMap[GetBackendType()][i] = CgroupV2ControllerFileTypeToString(i);        
-    }
+static const CgroupStatKey memoryStatKeys[] = {
+    CGROUP_STAT_KEY("anon", CgroupMemoryStat, rss),
+    CGROUP_STAT_KEY("file", CgroupMemoryStat, cache),
+    CGROUP_STAT_KEY("inactive_anon", CgroupMemoryStat, inactiveAnon),
+    CGROUP_STAT_KEY("active_anon", CgroupMemoryStat, activeAnon),
+    CGROUP_STAT_KEY("inactive_file", CgroupMemoryStat, inactiveFile),
+    CGROUP_STAT_KEY("active_file", CgroupMemoryStat, activeFile),
+    CGROUP_STAT_KEY("unevictable", CgroupMemoryStat, unevictable),
+    CGROUP_STAT_KEY("pgfault", CgroupMemoryStat, pgfault),
+    CGROUP_STAT_KEY("pgmajfault", CgroupMemoryStat, pgmajfault),
+};
+static const CgroupStatParser memoryStatParser(memoryStatKeys, sizeof(memoryStatKeys) / sizeof(memoryStatKeys[0]));
+
+static const CgroupStatKey cpuStatKeys[] = {
+    CGROUP_STAT_KEY("usage_usec", CgroupCpuStat, usageUsec),
+    CGROUP_STAT_KEY("user_usec", CgroupCpuStat, userUsec),
+    CGROUP_STAT_KEY("system_usec", CgroupCpuStat, systemUsec),
+    CGROUP_STAT_KEY("nr_periods", CgroupCpuStat, nrPeriods),
+    CGROUP_STAT_KEY("nr_throttled", CgroupCpuStat, nrThrottled),
+    CGROUP_STAT_KEY("throttled_usec", CgroupCpuStat, throttledUsec),
+};
+static const CgroupStatParser cpuStatParser(cpuStatKeys, sizeof(cpuStatKeys) / sizeof(cpuStatKeys[0]));
+
+static const CgroupStatKey memoryEventsKeys[] = {
+    CGROUP_EVENT_KEY("low", CGROUP_EVENT_MEMORY_LOW),
+    CGROUP_EVENT_KEY("high", CGROUP_EVENT_MEMORY_HIGH),
+    CGROUP_EVENT_KEY("max", CGROUP_EVENT_MEMORY_MAX),
+    CGROUP_EVENT_KEY("oom", CGROUP_EVENT_MEMORY_OOM),
+    CGROUP_EVENT_KEY("oom_kill", CGROUP_EVENT_MEMORY_OOM_KILL),
+    CGROUP_EVENT_KEY("oom_group_kill", CGROUP_EVENT_MEMORY_OOM_GROUP_KILL),
+};
+static const CgroupStatParser memoryEventsParser(memoryEventsKeys, sizeof(memoryEventsKeys) / sizeof(memoryEventsKeys[0]));
+
+static const CgroupStatKey swapEventsKeys[] = {
+    CGROUP_EVENT_KEY("high", CGROUP_EVENT_SWAP_HIGH),
+    CGROUP_EVENT_KEY("max", CGROUP_EVENT_SWAP_MAX),
+    CGROUP_EVENT_KEY("fail", CGROUP_EVENT_SWAP_FAIL),
+};
+static const CgroupStatParser swapEventsParser(swapEventsKeys, sizeof(swapEventsKeys) / sizeof(swapEventsKeys[0]));
+
+static const CgroupStatKey pidsEventsKeys[] = {
+    CGROUP_EVENT_KEY("max", CGROUP_EVENT_PIDS_MAX),
+};
+static const CgroupStatParser pidsEventsParser(pidsEventsKeys, sizeof(pidsEventsKeys) / sizeof(pidsEventsKeys[0]));
+
+static const CgroupStatKey cgroupEventsKeys[] = {
+    CGROUP_EVENT_KEY("populated", CGROUP_EVENT_POPULATED),
+    CGROUP_EVENT_KEY("frozen", CGROUP_EVENT_FROZEN),
+};
+static const CgroupStatParser cgroupEventsParser(cgroupEventsKeys, sizeof(cgroupEventsKeys) / sizeof(cgroupEventsKeys[0]));
+
+CgroupBackendV2::CgroupBackendV2(const std::string &placement, const std::shared_ptr<const CgroupContext> &context)
+    : placement(placement),
+      CgroupBackend(CGROUP_BACKEND_TYPE_V2, placement, context, BasicCgroup<CgroupBackendV2>::FileNameStrings())
+{
 }
 
 std::string CgroupBackendV2::GetBasePath(int controller)
 {
-    fs::path base(this->mountPoint);
+    fs::path base(context->GetMountPoint());
     base /= this->placement;
 
     return base;
@@ -73,7 +114,7 @@ bool CgroupBackendV2::IsCgroupCreated()
 
 std::string CgroupBackendV2::GetControllerName(int controller)
 {
-    return CgroupV2ControllerTypeToString(controller);
+    return cgroupV2Controllers.Name(controller);
 }
 
 void CgroupBackendV2::Init()
@@ -85,22 +126,14 @@ void CgroupBackendV2::Init()
         Example if placement="/sys/fs/cgroup/TEST" and mountPoint="/sys/fs/cgroup" => placement="/TEST"
         if placement="TEST" and mountPoint="/sys/fs/cgroup" => keep placement="TEST"
     */
-    if (this->placement.substr(0, this->mountPoint.size()) == this->mountPoint) {
-        this->placement = this->placement.substr(this->mountPoint.size());
+    const std::string &mountPoint = context->GetMountPoint();
+    if (this->placement.substr(0, mountPoint.size()) == mountPoint) {
+        this->placement = this->placement.substr(mountPoint.size());
     }
 
-    this->ParseControllersFile();
-}
-
-int CgroupBackendV2::DetectMounts(const char *mntType, const char *mntOpts, const char *mntDir)
-{
-    if (strcmp(mntType, CgroupBackend::GetBackendName().c_str()) != 0)
-        return 0;
-
-    this->mountPoint = std::string(mntDir);
-    // CGROUP_DEBUG("mountPoint=" << mountPoint);
-
-    return 0;
+    auto parsed = this->ParseControllersFile();
+    if (!parsed)
+        ThrowError(parsed.Error(), "'cgroup.controllers' of '" + GetBasePath() + "'");
 }
 
 int CgroupBackendV2::DetectPlacement(const std::string &path,
@@ -136,20 +169,207 @@ int CgroupBackendV2::ValidatePlacement()
     return 0;
 }
 
-void CgroupBackendV2::AddTask(pid_t pid, unsigned int taskflags)
+CgroupResult<void> CgroupBackendV2::TryAddTask(pid_t pid, unsigned int taskflags)
 {
     if (taskflags & CGROUP_TASK_THREAD)
-        SetCgroupValueI64(CGROUP_CONTROLLER_NONE, "cgroup.threads", pid);
-    else
-        SetCgroupValueI64(CGROUP_CONTROLLER_NONE, "cgroup.procs", pid);
+        return BasicCgroup<CgroupBackendV2>(*this).TryWrite<CgroupFiles::CgroupThreads>(pid);
+    return BasicCgroup<CgroupBackendV2>(*this).TryWrite<CgroupFiles::CgroupProcs>(pid);
+}
+
+size_t CgroupBackendV2::AddTasks(const pid_t *pids, size_t count, CgroupTaskErrors &errors, unsigned int taskflags)
+{
+    std::vector<std::pair<int, std::string>> files;
+    files.emplace_back(CGROUP_CONTROLLER_NONE, GetControllerFileName((taskflags & CGROUP_TASK_THREAD) ?
+        CGROUP_CONTROLLER_FILE_CGROUP_THREADS : CGROUP_CONTROLLER_FILE_CGROUP_PROCS));
+
+    return WriteTasks(files, pids, count, errors);
+}
+
+void CgroupBackendV2::GetTasks(std::vector<pid_t> &pids, unsigned int taskflags)
+{
+    pids.clear();
+    ReadTasks(GetPathOfController(CGROUP_CONTROLLER_NONE, GetControllerFileName((taskflags & CGROUP_TASK_THREAD) ?
+        CGROUP_CONTROLLER_FILE_CGROUP_THREADS : CGROUP_CONTROLLER_FILE_CGROUP_PROCS)), pids);
+    std::sort(pids.begin(), pids.end());
+}
+
+#ifdef CLONE_INTO_CGROUP
+static std::atomic<bool> clone3IntoCgroupUnsupported(false);
+#endif
+
+/*
+ * clone3(CLONE_INTO_CGROUP) (5.7+) creates the child directly in the
+ * cgroup, so it never runs elsewhere and no cgroup.procs write is needed.
+ * The cgroup directory fd stays in the file cache. Older kernels go
+ * through the fork and AddTask path.
+ */
+pid_t CgroupBackendV2::Spawn(const char *path, char *const argv[])
+{
+#if defined(CLONE_INTO_CGROUP) && defined(__NR_clone3)
+    if (!clone3IntoCgroupUnsupported.load(std::memory_order_relaxed))
+    {
+        auto use = UseFiles();
+        int dirFd = GetCgroupFileFd(CGROUP_CONTROLLER_NONE, ".", O_PATH | O_DIRECTORY);
+        int error[2];
+
+        if (pipe2(error, O_CLOEXEC) < 0)
+            throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot create pipe");
+
+        struct clone_args args;
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = dirFd;
+
+        pid_t pid = syscall(__NR_clone3, &args, sizeof(args));
+        if (pid == 0) {
+            close(error[0]);
+            SpawnExec(path, argv, error[1]);
+        }
+
+        int err = errno;
+        close(error[1]);
+        if (pid > 0)
+            return SpawnWaitExec(pid, error[0], path);
+        close(error[0]);
+
+        /* ENOSYS before 5.3, E2BIG for the larger struct before 5.7 */
+        if (err != ENOSYS && err != E2BIG && err != EINVAL) {
+            if (err == ENODEV || err == ENOENT)
+                InvalidateCgroupFile(CGROUP_CONTROLLER_NONE, ".", O_PATH | O_DIRECTORY);
+            throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot spawn '"
+                                      + std::string(path) + "' in '" + GetBasePath() + "'");
+        }
+
+        CGROUP_DEBUG("clone3(CLONE_INTO_CGROUP) not supported (errno=" << err << "), falling back to fork");
+        clone3IntoCgroupUnsupported = true;
+    }
+#endif
+
+    return CgroupBackend::Spawn(path, argv);
+}
+
+CgroupResult<void> CgroupBackendV2::ReadCgroupEvents(CgroupEventCounters &counters)
+{
+    char buf[CGROUP_MAX_VAL];
+    auto n = TryReadCgroupFile(CGROUP_CONTROLLER_NONE, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_EVENTS),
+                               buf, sizeof(buf));
+    if (!n)
+        return n.Error();
+
+    if (cgroupEventsParser.Parse(buf, *n, &counters) == 0)
+        return CgroupError(CGROUP_ERR_INVALID, EINVAL, "parse");
+
+    return CgroupResult<void>();
 }
 
+/* populated also accounts for the descendants, which is what matters
+   before removing the group */
 bool CgroupBackendV2::HasEmptyTasks(int controller)
 {
-    if (GetCgroupValueStr(controller, "cgroup.procs") == "")
-        return false;
+    auto populated = TryIsPopulated();
+    if (!populated)
+        ThrowError(populated.Error(), "'cgroup.events'");
+
+    return !*populated;
+}
+
+CgroupResult<bool> CgroupBackendV2::TryIsPopulated()
+{
+    CgroupEventCounters counters;
+    auto read = ReadCgroupEvents(counters);
+    if (!read)
+        return read.Error();
 
-    return true;
+    return counters.values[CGROUP_EVENT_POPULATED] != 0;
+}
+
+/* cgroup.events is a kernfs file, poll() reports every change of it */
+int CgroupBackendV2::GetPopulatedFd()
+{
+    return TryGetCgroupFileFd(CGROUP_CONTROLLER_NONE, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_EVENTS),
+                              O_RDONLY).ValueOr(-1);
+}
+
+CgroupResult<bool> CgroupBackendV2::Freeze()
+{
+    auto written = TryWriteCgroupFile(CGROUP_CONTROLLER_NONE,
+                                      GetControllerFileName(CGROUP_CONTROLLER_FILE_FREEZER_STATE), "1", 1);
+    if (!written)
+        return written.Error();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CGROUP_FREEZE_TIMEOUT_MS);
+    for (;;) {
+        CgroupEventCounters counters;
+        auto read = ReadCgroupEvents(counters);
+        if (!read)
+            return read.Error();
+        if (counters.values[CGROUP_EVENT_FROZEN])
+            return true;
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+            return false;
+
+        auto use = UseFiles();
+        struct pollfd pfd = { GetPopulatedFd(), POLLPRI, 0 };
+        poll(&pfd, 1, remaining.count());
+    }
+}
+
+CgroupResult<void> CgroupBackendV2::Thaw()
+{
+    return TryWriteCgroupFile(CGROUP_CONTROLLER_NONE,
+                              GetControllerFileName(CGROUP_CONTROLLER_FILE_FREEZER_STATE), "0", 1);
+}
+
+/*
+ * cgroup.kill (5.14+) kills the whole subtree in the kernel, forks racing
+ * with it included. Older kernels freeze the group, signal every process
+ * of the subtree and thaw it.
+ */
+CgroupResult<void> CgroupBackendV2::TryKill()
+{
+    if (this->placement == "/" || this->placement == "")
+        return CgroupError(CGROUP_ERR_INVALID, EINVAL, "kill");
+
+    auto killed = TryWriteCgroupFile(CGROUP_CONTROLLER_NONE, GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_KILL), "1", 1);
+    if (killed || killed.Error().code != CGROUP_ERR_NOT_FOUND)
+        return killed;
+
+    /* NOT_FOUND either when the group is gone or before 5.2 (no cgroup.freeze),
+       the latter is signalled without freezing */
+    auto frozen = Freeze();
+    if (!frozen && (frozen.Error().code != CGROUP_ERR_NOT_FOUND || !IsCgroupCreated()))
+        return frozen.Error();
+    bool isFrozen = frozen.ValueOr(false);
+
+    CgroupResult<void> result;
+    for (int round = 0; round < (isFrozen ? 1 : CGROUP_KILL_ROUNDS); round++) {
+        auto n = SignalTree(CGROUP_CONTROLLER_NONE, this->placement, SIGKILL);
+        if (!n) {
+            result = n.Error();
+            break;
+        }
+        if (*n == 0)
+            break;
+    }
+
+    if (frozen) {
+        auto thawed = Thaw();
+        if (!thawed && thawed.Error().code != CGROUP_ERR_NOT_FOUND && result)
+            result = thawed;
+    }
+
+    CGROUP_DEBUG("Killed the tasks of '" << this->placement << "' without cgroup.kill" << (isFrozen ? " (frozen)" : ""));
+    return result;
+}
+
+void CgroupBackendV2::GetChildren(std::vector<std::string> &names)
+{
+    names.clear();
+    ListChildren(GetBasePath(), names);
+    std::sort(names.begin(), names.end());
 }
 
 void CgroupBackendV2::Remove()
@@ -159,62 +379,61 @@ void CgroupBackendV2::Remove()
     if (this->placement == "/" || this->placement == "")
         return;
 
-    fs::path grppath = this->GetBasePath();
-    std::uintmax_t n = fs::remove_all(grppath);
+    InvalidateFileCache();
+    std::uintmax_t n = RemoveTree(CGROUP_CONTROLLER_NONE, this->placement);
     this->controllers = 0;
-    CGROUP_DEBUG("Deleted " << n << " files or directories here " << grppath);
+    CGROUP_DEBUG("Deleted " << n << " groups here " << fs::path(this->GetBasePath()));
 }
 
 
-/**
- * EnableSubtreeControllerCgroupV2:
- *
- * Returns: -1 on fatal error
- *          -2 if we failed to write into cgroup.subtree_control
- *          0 on success
- */
-int CgroupBackendV2::EnableSubtreeControllerCgroupV2(int controller)
+/* Writes "+controller" (or "-controller") into cgroup.subtree_control of this group */
+static CgroupResult<void> WriteSubtreeControl(CgroupBackendV2 &cgroup, char op, int controller)
 {
-    std::string val = std::string("+") + GetControllerName(controller);
-    std::string path = GetPathOfController(controller, "cgroup.subtree_control");
-    FileWriteStr(path, val);
+    if (!cgroup.IsControllerUsable(controller))
+        return CgroupError(CGROUP_ERR_NO_CONTROLLER, ENOENT, "write");
 
-    return 0;
+    char buf[CGROUP_NUM_BUF_LEN];
+    int n = snprintf(buf, sizeof(buf), "%c%s", op, cgroupV2Controllers.Name(controller));
+    return cgroup.TryWriteCgroupFile(CGROUP_CONTROLLER_NONE,
+                                     cgroup.GetControllerFileName(CGROUP_CONTROLLER_FILE_CGROUP_SUBTREE_CONTROL), buf, n);
 }
 
-/**
- * EnableSubtreeControllerCgroupV2:
- *
- * Returns: -1 on fatal error
- *          -2 if we failed to write into cgroup.subtree_control
- *          0 on success
- */
-int CgroupBackendV2::DisableSubtreeControllerCgroupV2(int controller)
+CgroupResult<void> CgroupBackendV2::EnableSubtreeControllerCgroupV2(int controller)
 {
-    std::string val = std::string("-") + GetControllerName(controller);
-    std::string path = GetPathOfController(controller, "cgroup.subtree_control");
-    FileWriteStr(path, val);
+    return WriteSubtreeControl(*this, '+', controller);
+}
 
-    return 0;
+CgroupResult<void> CgroupBackendV2::DisableSubtreeControllerCgroupV2(int controller)
+{
+    return WriteSubtreeControl(*this, '-', controller);
 }
 
-void CgroupBackendV2::MakeGroup(unsigned int flags)
+CgroupResult<void> CgroupBackendV2::TryMakeGroup(unsigned int flags)
 {
-    fs::path path(this->GetBasePath());
-    int controller;
+    std::string path = this->GetBasePath();
 
-    if (flags & CGROUP_SYSTEMD)
-        throw CGroupBaseException("Running with systemd so we should not create cgroups ourselves.");
+    if (flags & CGROUP_SYSTEMD) {
+        CGROUP_ERROR("Running with systemd so we should not create cgroups ourselves.");
+        return CgroupError(CGROUP_ERR_SYSTEM, EPERM, "create");
+    }
 
     CGROUP_DEBUG("Make group " << path << " perms:"  << static_cast<int>(fs::perms::all));
 
-    auto fstatus = fs::status(path);
-    
-    if (!fs::exists(fstatus) && !fs::create_directory(path))
-        throw CGroupFileNotFoundException(std::to_string(errno) + "Failed to create v2 cgroup " + path.string());
+    // a re-created group has new interface files
+    InvalidateFileCache();
+
+    if (mkdir(path.c_str(), 0777) < 0 && errno != EEXIST)
+        return CgroupError::FromErrno(errno, "create");
+
+    auto parent = CgroupBackendV2(fs::path(this->placement).parent_path(), context);
+    auto parsed = parent.ParseControllersFile();
+    if (!parsed)
+        return parsed;
 
-    auto parent = CgroupBackendV2(path.parent_path());
-    parent.ParseControllersFile();
+    /* siblings share the parent, only enable what is not enabled yet */
+    auto subtree = BasicCgroup<CgroupBackendV2>(parent).TryRead<CgroupFiles::CgroupSubtreeControl>();
+    if (!subtree)
+        return subtree.Error();
 
     for (size_t controller = CGROUP_CONTROLLER_CPU; controller < CGROUP_CONTROLLER_LAST; controller++)
     {
@@ -225,51 +444,34 @@ void CgroupBackendV2::MakeGroup(unsigned int flags)
         /* Controllers that are implicitly enabled if available. */
         if (controller == CGROUP_CONTROLLER_CPUACCT || controller == CGROUP_CONTROLLER_DEVICES)
             continue;
-        
-        try
-        {
-            parent.EnableSubtreeControllerCgroupV2(controller);
-        } catch (CGroupBaseException ex) {
+
+        if (*subtree & (1 << controller))
+            continue;
+
+        auto enabled = parent.EnableSubtreeControllerCgroupV2(controller);
+        if (!enabled) {
             this->controllers &= ~(1 << controller);
-            CGROUP_ERROR("failed to enable '" << GetControllerName(controller) << "' controller, error:" << ex.what());
+            CGROUP_ERROR("failed to enable '" << GetControllerName(controller) << "' controller, errno:" << enabled.Error().error);
         }
     }
 
     // re-update controllers
-    this->ParseControllersFile();
+    return this->ParseControllersFile();
 }
 
 
-int CgroupBackendV2::ParseControllersFile()
+CgroupResult<void> CgroupBackendV2::ParseControllersFile()
 {
-    std::string controllerStr;
-    std::vector<std::string> controllerList;
-
     if (!this->IsCgroupCreated())
-        return 0;
-
-    fs::path controllerFile(this->GetBasePath());
-    controllerFile /= "cgroup.controllers";
-
-    controllerStr = FileReadAll(controllerFile);
-
-    CGROUP_DEBUG("Parsing controlers from path " << controllerFile << " => '" << controllerStr << "'");
-    trim(controllerStr);
-    split(controllerList, controllerStr, boost::is_any_of(" "));
-
-    if (controllerList.empty())
-        return -1;
+        return CgroupResult<void>();
 
-    this->controllers = CGROUP_CONTROLLER_NONE; // reset
-    for (int i = 0; i < controllerList.size(); i++)
-    {
-        int type = CgroupV2ControllerTypeFromString(controllerList[i]);
-        if (type >= 0)
-            this->controllers |= 1 << type;
-    }
+    auto controllers = BasicCgroup<CgroupBackendV2>(*this).TryRead<CgroupFiles::CgroupControllers>();
+    if (!controllers)
+        return controllers.Error();
 
-    controllerList.clear();
-    return 0;
+    this->controllers = *controllers;
+    CGROUP_DEBUG("Parsed controllers of " << this->GetBasePath() << " => 0x" << std::hex << this->controllers << std::dec);
+    return CgroupResult<void>();
 }
 
 
@@ -298,6 +500,11 @@ bool CgroupBackendV2::HasController(int controller)
     return this->controllers & (1 << controller);
 }
 
+bool CgroupBackendV2::IsControllerUsable(int controller)
+{
+    return controller == CGROUP_CONTROLLER_NONE || HasController(controller);
+}
+
 std::string CgroupBackendV2::GetPathOfController(int controller, const std::string &key)
 {
     if (controller != CGROUP_CONTROLLER_NONE && !HasController(controller))
@@ -312,70 +519,81 @@ std::string CgroupBackendV2::GetPathOfController(int controller, const std::stri
 
 //////  CPU   //////
 
+/* cpu.max is "$QUOTA $PERIOD" where $QUOTA may be "max" */
+void CgroupBackendV2::ReadCpuMax(long long &quota, unsigned long long &period)
+{
+    const std::string &key = GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA);
+    char buf[CGROUP_NUM_BUF_LEN];
+    ssize_t n = ReadCgroupFile(CGROUP_CONTROLLER_CPU, key, buf, sizeof(buf));
+
+    const char *cur = buf;
+    if (!ParseValueI64(cur, buf + n, quota, CGROUP_CPU_QUOTA_UNLIMITED) ||
+        !ParseValueU64(cur, buf + n, period))
+        throw CGroupCPUException("Invalid '" + key + "' data.");
+}
+
 void CgroupBackendV2::SetCpuCfsPeriod(unsigned long long cfs_period)
 {
     this->ValidateCPUCfsPeiod(cfs_period);
 
-    std::string str = GetCgroupValueStr(CGROUP_CONTROLLER_CPU, "cpu.max");
+    const std::string &key = GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_PERIOD);
+    char buf[CGROUP_NUM_BUF_LEN];
+    ssize_t n = ReadCgroupFile(CGROUP_CONTROLLER_CPU, key, buf, sizeof(buf));
 
-    std::vector<std::string> strList;
-    split(strList, str, is_any_of(" "));
-    if (strList.size() <= 1)
-        throw CGroupCPUException("Invalid 'cpu.max' data.");
+    /* keep the current quota token as is, "max" included */
+    char *sep = (char *)memchr(buf, ' ', n);
+    if (!sep)
+        throw CGroupCPUException("Invalid '" + key + "' data.");
 
-    std::string value = strList[0] + " " + std::to_string(cfs_period);
-
-    SetCgroupValueStr(CGROUP_CONTROLLER_CPU, "cpu.max", value);
+    auto res = std::to_chars(sep + 1, buf + sizeof(buf), cfs_period);
+    WriteCgroupFile(CGROUP_CONTROLLER_CPU, key, buf, res.ptr - buf);
 }
 
 void CgroupBackendV2::SetCpuCfsQuota(long long cfs_quota)
 {
     this->ValidateCPUCfsQuota(cfs_quota);
 
-    if (cfs_quota == ULLONG_MAX / 1000) {
-        SetCgroupValueStr(CGROUP_CONTROLLER_CPU, "cpu.max", "max");
+    const std::string &key = GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA);
+    if (cfs_quota == CGROUP_CPU_QUOTA_UNLIMITED) {
+        SetCgroupValueStr(CGROUP_CONTROLLER_CPU, key, "max");
+        return;
     }
 
-    SetCgroupValueI64(CGROUP_CONTROLLER_CPU, "cpu.max", cfs_quota);
+    SetCgroupValueI64(CGROUP_CONTROLLER_CPU, key, cfs_quota);
 }
 
 unsigned long long CgroupBackendV2::GetCpuCfsPeriod()
 {
-    std::string str = GetCgroupValueStr(CGROUP_CONTROLLER_CPU, "cpu.max");
-
-    std::vector<std::string> strList;
-    split(strList, str, is_any_of(" "));
-
-    if (strList.size() <= 1) {
-        CGROUP_ERROR("Invalid 'cpu.max' data.");
-        return -1;
-    }
+    long long quota;
+    unsigned long long period;
 
-    return std::stoull(strList[1]);;
+    ReadCpuMax(quota, period);
+    return period;
 }
 
 long long CgroupBackendV2::GetCpuCfsQuota()
 {
-    std::string str = GetCgroupValueStr(CGROUP_CONTROLLER_CPU, "cpu.max");
-    
-    if (strncmp(str.c_str(), "max", 3) == 0) {
-        return ULLONG_MAX / 1000;
-    }
+    long long quota;
+    unsigned long long period;
 
-    std::vector<std::string> strList;
-    split(strList, str, is_any_of(" "));
-
-    if (strList.size() <= 1) {
-        CGROUP_ERROR("Invalid 'cpu.max' data.");
-        return -1;
-    }
+    ReadCpuMax(quota, period);
+    return quota;
+}
 
-    return stoll(strList[0]);
+/* cpu.stat always exists in cgroup v2, even without the cpu controller */
+void CgroupBackendV2::GetCpuStat(CgroupCpuStat &stat)
+{
+    ReadStatFile(CGROUP_CONTROLLER_NONE, GetControllerFileName(CGROUP_CONTROLLER_FILE_CPU_STAT), cpuStatParser, &stat);
 }
 
 
 ////// Memory //////
 
+void CgroupBackendV2::GetMemoryStat(CgroupMemoryStat &stat)
+{
+    ReadStatFile(CGROUP_CONTROLLER_MEMORY, GetControllerFileName(CGROUP_CONTROLLER_FILE_MEMORY_STAT), memoryStatParser, &stat);
+}
+
 void CgroupBackendV2::SetMemoryLimitInKB(const std::string &keylimit, unsigned long long kb)
 {
     unsigned long long maxkb = CGROUP_MEMORY_PARAM_UNLIMITED;
@@ -393,16 +611,173 @@ void CgroupBackendV2::SetMemoryLimitInKB(const std::string &keylimit, unsigned l
 
 unsigned long long CgroupBackendV2::GetMemoryLimitInKB(const std::string &keylimit)
 {
-    unsigned long long value;
-    std::string strval = GetCgroupValueStr(CGROUP_CONTROLLER_MEMORY, keylimit);
+    unsigned long long value = GetCgroupValueU64(CGROUP_CONTROLLER_MEMORY, keylimit, CGROUP_PARAM_MAX);
 
-    if (strval == "max")
+    if (value == CGROUP_PARAM_MAX)
         return CGROUP_MEMORY_PARAM_UNLIMITED;
 
-    value = std::stoull(strval) >> 10;
+    value >>= 10;
     if (value >= CGROUP_MEMORY_PARAM_UNLIMITED)
         value = CGROUP_MEMORY_PARAM_UNLIMITED;
 
     return value;
 }
 
+
+////// IO //////
+
+void CgroupBackendV2::GetIoStat(CgroupIoStat &stat)
+{
+    char buf[CGROUP_STAT_BUF_LEN];
+    ssize_t n = ReadCgroupFile(CGROUP_CONTROLLER_BLKIO, GetControllerFileName(CGROUP_CONTROLLER_FILE_IO_STAT), buf, sizeof(buf));
+
+    ParseIoStatV2(buf, n, stat);
+}
+
+
+////// Sampling //////
+
+const std::vector<CgroupSampleFile> &CgroupBackendV2::GetSampleFiles()
+{
+    static const std::vector<CgroupSampleFile> files = {
+        { CGROUP_SAMPLE_MEMORY_USAGE, CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_USAGE, CGROUP_NUM_BUF_LEN },
+        { CGROUP_SAMPLE_MEMORY_STAT, CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_STAT, CGROUP_STAT_BUF_LEN },
+        { CGROUP_SAMPLE_CPU_STAT, CGROUP_CONTROLLER_NONE, CGROUP_CONTROLLER_FILE_CPU_STAT, CGROUP_NUM_BUF_LEN * 4 },
+        { CGROUP_SAMPLE_IO_STAT, CGROUP_CONTROLLER_BLKIO, CGROUP_CONTROLLER_FILE_IO_STAT, CGROUP_STAT_BUF_LEN },
+        { CGROUP_SAMPLE_PIDS_CURRENT, CGROUP_CONTROLLER_PIDS, CGROUP_CONTROLLER_FILE_PIDS_CURRENT, CGROUP_NUM_BUF_LEN },
+    };
+
+    return files;
+}
+
+void CgroupBackendV2::ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample)
+{
+    const char *end = buf + len;
+    unsigned long long value;
+
+    switch (fileType)
+    {
+        case CGROUP_CONTROLLER_FILE_MEMORY_USAGE:
+            if (ParseValueU64(buf, end, value))
+                sample.memoryUsage = value >> 10;
+            break;
+        case CGROUP_CONTROLLER_FILE_MEMORY_STAT:
+            memoryStatParser.Parse(buf, len, &sample.memoryStat);
+            break;
+        case CGROUP_CONTROLLER_FILE_CPU_STAT:
+            cpuStatParser.Parse(buf, len, &sample.cpuStat);
+            break;
+        case CGROUP_CONTROLLER_FILE_IO_STAT:
+            ParseIoStatV2(buf, len, sample.ioStat);
+            break;
+        case CGROUP_CONTROLLER_FILE_PIDS_CURRENT:
+            if (ParseValueU64(buf, end, value))
+                sample.pidsCurrent = value;
+            break;
+    }
+}
+
+
+////// Events //////
+
+const std::vector<CgroupEventFile> &CgroupBackendV2::GetEventFiles()
+{
+    static const std::vector<CgroupEventFile> files = {
+        { CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_EVENTS, false },
+        { CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_SWAP_EVENTS, false },
+        { CGROUP_CONTROLLER_PIDS, CGROUP_CONTROLLER_FILE_PIDS_EVENTS, false },
+        { CGROUP_CONTROLLER_NONE, CGROUP_CONTROLLER_FILE_CGROUP_EVENTS, false },
+    };
+
+    return files;
+}
+
+void CgroupBackendV2::ParseEventFile(int fileType, const char *buf, size_t len, CgroupEventCounters &counters)
+{
+    switch (fileType)
+    {
+        case CGROUP_CONTROLLER_FILE_MEMORY_EVENTS:
+            memoryEventsParser.Parse(buf, len, &counters);
+            break;
+        case CGROUP_CONTROLLER_FILE_MEMORY_SWAP_EVENTS:
+            swapEventsParser.Parse(buf, len, &counters);
+            break;
+        case CGROUP_CONTROLLER_FILE_PIDS_EVENTS:
+            pidsEventsParser.Parse(buf, len, &counters);
+            break;
+        case CGROUP_CONTROLLER_FILE_CGROUP_EVENTS:
+            cgroupEventsParser.Parse(buf, len, &counters);
+            break;
+    }
+}
+
+
+////// Limits //////
+
+static std::string FormatMemoryLimitV2(unsigned long long kb)
+{
+    if (kb == CGROUP_MEMORY_PARAM_UNLIMITED)
+        return "max";
+
+    return std::to_string(kb << 10);
+}
+
+unsigned long long CgroupBackendV2::GetDefaultCpuShares()
+{
+    return 100;
+}
+
+void CgroupBackendV2::SetLimits(const LimitSet &limits)
+{
+    BasicCgroup<CgroupBackendV2>(*this).SetLimits(limits);
+}
+
+/*
+ * quota and period share cpu.max, so both go into a single write. The
+ * memory.high throttling limit is lowered before memory.max so that a
+ * shrinking tenant gets throttled before it gets reclaimed or OOM killed.
+ */
+static std::string FormatCpuQuota(long long quota)
+{
+    return quota == CGROUP_CPU_QUOTA_UNLIMITED ? "max" : std::to_string(quota);
+}
+
+void CgroupBackendV2::PlanLimits(const LimitSet &limits, CgroupLimitPlan &plan)
+{
+    if (limits.cpuShares)
+        plan.push_back({ CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_SHARES,
+                         std::to_string(*limits.cpuShares == CGROUP_CPU_SHARES_DEFAULT ?
+                                        GetDefaultCpuShares() : *limits.cpuShares) });
+
+    if (limits.cpuQuota || limits.cpuPeriod) {
+        long long quota;
+        unsigned long long period;
+
+        CgroupLimitWrite write(CGROUP_CONTROLLER_CPU, CGROUP_CONTROLLER_FILE_CPU_CFS_QUOTA);
+
+        /* the period alone cannot be written, keep the current quota */
+        if (limits.cpuQuota) {
+            quota = *limits.cpuQuota;
+        } else {
+            ReadCpuMax(quota, period);
+            write.SetPrevious(FormatCpuQuota(quota) + " " + std::to_string(period));
+        }
+
+        write.value = FormatCpuQuota(quota);
+        if (limits.cpuPeriod)
+            write.value += " " + std::to_string(*limits.cpuPeriod);
+        plan.push_back(write);
+    }
+
+    if (limits.memorySoftLimit)
+        plan.push_back({ CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_SOFT_LIMIT,
+                         FormatMemoryLimitV2(*limits.memorySoftLimit) });
+
+    if (limits.memoryHardLimit)
+        plan.push_back({ CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_HARD_LIMIT,
+                         FormatMemoryLimitV2(*limits.memoryHardLimit) });
+
+    if (limits.memSwapHardLimit)
+        plan.push_back({ CGROUP_CONTROLLER_MEMORY, CGROUP_CONTROLLER_FILE_MEMORY_SWAP_HARD_LIMIT,
+                         FormatMemoryLimitV2(*limits.memSwapHardLimit) });
+}
@@ -5,33 +5,59 @@
 #include <memory>
 #include <string>
 #include "CgroupBackend.hh"
+#include "CgroupContext.hh"
 
 namespace mdsd {
 
-class CgroupBackendV2 : public CgroupBackend
+class CgroupBackendV2 final : public CgroupBackend
 {
 public:
-    CgroupBackendV2(const std::string &placement);
+    static constexpr CgroupBackendType Type = CGROUP_BACKEND_TYPE_V2;
+    /* this should match the CgroupControllerFile enum, "" when there is no such file */
+    static constexpr const char *FileNames[] = {
+        "cgroup.procs", "cgroup.threads",
+        "cpu.stat", "cpu.weight", "cpu.max", "cpu.max",
+        "memory.current", "memory.max", "memory.high",
+        "memory.swap.current", "memory.swap.max", "memory.swap.high",
+        "memory.stat", "cpu.stat",
+        "io.stat", "io.stat", "pids.current",
+        "cpu.pressure", "memory.pressure", "io.pressure",
+        "memory.events", "memory.swap.events", "pids.events", "cgroup.events",
+        "cgroup.controllers", "cgroup.subtree_control", "",
+        "cgroup.kill", "cgroup.freeze",
+    };
+
+    CgroupBackendV2(const std::string &placement,
+                    const std::shared_ptr<const CgroupContext> &context = CgroupContext::Get());
     ~CgroupBackendV2() {};
 
     virtual void Init();
-    virtual int DetectMounts(const char *mntType, const char *mntOpts, const char *mntDir);
     virtual int DetectPlacement(const std::string &path, const std::string &controllers, const std::string &selfpath);
     virtual int ValidatePlacement();
     
-    virtual void AddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual CgroupResult<void> TryAddTask(pid_t pid, unsigned int taskflags = CGROUP_TASK_PROCESS);
     virtual bool HasEmptyTasks(int controller = CGROUP_CONTROLLER_NONE);
+    virtual pid_t Spawn(const char *path, char *const argv[]);
+    using CgroupBackend::AddTasks;
+    virtual size_t AddTasks(const pid_t *pids, size_t count, CgroupTaskErrors &errors,
+                            unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual void GetTasks(std::vector<pid_t> &pids, unsigned int taskflags = CGROUP_TASK_PROCESS);
+    virtual CgroupResult<void> TryKill();
+    virtual CgroupResult<bool> TryIsPopulated();
+    virtual int GetPopulatedFd();
 
+    virtual void GetChildren(std::vector<std::string> &names);
     virtual void Remove();
-    virtual void MakeGroup(unsigned int flags = CGROUP_NONE);
-    int EnableSubtreeControllerCgroupV2(int controller);
-    int DisableSubtreeControllerCgroupV2(int controller);
+    virtual CgroupResult<void> TryMakeGroup(unsigned int flags = CGROUP_NONE);
+    CgroupResult<void> EnableSubtreeControllerCgroupV2(int controller);
+    CgroupResult<void> DisableSubtreeControllerCgroupV2(int controller);
 
 
-    int ParseControllersFile();
+    CgroupResult<void> ParseControllersFile();
     virtual int DetectControllers(int controllers, int alreadyDetected = CGROUP_CONTROLLER_NONE);
     virtual bool HasController(int controller = 0);
     virtual std::string GetPathOfController(int controller, const std::string &key);
+    virtual bool IsControllerUsable(int controller);
 
     virtual void SetCpuCfsPeriod(unsigned long long cfs_period);
     virtual unsigned long long GetCpuCfsPeriod();
@@ -39,19 +65,41 @@ public:
     virtual void SetCpuCfsQuota(long long cfs_quota);
     virtual long long GetCpuCfsQuota();
 
+    virtual unsigned long long GetDefaultCpuShares();
+    virtual void SetLimits(const LimitSet &limits);
+
+    virtual void GetCpuStat(CgroupCpuStat &stat);
+    using CgroupBackend::GetMemoryStat;
+    virtual void GetMemoryStat(CgroupMemoryStat &stat);
+    virtual void GetIoStat(CgroupIoStat &stat);
+
+    virtual const std::vector<CgroupSampleFile> &GetSampleFiles();
+    virtual void ParseSampleFile(int fileType, const char *buf, size_t len, CgroupUsageSample &sample);
+
+    virtual const std::vector<CgroupEventFile> &GetEventFiles();
+    virtual void ParseEventFile(int fileType, const char *buf, size_t len, CgroupEventCounters &counters);
+
 // helpers
     virtual std::string GetBasePath(int controller = CGROUP_CONTROLLER_NONE);
     virtual std::string GetRelativeBasePath(int controller = CGROUP_CONTROLLER_NONE);
     virtual bool IsCgroupCreated();
 protected:
+    template <typename Backend> friend class BasicCgroup;
+
     virtual void SetMemoryLimitInKB(const std::string &keylimit, unsigned long long kb);
     virtual unsigned long long GetMemoryLimitInKB(const std::string &keylimit);
+    virtual void PlanLimits(const LimitSet &limits, CgroupLimitPlan &plan);
     virtual std::string GetControllerName(int controller);
+    void ReadCpuMax(long long &quota, unsigned long long &period);
+    CgroupResult<void> ReadCgroupEvents(CgroupEventCounters &counters);
+    /* cgroup.freeze, Freeze() is false when cgroup.events does not report
+       the group frozen after CGROUP_FREEZE_TIMEOUT_MS */
+    CgroupResult<bool> Freeze();
+    CgroupResult<void> Thaw();
 
 private:
     std::string placement;
-    std::string mountPoint;
-    int controllers;
+    int controllers = 0;
 };
 
 } // namespace mdsd
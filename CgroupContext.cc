@@ -0,0 +1,262 @@
+#include "CgroupContext.hh"
+#include "CgroupFile.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <boost/algorithm/string.hpp>
+
+using namespace mdsd;
+using namespace boost::algorithm;
+
+CgroupHandle::~CgroupHandle()
+{
+    Reset();
+}
+
+CgroupHandle::CgroupHandle(CgroupHandle &&other)
+    : context(std::move(other.context)), dirfd(other.dirfd), pathId(other.pathId), controllers(other.controllers)
+{
+    other.dirfd = -1;
+}
+
+CgroupHandle& CgroupHandle::operator=(CgroupHandle &&other)
+{
+    if (this != &other) {
+        Reset();
+        context = std::move(other.context);
+        dirfd = other.dirfd;
+        pathId = other.pathId;
+        controllers = other.controllers;
+        other.dirfd = -1;
+    }
+    return *this;
+}
+
+void CgroupHandle::Reset()
+{
+    if (dirfd >= 0)
+        close(dirfd);
+    if (context)
+        context->ReleasePath(pathId);
+    dirfd = -1;
+    context.reset();
+}
+
+const std::string &CgroupHandle::GetPath() const
+{
+    static const std::string none;
+    return context ? context->GetPath(pathId) : none;
+}
+
+int CgroupHandle::OpenFile(const char *name, int flags) const
+{
+    return openat(dirfd, name, flags | O_CLOEXEC);
+}
+
+std::shared_ptr<const CgroupContext> CgroupContext::Get()
+{
+    static std::mutex lock;
+    static std::shared_ptr<const CgroupContext> context;
+
+    auto mounts = MountTable::Get();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!context || context->mounts != mounts)
+        context.reset(new CgroupContext(mounts));
+
+    return context;
+}
+
+CgroupContext::CgroupContext(const std::shared_ptr<const MountTableSnapshot> &mounts)
+    : mounts(mounts)
+{
+    std::fill(std::begin(hierarchy), std::end(hierarchy), -1);
+
+    /* same order as CgroupBackendFactory always used: the first cgroup
+       mount decides, a v2 "unified" mount next to v1 ones is ignored */
+    for (const auto &entry : *mounts)
+    {
+        if (entry.type == "cgroup" && !starts_with(entry.opts, "name=")) {
+            backendType = CGROUP_BACKEND_TYPE_V1;
+            break;
+        }
+
+        if (entry.type == "cgroup2" && !ends_with(entry.dir, "unified")) {
+            backendType = CGROUP_BACKEND_TYPE_V2;
+            break;
+        }
+    }
+
+    if (backendType == CGROUP_BACKEND_TYPE_V1)
+        DetectV1(*mounts);
+    else if (backendType == CGROUP_BACKEND_TYPE_V2)
+        DetectV2(*mounts);
+
+    for (const auto &dir : mountPoints)
+        rootFds.push_back(open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+
+    /* path id 0 is the root of the hierarchies, never released */
+    InternPath("");
+}
+
+CgroupContext::~CgroupContext()
+{
+    for (int fd : rootFds)
+        if (fd >= 0)
+            close(fd);
+}
+
+/* Lines of the mount table have the order of the mount operations and
+   bind mounts may repeat a hierarchy, the last mount of a controller wins */
+void CgroupContext::DetectV1(const MountTableSnapshot &mounts)
+{
+    for (const auto &entry : mounts)
+    {
+        if (entry.type != "cgroup")
+            continue;
+
+        unsigned int mounted = cgroupV1Controllers.FindAll(entry.opts, ',');
+
+        for (int i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
+        {
+            if (!(mounted & (1 << i)))
+                continue;
+
+            auto it = std::find(mountPoints.begin(), mountPoints.end(), entry.dir);
+            hierarchy[i] = it - mountPoints.begin();
+            if (it == mountPoints.end())
+                mountPoints.push_back(entry.dir);
+            controllers |= 1 << i;
+        }
+    }
+}
+
+/* Systemd mounts cgroup2 for process tracking only, without controllers */
+void CgroupContext::DetectV2(const MountTableSnapshot &mounts)
+{
+    for (const auto &entry : mounts)
+    {
+        if (entry.type != "cgroup2" || entry.controllers.empty() || ends_with(entry.dir, "unified"))
+            continue;
+
+        /* cpu.stat is always there */
+        controllers = 1 << CGROUP_CONTROLLER_CPUACCT | cgroupV2Controllers.FindAll(entry.controllers, ' ');
+
+        mountPoints.assign(1, entry.dir);
+        std::fill(std::begin(hierarchy), std::end(hierarchy), 0);
+    }
+}
+
+int CgroupContext::GetHierarchy(int controller) const
+{
+    if (controller == CGROUP_CONTROLLER_NONE) {
+        /* v1: any hierarchy, memory is the one tenants always have */
+        if (hierarchy[CGROUP_CONTROLLER_MEMORY] >= 0)
+            return hierarchy[CGROUP_CONTROLLER_MEMORY];
+        return mountPoints.empty() ? -1 : 0;
+    }
+
+    return hierarchy[controller];
+}
+
+const std::string &CgroupContext::GetMountPoint(int controller) const
+{
+    static const std::string none;
+    int index = GetHierarchy(controller);
+
+    return index < 0 ? none : mountPoints[index];
+}
+
+int CgroupContext::GetRootFd(int controller) const
+{
+    int index = GetHierarchy(controller);
+
+    return index < 0 ? -1 : rootFds[index];
+}
+
+CgroupHandle CgroupContext::Open(const std::string &path, unsigned int wanted) const
+{
+    std::string_view relative(path);
+    while (!relative.empty() && relative.front() == '/')
+        relative.remove_prefix(1);
+
+    unsigned int mask = wanted ? wanted & controllers : controllers;
+    int first = CGROUP_CONTROLLER_NONE;
+    if (backendType == CGROUP_BACKEND_TYPE_V1)
+        for (int i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST && !first; i++)
+            if (mask & (1 << i))
+                first = i;
+
+    int rootFd = GetRootFd(first);
+    int dirfd = rootFd < 0 ? -1 :
+        openat(rootFd, relative.empty() ? "." : std::string(relative).c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        throw CGroupFileNotFoundException("errno:" + std::to_string(rootFd < 0 ? ENOENT : errno) +
+                                          ", cannot open cgroup '" + path + "'");
+
+    /* interned once the group is known to exist, a failed open leaves no entry */
+    return CgroupHandle(shared_from_this(), dirfd, InternPath(relative), mask);
+}
+
+int CgroupContext::OpenFile(const CgroupHandle &handle, int controller, const char *name, int flags) const
+{
+    if (controller == CGROUP_CONTROLLER_NONE || backendType != CGROUP_BACKEND_TYPE_V1)
+        return handle.OpenFile(name, flags);
+
+    int rootFd = GetRootFd(controller);
+    if (rootFd < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    const std::string &path = GetPath(handle.GetPathId());
+    std::string file = path.empty() ? std::string(name) : path + "/" + name;
+    return openat(rootFd, file.c_str(), flags | O_CLOEXEC);
+}
+
+uint32_t CgroupContext::InternPath(std::string_view path) const
+{
+    std::lock_guard<std::mutex> guard(pathLock);
+
+    auto it = pathIds.find(path);
+    if (it != pathIds.end()) {
+        paths[it->second].refs++;
+        return it->second;
+    }
+
+    uint32_t id;
+    if (!freePathIds.empty()) {
+        id = freePathIds.back();
+        freePathIds.pop_back();
+        paths[id] = { std::string(path), 1 };
+    } else {
+        id = paths.size();
+        paths.push_back({ std::string(path), 1 });
+    }
+    pathIds.emplace(paths[id].path, id);
+    return id;
+}
+
+void CgroupContext::ReleasePath(uint32_t pathId) const
+{
+    std::lock_guard<std::mutex> guard(pathLock);
+
+    PathEntry &entry = paths[pathId];
+    if (--entry.refs > 0)
+        return;
+
+    pathIds.erase(entry.path);
+    std::string().swap(entry.path);
+    freePathIds.push_back(pathId);
+}
+
+const std::string &CgroupContext::GetPath(uint32_t pathId) const
+{
+    std::lock_guard<std::mutex> guard(pathLock);
+    return paths[pathId].path;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#ifndef __CGROUPCONTEXT_HH__
+#define __CGROUPCONTEXT_HH__
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "CgroupBackend.hh"
+#include "MountTable.hh"
+
+namespace mdsd {
+
+class CgroupContext;
+
+/*
+ * Handle on a cgroup directory: an O_PATH fd, the id of its relative path
+ * in the CgroupContext and the controllers it is used with.
+ *
+ * On v1 the fd is the directory in the first hierarchy of the mask, files
+ * of the other hierarchies are opened with CgroupContext::OpenFile(). The
+ * handle owns its fd and a reference on its path id, it can be moved but
+ * not copied.
+ */
+class CgroupHandle
+{
+public:
+    CgroupHandle() {}
+    CgroupHandle(const std::shared_ptr<const CgroupContext> &context, int dirfd, uint32_t pathId,
+                 uint32_t controllers)
+        : context(context), dirfd(dirfd), pathId(pathId), controllers(controllers) {}
+    ~CgroupHandle();
+
+    CgroupHandle(CgroupHandle &&other);
+    CgroupHandle& operator=(CgroupHandle &&other);
+    CgroupHandle(const CgroupHandle&) = delete;
+    CgroupHandle& operator=(const CgroupHandle&) = delete;
+
+    bool Valid() const { return dirfd >= 0; }
+    int GetDirFd() const { return dirfd; }
+    uint32_t GetPathId() const { return pathId; }
+    uint32_t GetControllers() const { return controllers; }
+    bool HasController(int controller) const { return controllers & (1 << controller); }
+    const std::string &GetPath() const;
+
+    /* Interface file of the group, returns -1 and sets errno on failure */
+    int OpenFile(const char *name, int flags) const;
+
+private:
+    void Reset();
+
+    std::shared_ptr<const CgroupContext> context;
+    int dirfd = -1;
+    uint32_t pathId = 0;
+    uint32_t controllers = 0;
+};
+
+/*
+ * What every cgroup of the process shares: the backend type, where each
+ * controller is mounted with an fd on the mount directory, and the
+ * relative paths of the groups opened as handles.
+ *
+ * Built once from the MountTable and never modified after, except for
+ * the path table: a path stays in it while a handle on it is alive and
+ * its id is reused once the last one is gone. Get() returns the same
+ * context until the mount table changes, backends and handles keep the
+ * one they were created with.
+ */
+class CgroupContext : public std::enable_shared_from_this<CgroupContext>
+{
+public:
+    ~CgroupContext();
+
+    CgroupContext(const CgroupContext&) = delete;
+    CgroupContext& operator=(const CgroupContext&) = delete;
+
+    static std::shared_ptr<const CgroupContext> Get();
+
+    CgroupBackendType GetBackendType() const { return backendType; }
+    /* true when the controller is mounted (v1) or listed in the root cgroup.controllers (v2) */
+    bool HasController(int controller) const { return controllers & (1 << controller); }
+    unsigned int GetControllers() const { return controllers; }
+
+    /* Mount directory of the hierarchy of the controller, the unified one on v2 */
+    const std::string &GetMountPoint(int controller = CGROUP_CONTROLLER_NONE) const;
+    int GetRootFd(int controller = CGROUP_CONTROLLER_NONE) const;
+
+    /* Opens the group at path, relative to the mount point. Throws
+       CGroupFileNotFoundException when it does not exist. */
+    CgroupHandle Open(const std::string &path, unsigned int controllers = CGROUP_CONTROLLER_NONE) const;
+    /* Interface file of the group in the hierarchy of controller */
+    int OpenFile(const CgroupHandle &handle, int controller, const char *name, int flags) const;
+
+    /* Takes a reference on the id of path, dropped with ReleasePath() */
+    uint32_t InternPath(std::string_view path) const;
+    void ReleasePath(uint32_t pathId) const;
+    /* Valid while a reference on pathId is held */
+    const std::string &GetPath(uint32_t pathId) const;
+
+private:
+    CgroupContext(const std::shared_ptr<const MountTableSnapshot> &mounts);
+
+    void DetectV1(const MountTableSnapshot &mounts);
+    void DetectV2(const MountTableSnapshot &mounts);
+    int GetHierarchy(int controller) const;
+
+    const std::shared_ptr<const MountTableSnapshot> mounts;
+    CgroupBackendType backendType = CGROUP_BACKEND_NONE;
+    unsigned int controllers = 0;
+
+    /* distinct mount points, co-mounted controllers (cpu,cpuacct) share one */
+    std::vector<std::string> mountPoints;
+    std::vector<int> rootFds;
+    int8_t hierarchy[CGROUP_CONTROLLER_LAST];   /* index in mountPoints, -1 when not mounted */
+
+    struct PathEntry {
+        std::string path;
+        unsigned int refs;
+    };
+    mutable std::mutex pathLock;
+    mutable std::deque<PathEntry> paths;        /* stable references */
+    mutable std::unordered_map<std::string_view, uint32_t> pathIds;
+    mutable std::vector<uint32_t> freePathIds;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPCONTEXT_HH__
@@ -6,34 +6,51 @@
 #include <sstream>
 #include <cstring>
 #include <string>
-#include <sstream>
+#include <climits>
+
+#include "CgroupLog.hh"
 
 #define CGROUP_MAX_VAL 512
+#define CGROUP_NUM_BUF_LEN 64 /* enough for any numeric interface file, e.g. cpu.max */
 #define CGROUP_MEM_MB_TO_BYTES(val) val * 1024 * 1024
 #define CGROUP_MEM_MB_TO_KB(val) val * 1024
 #define CGROUP_MEM_KB_TO_MB(val) double(val) / 1024
 #define CGROUP_MEM_KB_TO_BYTES(val) val * 1024
 #define CGROUP_MEMORY_PARAM_UNLIMITED 9007199254740991LL /* = INT64_MAX >> 10 */
+#define CGROUP_PARAM_MAX ULLONG_MAX /* value reported for the "max" keyword */
+#define CGROUP_CPU_QUOTA_UNLIMITED (long long)(ULLONG_MAX / 1000) /* GetCpuCfsQuota() of "max" on v2 */
+#define CGROUP_CPU_SHARES_DEFAULT ULLONG_MAX /* LimitSet cpuShares of the kernel default, see GetDefaultCpuShares() */
+#define CGROUP_FREEZE_TIMEOUT_MS 100 /* TryKill() signals anyway when freezing takes longer */
+#define CGROUP_KILL_ROUNDS 8 /* signal passes of TryKill() when the group could not be frozen */
+
+#ifndef CGROUP_LOG_LEVEL
+# define CGROUP_LOG_LEVEL CGROUP_LOG_LEVEL_DEBUG
+#endif
 
-#ifndef LOGGER_LINE_INFO
-# define LOGGER_LINE_INFO(line_str) \
-	do { \
-		std::ostringstream __msg; \
-		__msg << line_str; \
-		std::cout << __msg.str() << std::endl;\
-	} while (0)
+/* The host logger when it defines LOGGER_LINE_*, CgroupLog otherwise */
+#ifdef LOGGER_LINE_INFO
+# define CGROUP_LOG_DEBUG_LINE(log) LOGGER_LINE_INFO("[CGROUP] " << log)
+#else
+# define CGROUP_LOG_DEBUG_LINE(log) CGROUP_LOG_ASYNC(CGROUP_LOG_LEVEL_DEBUG, log)
 #endif
 
-#ifndef LOGGER_LINE_ERROR
-# define LOGGER_LINE_ERROR(line_str) \
-	do { \
-		std::ostringstream __msg; \
-		__msg << line_str; \
-		std::cout << __msg.str() << std::endl;\
-	} while (0)
+#ifdef LOGGER_LINE_ERROR
+# define CGROUP_LOG_ERROR_LINE(error) LOGGER_LINE_ERROR("[CGROUP] " << error)
+#else
+# define CGROUP_LOG_ERROR_LINE(error) CGROUP_LOG_ASYNC(CGROUP_LOG_LEVEL_ERROR, error)
 #endif
 
-#define CGROUP_DEBUG(log) LOGGER_LINE_INFO("[CGROUP] " << log)
-#define CGROUP_ERROR(error) LOGGER_LINE_ERROR("[CGROUP] " << error)
+/* Levels below CGROUP_LOG_LEVEL are compiled out, arguments are not evaluated */
+#if CGROUP_LOG_LEVEL <= CGROUP_LOG_LEVEL_DEBUG
+# define CGROUP_DEBUG(log) CGROUP_LOG_DEBUG_LINE(log)
+#else
+# define CGROUP_DEBUG(log) do { } while (0)
+#endif
+
+#if CGROUP_LOG_LEVEL <= CGROUP_LOG_LEVEL_ERROR
+# define CGROUP_ERROR(error) CGROUP_LOG_ERROR_LINE(error)
+#else
+# define CGROUP_ERROR(error) do { } while (0)
+#endif
 #endif // __CGROUP_DEF_HH__
 
@@ -0,0 +1,277 @@
+#include "CgroupEventWatcher.hh"
+
+#include <unistd.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+using namespace mdsd;
+
+#define CGROUP_EVENT_MAX_EVENTS 64
+#define CGROUP_EVENT_INOTIFY_BUF_LEN 4096
+
+CgroupEventWatcher::CgroupEventWatcher()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot create epoll instance");
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        int err = errno;
+        close(epollFd);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot create inotify instance");
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = inotifyFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &event);
+}
+
+CgroupEventWatcher::~CgroupEventWatcher()
+{
+    for (auto &target : targets)
+        for (auto &file : target.second.files)
+            CloseFile(file, target.first);
+
+    close(inotifyFd);
+    close(epollFd);
+}
+
+int CgroupEventWatcher::Watch(Cgroup &cgroup, unsigned long long cookie)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int id = nextCgroup++;
+    Target &target = targets[id];
+    CgroupBackend &backend = *cgroup.backend;
+
+    target.backend = cgroup.backend;
+    target.cookie = cookie;
+
+    /* a controller that is not enabled simply has no events file */
+    for (const auto &eventFile : backend.GetEventFiles())
+    {
+        File file = { eventFile.fileType, -1, -1, -1 };
+        std::string path;
+
+        try {
+            path = backend.GetPathOfController(eventFile.controller, backend.GetControllerFileName(eventFile.fileType));
+        } catch (const CGroupBaseException &e) {
+            continue;
+        }
+
+        file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file.fd < 0)
+            continue;
+
+        try {
+            if (eventFile.eventControl) {
+                file.eventFd = backend.OpenEventControl(eventFile.controller, eventFile.fileType);
+
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.fd = file.eventFd;
+                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, file.eventFd, &event) < 0)
+                    throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot watch '" + path + "'");
+                byEventFd[file.eventFd] = { id, target.files.size() };
+            } else {
+                file.watch = inotify_add_watch(inotifyFd, path.c_str(), IN_MODIFY);
+                if (file.watch < 0)
+                    throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot watch '" + path + "'");
+                byWatch[file.watch].push_back({ id, target.files.size() });
+            }
+        } catch (const CGroupBaseException &e) {
+            CGROUP_ERROR(e.what());
+            CloseFile(file, id);
+            continue;
+        }
+
+        target.files.push_back(file);
+    }
+
+    /* baseline, nothing is reported for it */
+    for (size_t i = 0; i < target.files.size(); i++)
+        Refresh({ id, i }, false);
+
+    CGROUP_DEBUG("Watching " << target.files.size() << " event files of '"
+                 << backend.GetRelativeBasePath() << "' (id=" << id << ")");
+    return id;
+}
+
+void CgroupEventWatcher::CloseFile(File &file, int cgroup)
+{
+    if (file.watch >= 0) {
+        auto it = byWatch.find(file.watch);
+        if (it != byWatch.end()) {
+            auto &refs = it->second;
+            refs.erase(std::remove_if(refs.begin(), refs.end(),
+                                      [cgroup](const FileRef &ref) { return ref.cgroup == cgroup; }),
+                       refs.end());
+            if (refs.empty()) {
+                inotify_rm_watch(inotifyFd, file.watch);
+                byWatch.erase(it);
+            }
+        }
+    }
+
+    if (file.eventFd >= 0) {
+        byEventFd.erase(file.eventFd);
+        close(file.eventFd);
+    }
+
+    if (file.fd >= 0)
+        close(file.fd);
+
+    file.fd = file.watch = file.eventFd = -1;
+}
+
+void CgroupEventWatcher::Unwatch(int cgroup)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = targets.find(cgroup);
+    if (it == targets.end())
+        return;
+
+    for (auto &file : it->second.files)
+        CloseFile(file, cgroup);
+    targets.erase(it);
+}
+
+int CgroupEventWatcher::Subscribe(unsigned int mask, const CgroupEventCallback &callback)
+{
+    int id = nextSubscription++;
+    subscribers[id] = { mask, callback };
+    return id;
+}
+
+void CgroupEventWatcher::Unsubscribe(int subscription)
+{
+    subscribers.erase(subscription);
+}
+
+const CgroupEventCounters &CgroupEventWatcher::GetCounters(int cgroup) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = targets.find(cgroup);
+    if (it == targets.end())
+        throw CGroupBaseException("Unknown watched cgroup id " + std::to_string(cgroup));
+
+    return it->second.counters;
+}
+
+void CgroupEventWatcher::Refresh(const FileRef &ref, bool report)
+{
+    auto it = targets.find(ref.cgroup);
+    if (it == targets.end())
+        return;
+
+    Target &target = it->second;
+    File &file = target.files[ref.file];
+    if (file.fd < 0 || target.counters.values[CGROUP_EVENT_REMOVED])
+        return;
+
+    CgroupEventCounters counters = target.counters;
+    char buf[CGROUP_MAX_VAL];
+    ssize_t n = pread(file.fd, buf, sizeof(buf), 0);
+
+    if (n >= 0) {
+        target.backend->ParseEventFile(file.fileType, buf, n, counters);
+    } else if (errno == ENODEV || errno == ENOENT) {
+        counters.values[CGROUP_EVENT_REMOVED] = 1;
+    } else {
+        CGROUP_ERROR("errno:" << errno << ", cannot read " << target.backend->GetControllerFileName(file.fileType)
+                     << " of '" << target.backend->GetRelativeBasePath() << "'");
+        return;
+    }
+
+    for (int type = 0; type < CGROUP_EVENT_LAST && report; type++)
+        if (counters.values[type] != target.counters.values[type])
+            pending.push_back({ ref.cgroup, target.cookie, (CgroupEventType)type,
+                                target.counters.values[type], counters.values[type] });
+
+    target.counters = counters;
+}
+
+/* Subscribers run once all notifications are processed, so they may
+   unwatch cgroups or unsubscribe */
+void CgroupEventWatcher::Deliver(const std::vector<CgroupEvent> &events)
+{
+    for (const auto &event : events)
+    {
+        for (auto it = subscribers.begin(); it != subscribers.end(); )
+        {
+            auto &subscriber = (it++)->second;
+            if (subscriber.mask & CGROUP_EVENT_MASK(event.type))
+                subscriber.callback(event);
+        }
+    }
+}
+
+int CgroupEventWatcher::Dispatch(int timeoutMs)
+{
+    struct epoll_event events[CGROUP_EVENT_MAX_EVENTS];
+
+    int n = epoll_wait(epollFd, events, CGROUP_EVENT_MAX_EVENTS, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", epoll_wait failed");
+    }
+
+    std::unique_lock<std::mutex> lk(lock);
+    for (int i = 0; i < n; i++)
+    {
+        int fd = events[i].data.fd;
+
+        if (fd != inotifyFd) {
+            auto it = byEventFd.find(fd);
+            if (it == byEventFd.end())
+                continue;
+
+            uint64_t count;
+            if (read(fd, &count, sizeof(count)) == sizeof(count))
+                Refresh(it->second);
+            continue;
+        }
+
+        alignas(struct inotify_event) char buf[CGROUP_EVENT_INOTIFY_BUF_LEN];
+        ssize_t len;
+        while ((len = read(inotifyFd, buf, sizeof(buf))) > 0)
+        {
+            for (char *cur = buf; cur < buf + len; )
+            {
+                auto *event = (struct inotify_event *)cur;
+                cur += sizeof(struct inotify_event) + event->len;
+
+                auto it = byWatch.find(event->wd);
+                if (it == byWatch.end())
+                    continue;
+
+                /* copy, Refresh() does not touch byWatch but IN_IGNORED below does */
+                auto refs = it->second;
+                if (event->mask & IN_IGNORED) {
+                    /* the kernel dropped the watch, the file is gone */
+                    byWatch.erase(it);
+                    for (const auto &ref : refs) {
+                        auto target = targets.find(ref.cgroup);
+                        if (target != targets.end())
+                            target->second.files[ref.file].watch = -1;
+                    }
+                }
+
+                for (const auto &ref : refs)
+                    Refresh(ref);
+            }
+        }
+    }
+
+    std::vector<CgroupEvent> changes;
+    changes.swap(pending);
+    lk.unlock();
+
+    Deliver(changes);
+    return changes.size();
+}
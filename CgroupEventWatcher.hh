@@ -0,0 +1,137 @@
+#pragma once
+#ifndef __CGROUPEVENTWATCHER_HH__
+#define __CGROUPEVENTWATCHER_HH__
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Cgroup.hh"
+#include "CgroupStat.hh"
+
+namespace mdsd {
+
+/* this should match the enum CgroupEventType */
+inline constexpr const char *cgroupEventNames[] = {
+    "memory.low", "memory.high", "memory.max", "memory.oom", "memory.oom_kill", "memory.oom_group_kill",
+    "swap.high", "swap.max", "swap.fail",
+    "pids.max",
+    "populated", "frozen", "under_oom", "removed",
+};
+static_assert(sizeof(cgroupEventNames) / sizeof(cgroupEventNames[0]) == CGROUP_EVENT_LAST,
+              "cgroupEventNames does not match the CgroupEventType enum");
+
+constexpr const char *CgroupEventName(int type)
+{
+    return type >= 0 && type < CGROUP_EVENT_LAST ? cgroupEventNames[type] : "";
+}
+
+/* A change of one counter or state, e.g. oom_kill 3 -> 4 or populated 1 -> 0 */
+struct CgroupEvent {
+    int cgroup;                 /* id returned by Watch() */
+    unsigned long long cookie;
+    CgroupEventType type;
+    unsigned long long oldValue;
+    unsigned long long newValue;
+};
+
+typedef std::function<void(const CgroupEvent &event)> CgroupEventCallback;
+
+#define CGROUP_EVENT_MASK(type) (1u << (type))
+#define CGROUP_EVENT_MASK_ALL ((1u << CGROUP_EVENT_LAST) - 1)
+
+/*
+ * Watches the *.events files (memory.events, memory.swap.events,
+ * pids.events and cgroup.events on v2, memory.oom_control on v1) of many
+ * cgroups and turns their changes into typed events.
+ *
+ * The kernel raises an inotify IN_MODIFY on an events file whenever one of
+ * its values changes, v1 OOMs are notified through an eventfd registered
+ * with cgroup.event_control. All of them are multiplexed over one epoll
+ * fd, so an idle watcher costs nothing. Only the file that changed is
+ * re-read and compared to the last known values.
+ *
+ * A cgroup whose files can no longer be read gets a CGROUP_EVENT_REMOVED
+ * event and stays silent until unwatched.
+ *
+ * Watch() and Unwatch() may be called from any thread, e.g. when tenants
+ * are added or removed while another thread dispatches. The other methods
+ * belong to the dispatching thread. Subscribers are called without the
+ * lock held, so they may watch and unwatch cgroups.
+ */
+class CgroupEventWatcher
+{
+public:
+    CgroupEventWatcher();
+    ~CgroupEventWatcher();
+
+    CgroupEventWatcher(const CgroupEventWatcher&) = delete;
+    CgroupEventWatcher& operator=(const CgroupEventWatcher&) = delete;
+
+    /* The values at the time of the call are the baseline, returns the cgroup id */
+    int Watch(Cgroup &cgroup, unsigned long long cookie = 0);
+    void Unwatch(int cgroup);
+
+    /* mask is a set of CGROUP_EVENT_MASK() bits, returns the subscription id */
+    int Subscribe(unsigned int mask, const CgroupEventCallback &callback);
+    void Unsubscribe(int subscription);
+
+    const CgroupEventCounters &GetCounters(int cgroup) const;
+
+    int GetFd() const { return epollFd; }
+
+    /* Wait up to timeoutMs (-1 forever) for changes and deliver them to the
+       subscribers, returns the number of events delivered */
+    int Dispatch(int timeoutMs);
+
+private:
+    struct File {
+        int fileType;
+        int fd;         /* the events file itself, read with pread() */
+        int watch;      /* inotify watch descriptor or -1 */
+        int eventFd;    /* cgroup.event_control eventfd or -1 */
+    };
+
+    struct Target {
+        std::shared_ptr<CgroupBackend> backend;
+        unsigned long long cookie;
+        CgroupEventCounters counters;
+        std::vector<File> files;
+    };
+
+    struct FileRef {
+        int cgroup;
+        size_t file;
+    };
+
+    struct Subscriber {
+        unsigned int mask;
+        CgroupEventCallback callback;
+    };
+
+    void CloseFile(File &file, int cgroup);
+    /* report is false for the baseline read of Watch() */
+    void Refresh(const FileRef &ref, bool report = true);
+    void Deliver(const std::vector<CgroupEvent> &events);
+
+    int epollFd;
+    int inotifyFd;
+    int nextCgroup = 0;
+    int nextSubscription = 0;
+
+    std::unordered_map<int, Target> targets;
+    /* several targets may watch the same inode, inotify hands out one wd */
+    std::unordered_map<int, std::vector<FileRef>> byWatch;
+    std::unordered_map<int, FileRef> byEventFd;
+    std::map<int, Subscriber> subscribers;
+    std::vector<CgroupEvent> pending;
+    /* targets and the fd maps, against Watch() and Unwatch() */
+    mutable std::mutex lock;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPEVENTWATCHER_HH__
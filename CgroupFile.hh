@@ -0,0 +1,215 @@
+#pragma once
+#ifndef __CGROUPFILE_HH__
+#define __CGROUPFILE_HH__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <charconv>
+#include <string_view>
+
+#include "CgroupBackend.hh"
+
+namespace mdsd {
+
+/* FNV-1a with a seed folded into the offset basis */
+constexpr uint32_t CgroupNameHash(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : name)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    return hash;
+}
+
+/*
+ * Perfect hash of a fixed list of names, indexed like the list.
+ *
+ * The seed is searched at compile time until no two names share a slot,
+ * so Find() hashes once and compares against a single candidate. Empty
+ * names (e.g. the CGROUP_CONTROLLER_NONE entry) are never found.
+ */
+template <size_t N, size_t Slots = 32>
+class CgroupNameIndex
+{
+public:
+    static_assert(N < Slots && Slots < 128, "too many names for the slot table");
+
+    constexpr CgroupNameIndex(const char *const (&list)[N]) : names(), slots(), seed(0)
+    {
+        for (size_t i = 0; i < N; i++)
+            names[i] = list[i];
+        while (!Fill())
+            seed++;
+    }
+
+    /* Index of name, -1 when it is not in the list */
+    constexpr int Find(std::string_view name) const
+    {
+        int index = slots[CgroupNameHash(name, seed) % Slots];
+        return index >= 0 && name == names[index] ? index : -1;
+    }
+
+    constexpr const char *Name(int index) const { return names[index]; }
+
+    /* Bit mask (1 << index) of the names found in a list such as
+       "cpu io memory" or "rw,nosuid,cpu,cpuacct", unknown names are skipped */
+    constexpr unsigned int FindAll(std::string_view list, char separator) const
+    {
+        unsigned int mask = 0;
+        while (!list.empty()) {
+            size_t end = 0;
+            while (end < list.size() && list[end] != separator && list[end] != '\n')
+                end++;
+
+            int index = Find(list.substr(0, end));
+            if (index >= 0)
+                mask |= 1u << index;
+
+            list.remove_prefix(end < list.size() ? end + 1 : end);
+        }
+        return mask;
+    }
+
+private:
+    constexpr bool Fill()
+    {
+        for (size_t s = 0; s < Slots; s++)
+            slots[s] = -1;
+
+        for (size_t i = 0; i < N; i++) {
+            if (names[i][0] == '\0')
+                continue;
+            size_t s = CgroupNameHash(names[i], seed) % Slots;
+            if (slots[s] >= 0)
+                return false;
+            slots[s] = i;
+        }
+        return true;
+    }
+
+    const char *names[N];
+    int8_t slots[Slots];
+    uint32_t seed;
+};
+
+/* these should match the enum CgroupController */
+inline constexpr const char *cgroupV1ControllerNames[CGROUP_CONTROLLER_LAST] = {
+    "", "cpu", "cpuacct", "cpuset", "memory", "devices",
+    "freezer", "blkio", "net_cls", "pids", "rdma", "perf_event", "name=systemd"
+};
+inline constexpr const char *cgroupV2ControllerNames[CGROUP_CONTROLLER_LAST] = {
+    "", "cpu", "cpuacct", "cpuset", "memory", "devices",
+    "freezer", "io", "net_cls", "pids", "rdma", "perf_event", "name=systemd"
+};
+
+inline constexpr CgroupNameIndex<CGROUP_CONTROLLER_LAST> cgroupV1Controllers(cgroupV1ControllerNames);
+inline constexpr CgroupNameIndex<CGROUP_CONTROLLER_LAST> cgroupV2Controllers(cgroupV2ControllerNames);
+
+static_assert(cgroupV1Controllers.Find("memory") == CGROUP_CONTROLLER_MEMORY &&
+              cgroupV2Controllers.Find("io") == CGROUP_CONTROLLER_BLKIO &&
+              cgroupV1Controllers.Find("io") < 0, "controller name index");
+
+/*
+ * Value codecs of interface files. Parse() gets the raw file content and
+ * returns false on garbage, Format() returns the length written into a
+ * buffer of BufSize bytes.
+ */
+struct CgroupU64Codec
+{
+    typedef unsigned long long Value;
+    static constexpr size_t BufSize = CGROUP_NUM_BUF_LEN;
+
+    /* "max" is read as CGROUP_PARAM_MAX */
+    static bool Parse(const char *buf, size_t len, Value &value)
+    {
+        return CgroupBackend::ParseValueU64(buf, buf + len, value);
+    }
+
+    /* CGROUP_PARAM_MAX is written as "max" on v2 and as -1 on v1 */
+    static size_t Format(Value value, CgroupBackendType type, char *buf)
+    {
+        if (value == CGROUP_PARAM_MAX) {
+            const char *max = type == CGROUP_BACKEND_TYPE_V2 ? "max" : "-1";
+            size_t len = strlen(max);
+            memcpy(buf, max, len);
+            return len;
+        }
+        return std::to_chars(buf, buf + BufSize, value).ptr - buf;
+    }
+};
+
+struct CgroupI64Codec
+{
+    typedef long long Value;
+    static constexpr size_t BufSize = CGROUP_NUM_BUF_LEN;
+
+    /* "max" is read as LLONG_MAX */
+    static bool Parse(const char *buf, size_t len, Value &value)
+    {
+        return CgroupBackend::ParseValueI64(buf, buf + len, value);
+    }
+
+    static size_t Format(Value value, CgroupBackendType, char *buf)
+    {
+        return std::to_chars(buf, buf + BufSize, value).ptr - buf;
+    }
+};
+
+/* Space separated controller names of cgroup.controllers and
+   cgroup.subtree_control as a CgroupController bit mask (v2 only) */
+struct CgroupControllersCodec
+{
+    typedef unsigned int Value;
+    static constexpr size_t BufSize = CGROUP_MAX_VAL;
+
+    static bool Parse(const char *buf, size_t len, Value &value)
+    {
+        value = cgroupV2Controllers.FindAll(std::string_view(buf, len), ' ');
+        return true;
+    }
+
+    /* "+name" for every controller of the mask, i.e. enable them */
+    static size_t Format(Value mask, CgroupBackendType, char *buf)
+    {
+        size_t len = 0;
+        for (int i = CGROUP_CONTROLLER_CPU; i < CGROUP_CONTROLLER_LAST; i++)
+            if (mask & (1u << i) && len < BufSize)
+                len += snprintf(buf + len, BufSize - len, len ? " +%s" : "+%s", cgroupV2Controllers.Name(i));
+        return len < BufSize ? len : BufSize - 1;
+    }
+};
+
+/*
+ * An interface file known at compile time: its CgroupControllerFile type
+ * (the name comes from the FileNames table of the backend), the controller
+ * whose hierarchy it lives in and the codec of its value. Read and written
+ * with BasicCgroup<Backend>::Read<File>() and Write<File>(), or their Try
+ * variants.
+ */
+template <int FileType, int ControllerType, typename Codec>
+struct CgroupFile : Codec
+{
+    static constexpr int Type = FileType;
+    static constexpr int Controller = ControllerType;
+};
+
+namespace CgroupFiles {
+
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CPU_SHARES, CGROUP_CONTROLLER_CPU, CgroupU64Codec> CpuShares;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CPU_CFS_PERIOD, CGROUP_CONTROLLER_CPU, CgroupU64Codec> CpuCfsPeriod;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_MEMORY_USAGE, CGROUP_CONTROLLER_MEMORY, CgroupU64Codec> MemoryCurrent;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_MEMORY_HARD_LIMIT, CGROUP_CONTROLLER_MEMORY, CgroupU64Codec> MemoryMax;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_MEMORY_SOFT_LIMIT, CGROUP_CONTROLLER_MEMORY, CgroupU64Codec> MemoryHigh;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_MEMORY_SWAP_USAGE, CGROUP_CONTROLLER_MEMORY, CgroupU64Codec> MemorySwapCurrent;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_MEMORY_SWAP_HARD_LIMIT, CGROUP_CONTROLLER_MEMORY, CgroupU64Codec> MemorySwapMax;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_PIDS_CURRENT, CGROUP_CONTROLLER_PIDS, CgroupU64Codec> PidsCurrent;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CGROUP_PROCS, CGROUP_CONTROLLER_NONE, CgroupI64Codec> CgroupProcs;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CGROUP_THREADS, CGROUP_CONTROLLER_NONE, CgroupI64Codec> CgroupThreads;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CGROUP_CONTROLLERS, CGROUP_CONTROLLER_NONE, CgroupControllersCodec> CgroupControllers;
+typedef CgroupFile<CGROUP_CONTROLLER_FILE_CGROUP_SUBTREE_CONTROL, CGROUP_CONTROLLER_NONE, CgroupControllersCodec> CgroupSubtreeControl;
+
+} // namespace CgroupFiles
+
+} // namespace mdsd
+
+#endif // __CGROUPFILE_HH__
@@ -0,0 +1,161 @@
+#include "CgroupFileCache.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+using namespace mdsd;
+
+CgroupFileCache::CgroupFileCache()
+{
+    for (auto &fds : fileFds)
+        for (auto &fd : fds)
+            fd = -1;
+}
+
+CgroupFileCache::~CgroupFileCache()
+{
+    Clear();
+}
+
+CgroupFileCache::FdMap &CgroupFileCache::GetMap(int controller, int flags)
+{
+    if (!named)
+        named.reset(new NamedFds());
+
+    return IsWrite(flags) ? named->writeFds[controller] : named->readFds[controller];
+}
+
+const CgroupFileCache::FdMap *CgroupFileCache::FindMap(int controller, int flags) const
+{
+    if (!named)
+        return NULL;
+
+    auto &fds = IsWrite(flags) ? named->writeFds : named->readFds;
+    auto it = fds.find(controller);
+    if (it == fds.end())
+        return NULL;
+
+    return &it->second;
+}
+
+int CgroupFileCache::Lookup(int controller, const std::string &key, int flags) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto map = FindMap(controller, flags);
+    if (!map)
+        return -1;
+
+    auto it = map->find(key);
+    if (it == map->end())
+        return -1;
+
+    return it->second;
+}
+
+int CgroupFileCache::Open(int controller, const std::string &key, int flags, const std::string &path)
+{
+    int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    /* another thread may have opened it meanwhile, keep the fd it uses */
+    std::lock_guard<std::mutex> guard(lock);
+    auto &map = GetMap(controller, flags);
+    auto it = map.find(key);
+    if (it != map.end()) {
+        close(fd);
+        return it->second;
+    }
+
+    map.emplace(key, fd);
+    return fd;
+}
+
+void CgroupFileCache::Invalidate(int controller, const std::string &key, int flags)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!named)
+        return;
+
+    auto &map = GetMap(controller, flags);
+    auto it = map.find(key);
+    if (it == map.end())
+        return;
+
+    Retire(it->second);
+    map.erase(it);
+    CloseRetired();
+}
+
+void CgroupFileCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (named) {
+        for (auto fds : { &named->readFds, &named->writeFds })
+            for (auto &controller : *fds)
+                for (auto &entry : controller.second)
+                    Retire(entry.second);
+        named.reset();
+    }
+    for (auto &fds : fileFds)
+        for (auto &slot : fds) {
+            int fd = slot.exchange(-1);
+            if (fd >= 0)
+                Retire(fd);
+        }
+    CloseRetired();
+}
+
+int CgroupFileCache::OpenFile(int fileType, int flags, const std::string &path)
+{
+    int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    int cached = -1;
+    if (fileFds[IsWrite(flags)][fileType].compare_exchange_strong(cached, fd))
+        return fd;
+
+    close(fd);
+    return cached;
+}
+
+/* A Use taken before the exchange sees the old fd, which is then retired
+   while users is not 0 */
+void CgroupFileCache::InvalidateFile(int fileType, int flags)
+{
+    int fd = fileFds[IsWrite(flags)][fileType].exchange(-1);
+    if (fd < 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    Retire(fd);
+    CloseRetired();
+}
+
+void CgroupFileCache::Retire(int fd)
+{
+    retired.push_back(fd);
+    hasRetired = true;
+}
+
+/* A Use taken after the entries were forgotten cannot see the retired fds */
+void CgroupFileCache::CloseRetired()
+{
+    if (users != 0)
+        return;
+
+    for (int fd : retired)
+        close(fd);
+    retired.clear();
+    hasRetired = false;
+}
+
+void CgroupFileCache::Release()
+{
+    if (--users == 0 && hasRetired) {
+        std::lock_guard<std::mutex> guard(lock);
+        CloseRetired();
+    }
+}
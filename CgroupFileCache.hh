@@ -0,0 +1,111 @@
+#pragma once
+#ifndef __CGROUPFILECACHE_HH__
+#define __CGROUPFILECACHE_HH__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/types.h>
+
+namespace mdsd {
+
+#define CGROUP_FILE_CACHE_SLOTS 32 /* at least CGROUP_CONTROLLER_FILE_LAST */
+
+/*
+ * Cache of open file descriptors on cgroup interface files, keyed by
+ * (controller, interface file). Reads are done with pread() at offset 0
+ * and writes with a single pwrite(), so a cached fd can be reused forever
+ * as long as the cgroup directory it lives in is not removed.
+ *
+ * Read and write descriptors are kept apart since several interface files
+ * are read-only (memory.current, cgroup.controllers) or write-only.
+ *
+ * Files known by their CgroupControllerFile type (see BasicCgroup) are
+ * kept in a table indexed by type instead of the maps, so looking them up
+ * is a single load. Files reached by name and by type are cached apart,
+ * the maps are only allocated once a file is opened by name as there is
+ * a cache per cgroup.
+ *
+ * Several threads may use the same cache, e.g. the sampler and the event
+ * watcher. An fd is only used while a Use of the cache is alive:
+ * Invalidate() and Clear() forget the fds right away but close them once
+ * the last Use is gone, so an fd is never closed (and its number reused)
+ * under a reader.
+ */
+class CgroupFileCache
+{
+public:
+    /* Keeps the fds of the cache open, taken around every access */
+    class Use
+    {
+    public:
+        explicit Use(CgroupFileCache &cache) : cache(&cache) { cache.users++; }
+        Use(Use &&other) noexcept : cache(other.cache) { other.cache = nullptr; }
+        ~Use() { if (cache) cache->Release(); }
+
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+
+    private:
+        CgroupFileCache *cache;
+    };
+
+    CgroupFileCache();
+    ~CgroupFileCache();
+
+    CgroupFileCache(const CgroupFileCache&) = delete;
+    CgroupFileCache& operator=(const CgroupFileCache&) = delete;
+
+    /* Returns the cached fd or -1 if (controller, key) was never opened */
+    int Lookup(int controller, const std::string &key, int flags) const;
+
+    /* Opens path and caches it, returns -1 and sets errno on failure. If
+       the entry was opened meanwhile the existing fd is returned. */
+    int Open(int controller, const std::string &key, int flags, const std::string &path);
+
+    /* Forget a single entry, e.g. after the kernel returned ENODEV */
+    void Invalidate(int controller, const std::string &key, int flags);
+
+    /* Forget all entries */
+    void Clear();
+
+    /* Same as above for a file known by type, a type is always opened in
+       the hierarchy of the same controller */
+    int LookupFile(int fileType, int flags) const { return fileFds[IsWrite(flags)][fileType]; }
+    int OpenFile(int fileType, int flags, const std::string &path);
+    void InvalidateFile(int fileType, int flags);
+
+private:
+    typedef std::unordered_map<std::string, int> FdMap;
+    /* one map per controller so lookups never build a composite key */
+    struct NamedFds {
+        std::unordered_map<int, FdMap> readFds;
+        std::unordered_map<int, FdMap> writeFds;
+    };
+    static int IsWrite(int flags) { return (flags & O_ACCMODE) != O_RDONLY; }
+    /* with lock held */
+    FdMap &GetMap(int controller, int flags);
+    const FdMap *FindMap(int controller, int flags) const;
+    void Retire(int fd);
+    void CloseRetired();
+    void Release();
+
+    std::unique_ptr<NamedFds> named;
+    mutable std::mutex lock;
+
+    /* read and write fds by CgroupControllerFile type, -1 when not open */
+    std::atomic<int> fileFds[2][CGROUP_FILE_CACHE_SLOTS];
+
+    /* fds forgotten while a Use was alive, closed by the last one */
+    std::atomic<unsigned int> users{0};
+    std::atomic<bool> hasRetired{false};
+    std::vector<int> retired;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPFILECACHE_HH__
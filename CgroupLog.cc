@@ -0,0 +1,318 @@
+#include "CgroupLog.hh"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace mdsd;
+
+namespace {
+
+/* Single producer, single consumer byte ring of length prefixed records */
+class CgroupLogRing
+{
+public:
+    static constexpr size_t Size = 64 * 1024; /* power of 2 */
+
+    /* Producer side, false when there is no room */
+    bool Push(const unsigned char *record, size_t len)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        uint16_t n = len;
+
+        if (Size - (h - t) < sizeof(n) + len)
+            return false;
+
+        Copy(h, &n, sizeof(n));
+        Copy(h + sizeof(n), record, len);
+        head.store(h + sizeof(n) + len, std::memory_order_release);
+        return true;
+    }
+
+    /* Producer side, a ring more than half full should be drained soon */
+    bool Filling() const
+    {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed) > Size / 2;
+    }
+
+    /* Consumer side, calls fn(record, len) for every queued record */
+    template <typename Fn>
+    size_t Drain(Fn fn)
+    {
+        unsigned char record[CgroupLogRecord::MaxSize];
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        size_t count = 0;
+
+        while (t != h) {
+            uint16_t n;
+            Read(t, &n, sizeof(n));
+            Read(t + sizeof(n), record, n);
+            fn(record, n);
+            t += sizeof(n) + n;
+            count++;
+        }
+
+        tail.store(t, std::memory_order_release);
+        return count;
+    }
+
+    /* set by the owning thread when it exits */
+    std::atomic<bool> closed{false};
+
+private:
+    void Copy(uint64_t pos, const void *src, size_t len)
+    {
+        size_t offset = pos & (Size - 1);
+        size_t first = std::min(len, Size - offset);
+        memcpy(data + offset, src, first);
+        memcpy(data, static_cast<const unsigned char *>(src) + first, len - first);
+    }
+
+    void Read(uint64_t pos, void *dst, size_t len) const
+    {
+        size_t offset = pos & (Size - 1);
+        size_t first = std::min(len, Size - offset);
+        memcpy(dst, data + offset, first);
+        memcpy(static_cast<unsigned char *>(dst) + first, data, len - first);
+    }
+
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    unsigned char data[Size];
+};
+
+class CgroupLogger
+{
+public:
+    static CgroupLogger &Get()
+    {
+        static CgroupLogger logger;
+        return logger;
+    }
+
+    /* false once the logger was destroyed at exit */
+    static bool Running() { return running.load(std::memory_order_acquire); }
+
+    std::shared_ptr<CgroupLogRing> Register()
+    {
+        auto ring = std::make_shared<CgroupLogRing>();
+        std::lock_guard<std::mutex> guard(ringsLock);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void Wake() { wakeCond.notify_one(); }
+
+    /* Consumer side of all rings, one caller at a time */
+    void Drain()
+    {
+        std::lock_guard<std::mutex> drainGuard(drainLock);
+        std::vector<std::shared_ptr<CgroupLogRing>> current;
+        {
+            std::lock_guard<std::mutex> guard(ringsLock);
+            current = rings;
+        }
+
+        /* closed is read before the last drain of a ring, nothing follows it */
+        std::vector<CgroupLogRing *> done;
+        for (const auto &ring : current) {
+            if (ring->closed.load(std::memory_order_acquire))
+                done.push_back(ring.get());
+            ring->Drain([this](const unsigned char *record, size_t len) {
+                CgroupLogRecord::Format(record, len, text);
+            });
+        }
+
+        if (!text.empty()) {
+            fwrite(text.data(), 1, text.size(), stdout);
+            fflush(stdout);
+            text.clear();
+        }
+
+        if (!done.empty()) {
+            std::lock_guard<std::mutex> guard(ringsLock);
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [&done](const std::shared_ptr<CgroupLogRing> &ring) {
+                return std::find(done.begin(), done.end(), ring.get()) != done.end();
+            }), rings.end());
+        }
+    }
+
+private:
+    CgroupLogger()
+    {
+        running.store(true, std::memory_order_release);
+        thread = std::thread(&CgroupLogger::Run, this);
+    }
+
+    ~CgroupLogger()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wakeCond.notify_one();
+        thread.join();
+
+        running.store(false, std::memory_order_release);
+        Drain();
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lk(wakeLock);
+        while (!stopping) {
+            lk.unlock();
+            Drain();
+            lk.lock();
+            wakeCond.wait_for(lk, std::chrono::milliseconds(20));
+        }
+    }
+
+    static std::atomic<bool> running;
+
+    std::mutex ringsLock;
+    std::vector<std::shared_ptr<CgroupLogRing>> rings;
+
+    std::mutex drainLock;
+    std::string text; /* guarded by drainLock */
+
+    std::mutex wakeLock;
+    std::condition_variable wakeCond;
+    bool stopping = false;
+    std::thread thread;
+};
+
+std::atomic<bool> CgroupLogger::running(false);
+
+/* The ring of the calling thread, created on its first message */
+struct CgroupLogThread
+{
+    ~CgroupLogThread();
+
+    std::shared_ptr<CgroupLogRing> ring;
+};
+
+thread_local CgroupLogThread logThread;
+/* set once logThread is gone, e.g. for messages of static destructors */
+thread_local bool logThreadExited = false;
+
+CgroupLogThread::~CgroupLogThread()
+{
+    if (ring)
+        ring->closed.store(true, std::memory_order_release);
+    logThreadExited = true;
+}
+
+} // namespace
+
+CgroupLogRecord &CgroupLogRecord::operator<<(std::ios_base &(*manip)(std::ios_base &))
+{
+    if (manip == static_cast<std::ios_base &(*)(std::ios_base &)>(std::hex))
+        Put(ARG_HEX, nullptr, 0);
+    else if (manip == static_cast<std::ios_base &(*)(std::ios_base &)>(std::dec))
+        Put(ARG_DEC, nullptr, 0);
+    return *this;
+}
+
+void CgroupLogRecord::Commit()
+{
+    bool error = buf[0] >= CGROUP_LOG_LEVEL_ERROR;
+    CgroupLogger &logger = CgroupLogger::Get();
+
+    if (!CgroupLogger::Running() || logThreadExited) {
+        std::string text;
+        Format(buf, size, text);
+        fwrite(text.data(), 1, text.size(), stdout);
+        return;
+    }
+
+    if (!logThread.ring)
+        logThread.ring = logger.Register();
+
+    CgroupLogRing &ring = *logThread.ring;
+    while (!ring.Push(buf, size)) {
+        logger.Wake();
+        std::this_thread::yield();
+    }
+
+    if (error || ring.Filling())
+        logger.Wake();
+}
+
+void CgroupLogRecord::Format(const unsigned char *record, size_t len, std::string &out)
+{
+    char num[32];
+    bool hex = false;
+    size_t i = 1;
+
+    out += "[CGROUP] ";
+    while (i < len) {
+        uint8_t tag = record[i++];
+        switch (tag) {
+        case ARG_STR: {
+            uint16_t n;
+            memcpy(&n, record + i, sizeof(n));
+            out.append(reinterpret_cast<const char *>(record) + i + sizeof(n), n);
+            i += sizeof(n) + n;
+            break;
+        }
+        case ARG_CHAR:
+            out += static_cast<char>(record[i++]);
+            break;
+        case ARG_I64: {
+            long long value;
+            memcpy(&value, record + i, sizeof(value));
+            out.append(num, snprintf(num, sizeof(num), hex ? "%llx" : "%lld", value));
+            i += sizeof(value);
+            break;
+        }
+        case ARG_U64: {
+            unsigned long long value;
+            memcpy(&value, record + i, sizeof(value));
+            out.append(num, snprintf(num, sizeof(num), hex ? "%llx" : "%llu", value));
+            i += sizeof(value);
+            break;
+        }
+        case ARG_F64: {
+            double value;
+            memcpy(&value, record + i, sizeof(value));
+            out.append(num, snprintf(num, sizeof(num), "%g", value));
+            i += sizeof(value);
+            break;
+        }
+        case ARG_PTR: {
+            uintptr_t value;
+            memcpy(&value, record + i, sizeof(value));
+            out.append(num, snprintf(num, sizeof(num), "0x%llx", static_cast<unsigned long long>(value)));
+            i += sizeof(value);
+            break;
+        }
+        case ARG_HEX:
+            hex = true;
+            break;
+        case ARG_DEC:
+            hex = false;
+            break;
+        default:
+            i = len;
+            break;
+        }
+    }
+    out += '\n';
+}
+
+void CgroupLog::Flush()
+{
+    if (CgroupLogger::Running())
+        CgroupLogger::Get().Drain();
+    else
+        fflush(stdout);
+}
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef __CGROUPLOG_HH__
+#define __CGROUPLOG_HH__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#define CGROUP_LOG_LEVEL_DEBUG 0
+#define CGROUP_LOG_LEVEL_ERROR 1
+#define CGROUP_LOG_LEVEL_NONE 2
+
+namespace mdsd {
+
+/*
+ * One log message as it is queued: the level followed by the streamed
+ * arguments in binary form, strings copied and numbers as is. Formatting
+ * to text happens on the drain thread of CgroupLog. Types without a binary
+ * form (e.g. fs::path) are formatted in place with their operator<<.
+ *
+ * Messages longer than MaxSize are truncated.
+ */
+class CgroupLogRecord
+{
+public:
+    static constexpr size_t MaxSize = 1024;
+
+    enum : uint8_t {
+        ARG_STR, ARG_CHAR, ARG_I64, ARG_U64, ARG_F64, ARG_PTR, ARG_HEX, ARG_DEC,
+    };
+
+    explicit CgroupLogRecord(int level) : size(1) { buf[0] = level; }
+
+    template <typename T>
+    CgroupLogRecord &operator<<(const T &value)
+    {
+        if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)
+            Put(ARG_CHAR, &value, 1);
+        else if constexpr (std::is_same_v<T, bool> || (std::is_integral_v<T> && std::is_unsigned_v<T>))
+            PutNumber(ARG_U64, static_cast<unsigned long long>(value));
+        else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+            PutNumber(ARG_I64, static_cast<long long>(value));
+        else if constexpr (std::is_floating_point_v<T>)
+            PutNumber(ARG_F64, static_cast<double>(value));
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+            PutStr(value);
+        else if constexpr (std::is_pointer_v<T>)
+            PutNumber(ARG_PTR, reinterpret_cast<uintptr_t>(value));
+        else {
+            std::ostringstream text;
+            text << value;
+            PutStr(text.str());
+        }
+        return *this;
+    }
+
+    /* std::hex and std::dec, other manipulators are ignored */
+    CgroupLogRecord &operator<<(std::ios_base &(*manip)(std::ios_base &));
+
+    /* Queues the message, called once */
+    void Commit();
+
+    /* Appends the text of a queued message to out, with a trailing '\n' */
+    static void Format(const unsigned char *record, size_t len, std::string &out);
+
+private:
+    void Put(uint8_t tag, const void *data, size_t len)
+    {
+        if (size + 1 + len > MaxSize)
+            return;
+        buf[size++] = tag;
+        memcpy(buf + size, data, len);
+        size += len;
+    }
+
+    template <typename N>
+    void PutNumber(uint8_t tag, N value) { Put(tag, &value, sizeof(value)); }
+
+    void PutStr(std::string_view str)
+    {
+        if (size + 3 > MaxSize)
+            return;
+        uint16_t len = std::min(str.size(), MaxSize - size - 3);
+        buf[size++] = ARG_STR;
+        memcpy(buf + size, &len, sizeof(len));
+        memcpy(buf + size + sizeof(len), str.data(), len);
+        size += sizeof(len) + len;
+    }
+
+    unsigned char buf[MaxSize];
+    size_t size;
+};
+
+/*
+ * Asynchronous log sink of CGROUP_DEBUG and CGROUP_ERROR.
+ *
+ * Every thread that logs gets its own lock-free single producer ring, a
+ * background thread drains all rings to stdout. A thread only waits when
+ * its ring is full, errors wake the drain thread right away. The order of
+ * messages is kept per thread only. After the sink was destroyed at exit
+ * messages are written synchronously.
+ */
+namespace CgroupLog {
+
+/* Writes out everything queued so far */
+void Flush();
+
+} // namespace CgroupLog
+
+} // namespace mdsd
+
+#define CGROUP_LOG_ASYNC(level, log) \
+	do { \
+		mdsd::CgroupLogRecord __rec(level); \
+		__rec << log; \
+		__rec.Commit(); \
+	} while (0)
+
+#endif // __CGROUPLOG_HH__
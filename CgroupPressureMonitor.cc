@@ -0,0 +1,83 @@
+#include "CgroupPressureMonitor.hh"
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+using namespace mdsd;
+
+#define CGROUP_PRESSURE_MAX_EVENTS 64
+
+CgroupPressureMonitor::CgroupPressureMonitor()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", cannot create epoll instance");
+}
+
+CgroupPressureMonitor::~CgroupPressureMonitor()
+{
+    for (const auto &trigger : triggers)
+        close(trigger.first);
+    close(epollFd);
+}
+
+int CgroupPressureMonitor::AddTrigger(CgroupBackend &backend, int fileType, const std::string &trigger,
+                                      unsigned long long cookie)
+{
+    int fd = backend.OpenPressureTrigger(fileType, trigger);
+
+    struct epoll_event event = {};
+    event.events = EPOLLPRI;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        int err = errno;
+        close(fd);
+        throw CGroupBaseException("errno:" + std::to_string(err) + ", cannot watch pressure trigger");
+    }
+
+    triggers[fd] = { cookie, fileType };
+    CGROUP_DEBUG("Pressure trigger '" << trigger << "' on '" << backend.GetRelativeBasePath()
+                 << "' registered (fd=" << fd << ")");
+    return fd;
+}
+
+void CgroupPressureMonitor::RemoveTrigger(int trigger)
+{
+    if (triggers.erase(trigger) == 0)
+        return;
+
+    /* closing the fd removes it from the epoll set and the trigger from the kernel */
+    close(trigger);
+}
+
+int CgroupPressureMonitor::Dispatch(int timeoutMs, const CgroupPressureCallback &callback)
+{
+    struct epoll_event events[CGROUP_PRESSURE_MAX_EVENTS];
+
+    int n = epoll_wait(epollFd, events, CGROUP_PRESSURE_MAX_EVENTS, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        throw CGroupBaseException("errno:" + std::to_string(errno) + ", epoll_wait failed");
+    }
+
+    int delivered = 0;
+    for (int i = 0; i < n; i++)
+    {
+        auto it = triggers.find(events[i].data.fd);
+        if (it == triggers.end())
+            continue;
+
+        CgroupPressureEvent event = { it->first, it->second.cookie, it->second.fileType, false };
+        if (events[i].events & EPOLLERR) {
+            event.removed = true;
+            RemoveTrigger(event.trigger);
+        }
+
+        callback(event);
+        delivered++;
+    }
+
+    return delivered;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef __CGROUPPRESSUREMONITOR_HH__
+#define __CGROUPPRESSUREMONITOR_HH__
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "CgroupBackend.hh"
+
+namespace mdsd {
+
+struct CgroupPressureEvent {
+    int trigger;        /* id returned by AddTrigger() */
+    unsigned long long cookie;
+    int fileType;       /* CGROUP_CONTROLLER_FILE_*_PRESSURE */
+    bool removed;       /* the cgroup went away, the trigger was dropped */
+};
+
+typedef std::function<void(const CgroupPressureEvent &event)> CgroupPressureCallback;
+
+/*
+ * Delivers PSI trigger notifications of many cgroups through one epoll fd.
+ *
+ * Each trigger is an fd on a *.pressure file (see
+ * CgroupBackend::OpenPressureTrigger), the kernel raises POLLPRI on it at
+ * most once per window when the stall threshold is crossed, and POLLERR
+ * once the cgroup is removed. GetFd() can itself be added to the caller's
+ * event loop, or Dispatch() can be used to block on it.
+ *
+ * Not thread-safe.
+ */
+class CgroupPressureMonitor
+{
+public:
+    CgroupPressureMonitor();
+    ~CgroupPressureMonitor();
+
+    CgroupPressureMonitor(const CgroupPressureMonitor&) = delete;
+    CgroupPressureMonitor& operator=(const CgroupPressureMonitor&) = delete;
+
+    /* trigger is "some|full <stall usec> <window usec>", returns the trigger id */
+    int AddTrigger(CgroupBackend &backend, int fileType, const std::string &trigger,
+                   unsigned long long cookie = 0);
+    void RemoveTrigger(int trigger);
+
+    int GetFd() const { return epollFd; }
+    size_t Size() const { return triggers.size(); }
+
+    /* Wait up to timeoutMs (-1 forever) and call callback for every fired
+       trigger, returns the number of events delivered */
+    int Dispatch(int timeoutMs, const CgroupPressureCallback &callback);
+
+private:
+    struct Trigger {
+        unsigned long long cookie;
+        int fileType;
+    };
+
+    int epollFd;
+    /* keyed by the trigger fd, which also is the trigger id */
+    std::unordered_map<int, Trigger> triggers;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPPRESSUREMONITOR_HH__
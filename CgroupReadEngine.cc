@@ -0,0 +1,215 @@
+#include "CgroupReadEngine.hh"
+#include "CgroupDef.hh"
+
+#include <unistd.h>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+# include <linux/io_uring.h>
+# define CGROUP_HAVE_IO_URING 1
+#endif
+
+using namespace mdsd;
+
+CgroupReadEngine::CgroupReadEngine(bool useIoUring, unsigned int entries)
+{
+    if (useIoUring && !SetupRing(entries))
+        CGROUP_DEBUG("io_uring not available (errno=" << errno << "), falling back to pread");
+}
+
+CgroupReadEngine::~CgroupReadEngine()
+{
+    TeardownRing();
+}
+
+void CgroupReadEngine::Submit(std::vector<CgroupReadRequest> &requests)
+{
+    size_t done = 0;
+
+    while (done < requests.size() && ringFd >= 0)
+    {
+        size_t count = std::min<size_t>(requests.size() - done, sqEntries);
+        size_t handled = SubmitRing(&requests[done], count);
+        done += handled;
+        if (handled < count) {
+            /* nothing is in flight anymore, the rest was never submitted */
+            CGROUP_ERROR("io_uring submit failed errno=" << errno << ", falling back to pread");
+            TeardownRing();
+            break;
+        }
+    }
+
+    if (done < requests.size())
+        SubmitSync(&requests[done], requests.size() - done);
+}
+
+void CgroupReadEngine::SubmitSync(CgroupReadRequest *requests, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = pread(requests[i].fd, requests[i].buf, requests[i].size, 0);
+        if (requests[i].result < 0)
+            requests[i].result = -errno;
+    }
+}
+
+#ifdef CGROUP_HAVE_IO_URING
+
+bool CgroupReadEngine::SetupRing(unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0)
+        return false;
+
+    sqEntries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        TeardownRing();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            TeardownRing();
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = nullptr;
+        TeardownRing();
+        return false;
+    }
+
+    sqHead = (unsigned *)((char *)sqRing + params.sq_off.head);
+    sqTail = (unsigned *)((char *)sqRing + params.sq_off.tail);
+    sqMask = (unsigned *)((char *)sqRing + params.sq_off.ring_mask);
+    sqArray = (unsigned *)((char *)sqRing + params.sq_off.array);
+    cqHead = (unsigned *)((char *)cqRing + params.cq_off.head);
+    cqTail = (unsigned *)((char *)cqRing + params.cq_off.tail);
+    cqMask = (unsigned *)((char *)cqRing + params.cq_off.ring_mask);
+    cqes = (char *)cqRing + params.cq_off.cqes;
+
+    iovecs.resize(sqEntries);
+    return true;
+}
+
+void CgroupReadEngine::TeardownRing()
+{
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    if (ringFd >= 0)
+        close(ringFd);
+
+    sqes = sqRing = cqRing = nullptr;
+    ringFd = -1;
+}
+
+/* READV (5.1+) rather than READ (5.6+) to support older kernels. The
+   kernel takes the SQEs in order, so when io_uring_enter() fails the
+   requests it took are the first ones: their completions are waited for,
+   so that no read lands in a buffer after returning, and their number is
+   returned. */
+size_t CgroupReadEngine::SubmitRing(CgroupReadRequest *requests, size_t count)
+{
+    auto *sqeArray = (struct io_uring_sqe *)sqes;
+    auto *cqeArray = (struct io_uring_cqe *)cqes;
+    unsigned tail = __atomic_load_n(sqTail, __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < count; i++) {
+        unsigned index = tail & *sqMask;
+        struct io_uring_sqe *sqe = &sqeArray[index];
+
+        iovecs[i].iov_base = requests[i].buf;
+        iovecs[i].iov_len = requests[i].size;
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = requests[i].fd;
+        sqe->addr = (unsigned long)&iovecs[i];
+        sqe->len = 1;
+        sqe->off = 0;
+        sqe->user_data = i;
+        requests[i].result = -ECANCELED;
+
+        sqArray[index] = index;
+        tail++;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    size_t reaped = 0;
+    size_t toSubmit = count;
+    int error = 0;
+    while (reaped < count - toSubmit || (!error && reaped < count))
+    {
+        size_t wait = error ? count - toSubmit - reaped : count - reaped;
+        int ret = syscall(__NR_io_uring_enter, ringFd, error ? 0 : toSubmit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) {
+            if (error)
+                break;  /* cannot wait anymore, see below */
+            error = errno;
+            continue;
+        }
+        if (ret > 0 && !error)
+            toSubmit -= std::min<size_t>(ret, toSubmit);
+
+        unsigned head = __atomic_load_n(cqHead, __ATOMIC_RELAXED);
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &cqeArray[head & *cqMask];
+            requests[cqe->user_data].result = cqe->res;
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (!error)
+        return count;
+
+    if (reaped < count - toSubmit)
+        CGROUP_ERROR("io_uring: " << count - toSubmit - reaped << " reads still in flight");
+    errno = error;
+    return count - toSubmit;
+}
+
+#else /* !CGROUP_HAVE_IO_URING */
+
+bool CgroupReadEngine::SetupRing(unsigned int entries)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+void CgroupReadEngine::TeardownRing()
+{
+}
+
+size_t CgroupReadEngine::SubmitRing(CgroupReadRequest *requests, size_t count)
+{
+    errno = ENOSYS;
+    return 0;
+}
+
+#endif /* CGROUP_HAVE_IO_URING */
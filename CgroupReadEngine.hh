@@ -0,0 +1,72 @@
+#pragma once
+#ifndef __CGROUPREADENGINE_HH__
+#define __CGROUPREADENGINE_HH__
+
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace mdsd {
+
+/* One read at offset 0, result is the byte count or -errno */
+struct CgroupReadRequest {
+    int fd;
+    char *buf;
+    size_t size;
+    ssize_t result;
+};
+
+/*
+ * Submits many cgroup interface file reads at once.
+ *
+ * When the kernel supports it the whole batch goes through an io_uring
+ * with a single io_uring_enter() per ring full of requests, otherwise, or
+ * when disabled, every request is a plain pread(). The ring is set up with
+ * raw syscalls so no liburing is needed.
+ *
+ * Not thread-safe, use one engine per thread.
+ */
+class CgroupReadEngine
+{
+public:
+    CgroupReadEngine(bool useIoUring = true, unsigned int entries = 256);
+    ~CgroupReadEngine();
+
+    CgroupReadEngine(const CgroupReadEngine&) = delete;
+    CgroupReadEngine& operator=(const CgroupReadEngine&) = delete;
+
+    bool UsingIoUring() const { return ringFd >= 0; }
+
+    void Submit(std::vector<CgroupReadRequest> &requests);
+
+private:
+    bool SetupRing(unsigned int entries);
+    void TeardownRing();
+    size_t SubmitRing(CgroupReadRequest *requests, size_t count);
+    void SubmitSync(CgroupReadRequest *requests, size_t count);
+
+    int ringFd = -1;
+    unsigned int sqEntries = 0;
+
+    void *sqRing = nullptr;
+    void *cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    void *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    void *cqes = nullptr;
+
+    std::vector<struct iovec> iovecs;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPREADENGINE_HH__
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef __CGROUPRESULT_HH__
+#define __CGROUPRESULT_HH__
+
+#include <errno.h>
+
+#include <utility>
+
+namespace mdsd {
+
+typedef enum {
+    CGROUP_ERR_NONE = 0,
+    CGROUP_ERR_NOT_FOUND,     /* file or cgroup does not exist (anymore) */
+    CGROUP_ERR_NO_CONTROLLER, /* controller not mounted or not enabled for the group */
+    CGROUP_ERR_INVALID,       /* value rejected by the kernel or not parsable */
+    CGROUP_ERR_SYSTEM,        /* any other errno */
+} CgroupErrorCode;
+
+/* Why an operation failed, with the errno it failed with and what it was
+   doing ("open", "read", ...), no allocation involved */
+struct CgroupError {
+    CgroupErrorCode code = CGROUP_ERR_NONE;
+    int error = 0;
+    const char *op = "";
+
+    CgroupError() {}
+    CgroupError(CgroupErrorCode code, int error, const char *op) : code(code), error(error), op(op) {}
+
+    static CgroupError FromErrno(int error, const char *op)
+    {
+        CgroupErrorCode code = CGROUP_ERR_SYSTEM;
+        if (error == ENOENT || error == ENODEV)
+            code = CGROUP_ERR_NOT_FOUND;
+        else if (error == EINVAL)
+            code = CGROUP_ERR_INVALID;
+        return CgroupError(code, error, op);
+    }
+};
+
+/*
+ * Value or error of the Try* methods of the backends, which report
+ * expected failures (a vanished cgroup, a missing controller) without
+ * throwing. The throwing methods are wrappers around them.
+ */
+template <typename T>
+class CgroupResult
+{
+public:
+    CgroupResult(const T &value) : value(value) {}
+    CgroupResult(T &&value) : value(std::move(value)) {}
+    CgroupResult(const CgroupError &error) : error(error) {}
+
+    bool Ok() const { return error.code == CGROUP_ERR_NONE; }
+    explicit operator bool() const { return Ok(); }
+
+    const T &Value() const { return value; }
+    T &Value() { return value; }
+    const T &operator*() const { return value; }
+    T ValueOr(const T &fallback) const { return Ok() ? value : fallback; }
+
+    const CgroupError &Error() const { return error; }
+
+private:
+    T value{};
+    CgroupError error;
+};
+
+template <>
+class CgroupResult<void>
+{
+public:
+    CgroupResult() {}
+    CgroupResult(const CgroupError &error) : error(error) {}
+
+    bool Ok() const { return error.code == CGROUP_ERR_NONE; }
+    explicit operator bool() const { return Ok(); }
+
+    const CgroupError &Error() const { return error; }
+
+private:
+    CgroupError error;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPRESULT_HH__
@@ -0,0 +1,269 @@
+#include "CgroupSampler.hh"
+#include "CgroupBackend.hh"
+#include "CgroupContext.hh"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+
+using namespace mdsd;
+using namespace std::chrono;
+
+CgroupSampler::CgroupSampler(const std::vector<std::shared_ptr<Cgroup>> &cgroups,
+                             std::chrono::milliseconds interval, unsigned int workers, bool useIoUring)
+    : interval(interval),
+      nworkers(std::max(1u, workers ? workers : std::min(4u, std::thread::hardware_concurrency() / 2))),
+      useIoUring(useIoUring)
+{
+    for (size_t i = 0; i < cgroups.size(); i++)
+        Add(cgroups[i], i);
+}
+
+CgroupSampler::~CgroupSampler()
+{
+    Stop();
+}
+
+void CgroupSampler::Add(const std::shared_ptr<Cgroup> &cgroup, unsigned long long cookie)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    nextCgroups.push_back(cgroup);
+    nextCookies.push_back(cookie);
+    changed = true;
+}
+
+void CgroupSampler::Remove(unsigned long long cookie)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = std::find(nextCookies.begin(), nextCookies.end(), cookie);
+    if (it == nextCookies.end())
+        return;
+
+    nextCgroups.erase(nextCgroups.begin() + (it - nextCookies.begin()));
+    nextCookies.erase(it);
+    changed = true;
+}
+
+void CgroupSampler::OnCycle(const std::function<void(const CgroupSampleSnapshot &snapshot)> &callback)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    cycleCallback = callback;
+}
+
+void CgroupSampler::Start()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (coordinator.joinable())
+        return;
+
+    /* after a restart, the cycles dispatched before are over for the new workers */
+    stopping = false;
+    for (unsigned int i = 0; i < nworkers; i++)
+        workers.emplace_back(&CgroupSampler::Work, this, i, generation);
+    coordinator = std::thread(&CgroupSampler::Run, this);
+}
+
+void CgroupSampler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    stopCond.notify_all();
+    workCond.notify_all();
+
+    if (coordinator.joinable())
+        coordinator.join();
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+std::shared_ptr<const CgroupSampleSnapshot> CgroupSampler::GetSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
+CgroupSamplerStats CgroupSampler::GetStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+void CgroupSampler::Run()
+{
+    std::shared_ptr<CgroupSampleSnapshot> next, published;
+    unsigned long long cycle = 0;
+    auto deadline = steady_clock::now();
+
+    std::unique_lock<std::mutex> lk(lock);
+    while (!stopping)
+    {
+        deadline += interval;
+        if (stopCond.wait_until(lk, deadline, [this] { return stopping; }))
+            break;
+
+        /* no worker runs, the set of cgroups can change */
+        if (changed) {
+            cgroups = nextCgroups;
+            cookies = nextCookies;
+            changed = false;
+        }
+        lk.unlock();
+
+        /* reuse the buffer published two cycles ago once no reader holds it */
+        if (!next || next.use_count() > 1)
+            next = std::make_shared<CgroupSampleSnapshot>();
+        next->samples.resize(cgroups.size());
+        next->cookies = cookies;
+
+        auto start = steady_clock::now();
+        next->cycle = ++cycle;
+        next->timestamp = start;
+        RunCycle(*next);
+        if (cycleCallback)
+            cycleCallback(*next);
+
+        auto end = steady_clock::now();
+        std::atomic_store(&snapshot, std::shared_ptr<const CgroupSampleSnapshot>(next));
+        std::swap(next, published);
+
+        lk.lock();
+        auto elapsed = duration_cast<microseconds>(end - start);
+        stats.cycles++;
+        stats.lastCycle = elapsed;
+        stats.maxCycle = std::max(stats.maxCycle, elapsed);
+        stats.totalCycle += elapsed;
+
+        /* skip the intervals we ran over rather than sampling back to back */
+        while (deadline + interval <= end) {
+            deadline += interval;
+            stats.missedDeadlines++;
+        }
+    }
+}
+
+void CgroupSampler::RunCycle(CgroupSampleSnapshot &snapshot)
+{
+    std::unique_lock<std::mutex> lk(lock);
+    current = &snapshot;
+    pending = nworkers;
+    generation++;
+    workCond.notify_all();
+
+    doneCond.wait(lk, [this] { return pending == 0; });
+    current = nullptr;
+}
+
+void CgroupSampler::Work(unsigned int shard, unsigned long long seen)
+{
+    CgroupSampleBatch batch(useIoUring);
+
+    std::unique_lock<std::mutex> lk(lock);
+    for (;;)
+    {
+        workCond.wait(lk, [&] { return stopping || generation != seen; });
+
+        /* always finish a dispatched cycle, the coordinator waits for it */
+        if (generation == seen)
+            return;
+
+        seen = generation;
+        CgroupSampleSnapshot *snapshot = current;
+        lk.unlock();
+
+        for (size_t i = shard; i < cgroups.size(); i += nworkers) {
+            snapshot->samples[i] = CgroupUsageSample();
+            batch.Add(*cgroups[i], snapshot->samples[i]);
+
+            if (batch.Size() >= CGROUP_SAMPLE_BATCH)
+                batch.Run();
+        }
+        batch.Run();
+
+        lk.lock();
+        if (--pending == 0)
+            doneCond.notify_one();
+    }
+}
+
+void CgroupSampler::SampleUsage(Cgroup &cgroup, CgroupUsageSample &sample)
+{
+    CgroupSampleBatch batch(false);
+
+    batch.Add(cgroup, sample);
+    batch.Run();
+}
+
+CgroupSampleBatch::CgroupSampleBatch(bool useIoUring)
+    : type(CgroupContext::Get()->GetBackendType()), engine(useIoUring)
+{
+}
+
+void CgroupSampleBatch::Add(Cgroup &cgroup, CgroupUsageSample &sample)
+{
+    DispatchBackend(type, *cgroup.backend, [&](auto basic) { AddAs(basic, sample); });
+}
+
+/* A missing controller only invalidates the fields it provides */
+template <typename Backend>
+void CgroupSampleBatch::AddAs(BasicCgroup<Backend> cgroup, CgroupUsageSample &sample)
+{
+    Backend *backend = &cgroup.GetBackend();
+    uses.push_back(backend->UseFiles());
+
+    for (const auto &file : cgroup.GetSampleFiles())
+    {
+        auto fd = cgroup.TryGetFileFd(file.controller, file.fileType, O_RDONLY);
+        if (!fd)
+            continue;
+
+        entries.push_back({ backend, &sample, &file, *fd, used });
+        used += file.bufSize;
+    }
+}
+
+void CgroupSampleBatch::Run()
+{
+    if (buffer.size() < used)
+        buffer.resize(used);
+
+    requests.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto &entry = entries[i];
+
+        requests[i].fd = entry.fd;
+        requests[i].buf = &buffer[entry.offset];
+        requests[i].size = entry.file->bufSize;
+        requests[i].result = 0;
+    }
+
+    engine.Submit(requests);
+
+    if (type == CGROUP_BACKEND_TYPE_V1)
+        ParseAs<CgroupBackendV1>();
+    else
+        ParseAs<CgroupBackendV2>();
+
+    entries.clear();
+    uses.clear();
+    used = 0;
+}
+
+/* Entries were added by AddAs<Backend>(), the cast is safe */
+template <typename Backend>
+void CgroupSampleBatch::ParseAs()
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto &entry = entries[i];
+        BasicCgroup<Backend> cgroup(*static_cast<Backend *>(entry.backend));
+
+        if (requests[i].result >= 0) {
+            cgroup.ParseSampleFile(entry.file->fileType, requests[i].buf, requests[i].result, *entry.sample);
+            entry.sample->valid |= entry.file->field;
+        } else if (requests[i].result == -ENODEV || requests[i].result == -ENOENT) {
+            /* the cgroup went away, reopen on the next cycle */
+            cgroup.InvalidateFile(entry.file->fileType, O_RDONLY);
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#pragma once
+#ifndef __CGROUPSAMPLER_HH__
+#define __CGROUPSAMPLER_HH__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BasicCgroup.hh"
+#include "Cgroup.hh"
+#include "CgroupStat.hh"
+#include "CgroupReadEngine.hh"
+
+namespace mdsd {
+
+#define CGROUP_SAMPLE_BATCH 256 /* reads per submission */
+
+/* Result of one sampling cycle, samples are in the order of the cgroups
+   sampled in that cycle, with the cookie each one was added with. Never
+   modified once published. */
+struct CgroupSampleSnapshot {
+    unsigned long long cycle = 0;
+    std::chrono::steady_clock::time_point timestamp;
+    std::vector<CgroupUsageSample> samples;
+    std::vector<unsigned long long> cookies;
+};
+
+struct CgroupSamplerStats {
+    unsigned long long cycles = 0;
+    unsigned long long missedDeadlines = 0;
+    std::chrono::microseconds lastCycle{0};
+    std::chrono::microseconds maxCycle{0};
+    std::chrono::microseconds totalCycle{0};
+};
+
+/*
+ * Samples several cgroups with one batch of reads: Add() opens (or finds
+ * in the backend fd cache, kept open until the end of the batch) the
+ * interface files of a cgroup, Run() submits
+ * all of them to the read engine at once and parses the results. Buffers
+ * are kept between runs so a steady state run does not allocate. Files
+ * are listed and parsed through BasicCgroup, without virtual calls.
+ */
+class CgroupSampleBatch
+{
+public:
+    CgroupSampleBatch(bool useIoUring = true);
+
+    void Add(Cgroup &cgroup, CgroupUsageSample &sample);
+    void Run();
+
+    size_t Size() const { return entries.size(); }
+    bool UsingIoUring() const { return engine.UsingIoUring(); }
+
+private:
+    template <typename Backend> void AddAs(BasicCgroup<Backend> cgroup, CgroupUsageSample &sample);
+    template <typename Backend> void ParseAs();
+
+    struct Entry {
+        CgroupBackend *backend;
+        CgroupUsageSample *sample;
+        const CgroupSampleFile *file;
+        int fd;
+        size_t offset;
+    };
+
+    const CgroupBackendType type;   /* of every cgroup of the process */
+    CgroupReadEngine engine;
+    std::vector<Entry> entries;
+    std::vector<CgroupFileCache::Use> uses;     /* fds of entries stay open until parsed */
+    std::vector<CgroupReadRequest> requests;
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+/*
+ * Periodically samples the usage of a set of cgroups.
+ *
+ * Add() and Remove() may be called from any thread at any time, they take
+ * effect at the start of the next cycle.
+ *
+ * Each cycle is run by a small pool of workers, cgroup i always being
+ * sampled by worker i % workers. The result of a cycle is published as an
+ * immutable snapshot. A cycle that ends after the start of the next one
+ * counts as a missed deadline and the skipped intervals are not replayed.
+ *
+ * Workers read their shard in batches of CGROUP_SAMPLE_BATCH reads,
+ * through io_uring when available.
+ */
+class CgroupSampler
+{
+public:
+    /* cgroups are added with their index as cookie */
+    CgroupSampler(const std::vector<std::shared_ptr<Cgroup>> &cgroups,
+                  std::chrono::milliseconds interval = std::chrono::milliseconds(1000),
+                  unsigned int workers = 0, bool useIoUring = true);
+    ~CgroupSampler();
+
+    /* cookie identifies the samples of cgroup in the snapshots */
+    void Add(const std::shared_ptr<Cgroup> &cgroup, unsigned long long cookie);
+    void Remove(unsigned long long cookie);
+
+    /* Called by the sampler thread after every cycle, while no worker
+       touches the backends. Must be set before Start(). */
+    void OnCycle(const std::function<void(const CgroupSampleSnapshot &snapshot)> &callback);
+
+    void Start();
+    void Stop();
+
+    std::shared_ptr<const CgroupSampleSnapshot> GetSnapshot() const;
+    CgroupSamplerStats GetStats();
+
+    static void SampleUsage(Cgroup &cgroup, CgroupUsageSample &sample);
+
+private:
+    void Run();
+    /* seen is the generation of the last cycle before the worker started */
+    void Work(unsigned int shard, unsigned long long seen);
+    void RunCycle(CgroupSampleSnapshot &snapshot);
+
+    /* sampled by the current cycle, only changed between cycles */
+    std::vector<std::shared_ptr<Cgroup>> cgroups;
+    std::vector<unsigned long long> cookies;
+    /* as of the last Add() and Remove(), under lock */
+    std::vector<std::shared_ptr<Cgroup>> nextCgroups;
+    std::vector<unsigned long long> nextCookies;
+    bool changed = false;
+
+    const std::chrono::milliseconds interval;
+    const unsigned int nworkers;
+    const bool useIoUring;
+    std::function<void(const CgroupSampleSnapshot &snapshot)> cycleCallback;
+
+    std::thread coordinator;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable workCond;
+    std::condition_variable doneCond;
+    std::condition_variable stopCond;
+    bool stopping = false;
+    unsigned long long generation = 0;
+    unsigned int pending = 0;
+    CgroupSampleSnapshot *current = nullptr;
+
+    std::shared_ptr<const CgroupSampleSnapshot> snapshot;
+    CgroupSamplerStats stats;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPSAMPLER_HH__
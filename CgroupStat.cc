@@ -0,0 +1,204 @@
+#include "CgroupStat.hh"
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+using namespace mdsd;
+
+CgroupStatParser::CgroupStatParser(const CgroupStatKey *keys, size_t count)
+    : keys(keys)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(keys[i].name);
+        keyLens.push_back(len);
+
+        if (byLength.size() <= len)
+            byLength.resize(len + 1);
+        byLength[len].push_back(i);
+    }
+}
+
+int CgroupStatParser::Find(const char *key, size_t len, int hint) const
+{
+    if (hint < (int)keyLens.size() && keyLens[hint] == len && memcmp(keys[hint].name, key, len) == 0)
+        return hint;
+
+    if (len >= byLength.size())
+        return -1;
+
+    for (int i : byLength[len])
+        if (memcmp(keys[i].name, key, len) == 0)
+            return i;
+
+    return -1;
+}
+
+size_t CgroupStatParser::Parse(const char *buf, size_t len, void *out) const
+{
+    const char *cur = buf;
+    const char *end = buf + len;
+    size_t found = 0;
+    int hint = 0;
+
+    while (cur < end)
+    {
+        const char *eol = (const char *)memchr(cur, '\n', end - cur);
+        if (!eol)
+            eol = end;
+
+        const char *sep = (const char *)memchr(cur, ' ', eol - cur);
+        if (sep) {
+            int i = Find(cur, sep - cur, hint);
+            unsigned long long value;
+
+            if (i >= 0 && std::from_chars(sep + 1, eol, value).ec == std::errc()) {
+                *(unsigned long long *)((char *)out + keys[i].offset) = value / keys[i].divisor;
+                hint = i + 1;
+                found++;
+            }
+        }
+
+        cur = eol + 1;
+    }
+
+    return found;
+}
+
+void mdsd::ParseIoStatV2(const char *buf, size_t len, CgroupIoStat &stat)
+{
+    static const CgroupStatKey ioKeys[] = {
+        CGROUP_STAT_KEY("rbytes", CgroupIoStat, rbytes),
+        CGROUP_STAT_KEY("wbytes", CgroupIoStat, wbytes),
+        CGROUP_STAT_KEY("rios", CgroupIoStat, rios),
+        CGROUP_STAT_KEY("wios", CgroupIoStat, wios),
+    };
+    const char *cur = buf;
+    const char *end = buf + len;
+
+    stat = CgroupIoStat();
+    while (cur < end)
+    {
+        const char *tokEnd = cur;
+        while (tokEnd < end && *tokEnd != ' ' && *tokEnd != '\n')
+            tokEnd++;
+
+        const char *eq = (const char *)memchr(cur, '=', tokEnd - cur);
+        if (eq) {
+            for (const auto &key : ioKeys) {
+                size_t klen = strlen(key.name);
+                unsigned long long value;
+
+                if (klen == size_t(eq - cur) && memcmp(key.name, cur, klen) == 0 &&
+                    std::from_chars(eq + 1, tokEnd, value).ec == std::errc()) {
+                    *(unsigned long long *)((char *)&stat + key.offset) += value;
+                    break;
+                }
+            }
+        }
+
+        cur = tokEnd + 1;
+    }
+}
+
+void mdsd::ParseBlkioV1(const char *buf, size_t len, unsigned long long &read, unsigned long long &write)
+{
+    const char *cur = buf;
+    const char *end = buf + len;
+
+    read = write = 0;
+    while (cur < end)
+    {
+        const char *eol = (const char *)memchr(cur, '\n', end - cur);
+        if (!eol)
+            eol = end;
+
+        /* skip the device, the last line is "Total N" */
+        const char *op = (const char *)memchr(cur, ' ', eol - cur);
+        const char *val = op ? (const char *)memchr(op + 1, ' ', eol - op - 1) : NULL;
+        if (val) {
+            unsigned long long value;
+            if (std::from_chars(val + 1, eol, value).ec == std::errc()) {
+                if (val - op - 1 == 4 && memcmp(op + 1, "Read", 4) == 0)
+                    read += value;
+                else if (val - op - 1 == 5 && memcmp(op + 1, "Write", 5) == 0)
+                    write += value;
+            }
+        }
+
+        cur = eol + 1;
+    }
+}
+
+/* The avgs are "12.34", integer part and two decimals, parsed by hand
+   since strtod depends on the locale */
+static double ParsePressureAvg(const char *cur, const char *end)
+{
+    unsigned long long whole = 0, frac = 0, scale = 1;
+
+    auto res = std::from_chars(cur, end, whole);
+    if (res.ec != std::errc())
+        return 0;
+
+    cur = res.ptr;
+    if (cur < end && *cur == '.') {
+        for (cur++; cur < end && *cur >= '0' && *cur <= '9' && scale < 1000000; cur++) {
+            frac = frac * 10 + (*cur - '0');
+            scale *= 10;
+        }
+    }
+
+    return whole + double(frac) / scale;
+}
+
+static void ParsePressureLine(const char *cur, const char *eol, CgroupPressureLine &line)
+{
+    while (cur < eol)
+    {
+        const char *tokEnd = (const char *)memchr(cur, ' ', eol - cur);
+        if (!tokEnd)
+            tokEnd = eol;
+
+        const char *eq = (const char *)memchr(cur, '=', tokEnd - cur);
+        if (eq) {
+            size_t klen = eq - cur;
+            if (klen == 5 && memcmp(cur, "total", 5) == 0)
+                std::from_chars(eq + 1, tokEnd, line.total);
+            else if (klen == 5 && memcmp(cur, "avg10", 5) == 0)
+                line.avg10 = ParsePressureAvg(eq + 1, tokEnd);
+            else if (klen == 5 && memcmp(cur, "avg60", 5) == 0)
+                line.avg60 = ParsePressureAvg(eq + 1, tokEnd);
+            else if (klen == 6 && memcmp(cur, "avg300", 6) == 0)
+                line.avg300 = ParsePressureAvg(eq + 1, tokEnd);
+        }
+
+        cur = tokEnd + 1;
+    }
+}
+
+bool mdsd::ParsePressure(const char *buf, size_t len, CgroupPressure &pressure)
+{
+    const char *cur = buf;
+    const char *end = buf + len;
+    bool found = false;
+
+    pressure = CgroupPressure();
+    while (cur < end)
+    {
+        const char *eol = (const char *)memchr(cur, '\n', end - cur);
+        if (!eol)
+            eol = end;
+
+        if (eol - cur > 5 && memcmp(cur, "some ", 5) == 0) {
+            ParsePressureLine(cur + 5, eol, pressure.some);
+            found = true;
+        } else if (eol - cur > 5 && memcmp(cur, "full ", 5) == 0) {
+            ParsePressureLine(cur + 5, eol, pressure.full);
+            found = true;
+        }
+
+        cur = eol + 1;
+    }
+
+    return found;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef __CGROUPSTAT_HH__
+#define __CGROUPSTAT_HH__
+
+#include <cstddef>
+#include <vector>
+
+namespace mdsd {
+
+#define CGROUP_STAT_BUF_LEN 8192 /* memory.stat is about 2KB on recent kernels */
+
+/* memory.stat, values in bytes */
+struct CgroupMemoryStat {
+    unsigned long long cache = 0;        /* v1 "cache", v2 "file" */
+    unsigned long long rss = 0;          /* v1 "rss", v2 "anon" */
+    unsigned long long activeAnon = 0;
+    unsigned long long inactiveAnon = 0;
+    unsigned long long activeFile = 0;
+    unsigned long long inactiveFile = 0;
+    unsigned long long unevictable = 0;
+    unsigned long long pgfault = 0;
+    unsigned long long pgmajfault = 0;
+};
+
+/* cpu.stat (v2) or cpuacct.usage + cpu.stat (v1), times in microseconds */
+struct CgroupCpuStat {
+    unsigned long long usageUsec = 0;
+    unsigned long long userUsec = 0;     /* v2 only */
+    unsigned long long systemUsec = 0;   /* v2 only */
+    unsigned long long nrPeriods = 0;
+    unsigned long long nrThrottled = 0;
+    unsigned long long throttledUsec = 0;
+};
+
+/* io.stat (v2) or blkio.throttle.* (v1), summed over all devices */
+struct CgroupIoStat {
+    unsigned long long rbytes = 0;
+    unsigned long long wbytes = 0;
+    unsigned long long rios = 0;
+    unsigned long long wios = 0;
+};
+
+typedef enum {
+    CGROUP_SAMPLE_MEMORY_USAGE = 1 << 0,
+    CGROUP_SAMPLE_MEMORY_STAT = 1 << 1,
+    CGROUP_SAMPLE_CPU_STAT = 1 << 2,
+    CGROUP_SAMPLE_IO_STAT = 1 << 3,
+    CGROUP_SAMPLE_PIDS_CURRENT = 1 << 4,
+} CgroupSampleField;
+
+/* Usage of one cgroup, only the fields flagged in 'valid' were read */
+struct CgroupUsageSample {
+    unsigned int valid = 0;
+    unsigned long long memoryUsage = 0; /* KB */
+    CgroupMemoryStat memoryStat;
+    CgroupCpuStat cpuStat;
+    CgroupIoStat ioStat;
+    unsigned long long pidsCurrent = 0;
+};
+
+/* One line of a PSI file: "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" */
+struct CgroupPressureLine {
+    double avg10 = 0;
+    double avg60 = 0;
+    double avg300 = 0;
+    unsigned long long total = 0; /* usec */
+};
+
+/* cpu.pressure, memory.pressure or io.pressure */
+struct CgroupPressure {
+    CgroupPressureLine some;
+    CgroupPressureLine full;
+};
+
+/* Counters and states of the *.events files, v1 only fills the ones it has */
+typedef enum {
+    CGROUP_EVENT_MEMORY_LOW = 0,
+    CGROUP_EVENT_MEMORY_HIGH,
+    CGROUP_EVENT_MEMORY_MAX,
+    CGROUP_EVENT_MEMORY_OOM,
+    CGROUP_EVENT_MEMORY_OOM_KILL,
+    CGROUP_EVENT_MEMORY_OOM_GROUP_KILL,
+    CGROUP_EVENT_SWAP_HIGH,
+    CGROUP_EVENT_SWAP_MAX,
+    CGROUP_EVENT_SWAP_FAIL,
+    CGROUP_EVENT_PIDS_MAX,
+    CGROUP_EVENT_POPULATED,     /* 0/1 */
+    CGROUP_EVENT_FROZEN,        /* 0/1 */
+    CGROUP_EVENT_UNDER_OOM,     /* 0/1, v1 memory.oom_control */
+    CGROUP_EVENT_REMOVED,       /* 0/1, set once the cgroup directory is gone */
+
+    CGROUP_EVENT_LAST,
+} CgroupEventType;
+
+struct CgroupEventCounters {
+    unsigned long long values[CGROUP_EVENT_LAST] = {};
+};
+
+/* Maps a key of a flat keyed file to a field of the output struct */
+struct CgroupStatKey {
+    const char *name;
+    size_t offset;                 /* offsetof() the unsigned long long field */
+    unsigned long long divisor;    /* e.g. 1000 for a ns value stored in usec */
+};
+
+#define CGROUP_STAT_KEY(name, type, field) { name, offsetof(type, field), 1 }
+#define CGROUP_STAT_KEY_DIV(name, type, field, div) { name, offsetof(type, field), div }
+#define CGROUP_EVENT_KEY(name, event) \
+    { name, offsetof(CgroupEventCounters, values) + (event) * sizeof(unsigned long long), 1 }
+
+/*
+ * Single pass parser for flat keyed files ("key value\n" lines) such as
+ * memory.stat and cpu.stat.
+ *
+ * The key table is indexed by key length at construction, and since the
+ * kernel always prints the keys in the same order the parser first tries
+ * the entry following the last match, so a line usually costs one memcmp.
+ * Unknown keys are skipped.
+ */
+class CgroupStatParser
+{
+public:
+    CgroupStatParser(const CgroupStatKey *keys, size_t count);
+
+    /* Returns the number of keys found */
+    size_t Parse(const char *buf, size_t len, void *out) const;
+
+private:
+    int Find(const char *key, size_t len, int hint) const;
+
+    const CgroupStatKey *keys;
+    std::vector<size_t> keyLens;
+    std::vector<std::vector<int>> byLength;
+};
+
+/* "MAJ:MIN rbytes=N wbytes=N rios=N wios=N ..." lines of v2 io.stat */
+void ParseIoStatV2(const char *buf, size_t len, CgroupIoStat &stat);
+
+/* "MAJ:MIN Read N" / "MAJ:MIN Write N" lines of v1 blkio.throttle files */
+void ParseBlkioV1(const char *buf, size_t len, unsigned long long &read, unsigned long long &write);
+
+/* Returns false when neither a "some" nor a "full" line was found */
+bool ParsePressure(const char *buf, size_t len, CgroupPressure &pressure);
+
+} // namespace mdsd
+
+#endif // __CGROUPSTAT_HH__
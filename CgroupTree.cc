@@ -0,0 +1,201 @@
+#include "CgroupTree.hh"
+#include "WorkerPool.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace mdsd;
+
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Names of the subdirectories of fd */
+static CgroupResult<void> ReadSubdirs(int fd, std::vector<std::string> &names)
+{
+    char buf[32 * 1024];
+    long n;
+
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+    {
+        for (long pos = 0; pos < n; ) {
+            auto entry = reinterpret_cast<struct linux_dirent64 *>(buf + pos);
+            pos += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            bool dir = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat st;
+                dir = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (dir)
+                names.emplace_back(name);
+        }
+    }
+
+    if (n < 0)
+        return CgroupError::FromErrno(errno, "list");
+
+    return CgroupResult<void>();
+}
+
+CgroupResult<CgroupTree> CgroupTree::Snapshot(int dirfd, const std::string &path)
+{
+    CgroupTree tree;
+
+    int fd = openat(dirfd, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return tree;
+        return CgroupError::FromErrno(errno, "open");
+    }
+
+    tree.nodes.push_back({ path, 0, 1, 0 });
+    auto walked = tree.Walk(fd, 0);
+    close(fd);
+
+    if (!walked)
+        return walked.Error();
+    return tree;
+}
+
+CgroupResult<void> CgroupTree::Walk(int fd, uint32_t index)
+{
+    std::vector<std::string> names;
+    auto listed = ReadSubdirs(fd, names);
+    if (!listed)
+        return listed;
+
+    for (auto &name : names)
+    {
+        int childFd = openat(fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (childFd < 0) {
+            if (errno == ENOENT)
+                continue;
+            return CgroupError::FromErrno(errno, "open");
+        }
+
+        uint32_t child = nodes.size();
+        nodes.push_back({ std::move(name), index, child + 1, nodes[index].depth + 1 });
+        auto walked = Walk(childFd, child);
+        close(childFd);
+
+        if (!walked)
+            return walked;
+    }
+
+    nodes[index].end = nodes.size();
+    return CgroupResult<void>();
+}
+
+std::string CgroupTree::GetPath(size_t index) const
+{
+    std::string path = nodes[index].name;
+
+    while (index != 0) {
+        index = nodes[index].parent;
+        path = nodes[index].name + "/" + path;
+    }
+
+    return path;
+}
+
+size_t CgroupTree::RemoveSubtree(int parentFd, uint32_t index, CgroupError &error) const
+{
+    const CgroupTreeNode &node = nodes[index];
+    size_t removed = 0;
+
+    if (node.end > index + 1) {
+        int fd = openat(parentFd, node.name.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno != ENOENT && error.code == CGROUP_ERR_NONE)
+                error = CgroupError::FromErrno(errno, "open");
+            return 0;
+        }
+
+        for (uint32_t child = index + 1; child < node.end; child = nodes[child].end)
+            removed += RemoveSubtree(fd, child, error);
+        close(fd);
+    }
+
+    if (unlinkat(parentFd, node.name.c_str(), AT_REMOVEDIR) == 0)
+        removed++;
+    else if (errno != ENOENT && error.code == CGROUP_ERR_NONE)
+        error = CgroupError::FromErrno(errno, "remove");
+
+    return removed;
+}
+
+CgroupResult<size_t> CgroupTree::Remove(int dirfd) const
+{
+    if (nodes.empty())
+        return size_t(0);
+
+    std::vector<uint32_t> subtrees;
+    for (uint32_t child = 1; child < nodes[0].end; child = nodes[child].end)
+        subtrees.push_back(child);
+
+    if (nodes.size() < CGROUP_TREE_PARALLEL_MIN || subtrees.size() < 2) {
+        CgroupError error;
+        size_t removed = RemoveSubtree(dirfd, 0, error);
+        if (error.code != CGROUP_ERR_NONE)
+            return error;
+        return removed;
+    }
+
+    int fd = openat(dirfd, nodes[0].name.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return size_t(0);
+        return CgroupError::FromErrno(errno, "open");
+    }
+
+    std::atomic<size_t> removed(0);
+    std::mutex errorLock;
+    CgroupError firstError;
+    {
+        unsigned int workers = std::min<size_t>(subtrees.size(), std::max(1u, std::thread::hardware_concurrency()));
+        WorkerPool pool(workers);
+
+        for (uint32_t child : subtrees)
+        {
+            pool.Submit([&, child] {
+                CgroupError error;
+                removed += RemoveSubtree(fd, child, error);
+                if (error.code != CGROUP_ERR_NONE) {
+                    std::lock_guard<std::mutex> guard(errorLock);
+                    if (firstError.code == CGROUP_ERR_NONE)
+                        firstError = error;
+                }
+            });
+        }
+        pool.Wait();
+    }
+    close(fd);
+
+    if (unlinkat(dirfd, nodes[0].name.c_str(), AT_REMOVEDIR) == 0)
+        removed++;
+    else if (errno != ENOENT && firstError.code == CGROUP_ERR_NONE)
+        firstError = CgroupError::FromErrno(errno, "remove");
+
+    if (firstError.code != CGROUP_ERR_NONE)
+        return firstError;
+    return removed.load();
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef __CGROUPTREE_HH__
+#define __CGROUPTREE_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CgroupResult.hh"
+
+namespace mdsd {
+
+#define CGROUP_TREE_PARALLEL_MIN 256 /* groups before Remove() fans out */
+
+struct CgroupTreeNode {
+    std::string name;   /* relative to the parent, the path given to Snapshot() for node 0 */
+    uint32_t parent;    /* 0 for node 0 */
+    uint32_t end;       /* index after the last descendant */
+    uint32_t depth;
+};
+
+/*
+ * Snapshot of a cgroup and all its descendants, in pre-order.
+ *
+ * Directories are read with getdents64 on fds opened relative to their
+ * parent, starting from a dirfd such as a hierarchy root fd of
+ * CgroupContext, so no full path is resolved more than once. Interface
+ * files are skipped, only groups are kept.
+ */
+class CgroupTree
+{
+public:
+    /* A group that does not exist gives an empty tree, groups removed
+       while walking are left out */
+    static CgroupResult<CgroupTree> Snapshot(int dirfd, const std::string &path);
+
+    size_t Size() const { return nodes.size(); }
+    bool Empty() const { return nodes.empty(); }
+    const CgroupTreeNode &operator[](size_t index) const { return nodes[index]; }
+
+    /* Path of a node relative to the dirfd given to Snapshot() */
+    std::string GetPath(size_t index) const;
+
+    /* rmdir every group of the snapshot, children before their parent.
+       With CGROUP_TREE_PARALLEL_MIN groups or more the subtrees of the
+       children of node 0 are removed in parallel. Groups already gone are
+       skipped, the first other error is returned once all were tried.
+       Returns the number of groups removed. */
+    CgroupResult<size_t> Remove(int dirfd) const;
+
+private:
+    CgroupResult<void> Walk(int fd, uint32_t index);
+    size_t RemoveSubtree(int parentFd, uint32_t index, CgroupError &error) const;
+
+    std::vector<CgroupTreeNode> nodes;
+};
+
+} // namespace mdsd
+
+#endif // __CGROUPTREE_HH__
@@ -1,13 +1,23 @@
 #include "ConfigINI.hh"
-#include <fstream>
 #include <iostream>
-#include <exception>
+#include <algorithm>
 #include <confini.h>
-#include <map>
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace mdsd;
 using namespace std;
 
+/* this should match the enum ConfigKey */
+static const char * const configKeyNames[CONFIG_KEY_LAST] = {
+    "AllowedTenants", "Provisioning", "SoftQuotaCushion",
+    "CPU", "CPUMin", "CPUMax", "Memory", "MemoryFloor",
+};
 
 ConfigINI::ConfigINI()
 {
@@ -15,68 +25,152 @@ ConfigINI::ConfigINI()
 
 ConfigINI::~ConfigINI()
 {
+    Unmap();
 }
 
-void ConfigINI::Parse(const std::string& path, IniParsedDataMap& data)
+void ConfigINI::Unmap()
 {
+    if (mapping)
+        munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+/*
+ * libconfini terminates the tokens in place, the last one at
+ * ini_source[ini_length]. That byte comes from an anonymous mapping under
+ * the file one, so it exists even when the file size is a multiple of the
+ * page size.
+ */
+bool ConfigINI::Parse(const std::string& path)
+{
+    Unmap();
+    sections.clear();
+    entries.clear();
+    sectionIds.clear();
+    keyIds.clear();
+    keyNames.clear();
+    for (int key = 0; key < CONFIG_KEY_LAST; key++)
+        InternKey(configKeyNames[key]);
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "ConfigINI: cannot open '%s': %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    mappingSize = size + 1;
+    void *addr = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr != MAP_FAILED && size > 0 &&
+        mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(addr, mappingSize);
+        addr = MAP_FAILED;
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "ConfigINI: cannot map '%s': %s\n", path.c_str(), strerror(errno));
+        mappingSize = 0;
+        return false;
+    }
+    mapping = (char *)addr;
+
+    /* about one entry per line */
+    size_t lines = 0;
+    for (const char *cur = mapping; (cur = (const char *)memchr(cur, '\n', mapping + size - cur)) != NULL; cur++)
+        lines++;
+    entries.reserve(lines + 1);
+
+    sections.push_back({ "", 0, 0 });
+    sectionIds[""] = 0;
+    lastSection = 0;
+
     /*  The format of the INI file  */
     IniFormat iniformat = INI_DEFAULT_FORMAT;
-    /*  Load the INI file  */
-    // intialize with root section
-    data[ROOT_SECTION_NAME] = map<string,string>();
-    auto loaded_ini = load_ini_path(path.c_str(), iniformat, NULL, &ConfigINI::ListenerCallback, &data);
-    if (loaded_ini) {
-
+    if (strip_ini_cache(mapping, size, iniformat, NULL, &ConfigINI::ListenerCallback, this)) {
         fprintf(stderr, "Sorry, something went wrong :-(\n");
-        return;
+        return false;
+    }
 
+    /* a section opened twice has its keys in two places */
+    auto bySection = [](const ConfigINIEntry &a, const ConfigINIEntry &b) { return a.section < b.section; };
+    if (!std::is_sorted(entries.begin(), entries.end(), bySection))
+        std::stable_sort(entries.begin(), entries.end(), bySection);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto &section = sections[entries[i].section];
+        if (section.count++ == 0)
+            section.first = i;
     }
+
+    return true;
 }
 
+const ConfigINISection *ConfigINI::FindSection(std::string_view name) const
+{
+    auto it = sectionIds.find(name);
+    return it == sectionIds.end() ? nullptr : &sections[it->second];
+}
+
+std::string_view ConfigINI::GetValue(const ConfigINISection &section, int key) const
+{
+    for (const ConfigINIEntry *entry = End(section); entry != Begin(section); ) {
+        --entry;
+        if (entry->key == key)
+            return entry->value;
+    }
+
+    return std::string_view();
+}
+
+int ConfigINI::InternKey(std::string_view name)
+{
+    auto it = keyIds.find(name);
+    if (it != keyIds.end())
+        return it->second;
+
+    int key = keyNames.size();
+    keyNames.push_back(name);
+    keyIds.emplace(name, key);
+    return key;
+}
+
+/* keys follow their section, the previous one is checked first */
+size_t ConfigINI::GetSection(std::string_view name)
+{
+    if (sections[lastSection].name == name)
+        return lastSection;
+
+    auto it = sectionIds.find(name);
+    if (it != sectionIds.end())
+        return lastSection = it->second;
+
+    lastSection = sections.size();
+    sections.push_back({ name, 0, 0 });
+    sectionIds.emplace(name, lastSection);
+    return lastSection;
+}
 
 int ConfigINI::ListenerCallback(IniDispatch * dispatch, void * user_data)
 {
-    IniParsedDataMap* data = (IniParsedDataMap *) user_data;
-
-    // printf(
-    //     "\ndispatch_id: %zu\n"
-    //     "format: {IniFormat}\n"
-    //     "type: %u\n"
-    //     "data: |%s|\n"
-    //     "value: |%s|\n"
-    //     "append_to: |%s|\n"
-    //     "d_len: %zu\n"
-    //     "v_len: %zu\n"
-    //     "at_len: %zu\n",
-
-    //     dispatch->dispatch_id,
-    //     dispatch->type,
-    //     dispatch->data,
-    //     dispatch->value,
-    //     *dispatch->append_to ? dispatch->append_to : ROOT_SECTION_NAME,
-    //     dispatch->d_len,
-    //     dispatch->v_len,
-    //     dispatch->at_len
-    // );
-    
+    ConfigINI* ini = (ConfigINI *) user_data;
+
     switch (dispatch->type)
     {
         case INI_SECTION:
         {
-            if(data->find(dispatch->data) == data->end())
-            {
-                (*data)[dispatch->data] = map<string,string>();
-            }
+            ini->GetSection(std::string_view(dispatch->data, dispatch->d_len));
             break;
         }
         case INI_KEY:
         {
-            auto appent_to = *dispatch->append_to ? dispatch->append_to : ROOT_SECTION_NAME;
-            auto section = data->find(appent_to);
-            if(section == data->end())
-                break;
-            
-            section->second[dispatch->data] = dispatch->value;
+            size_t section = ini->GetSection(std::string_view(dispatch->append_to, dispatch->at_len));
+            int key = ini->InternKey(std::string_view(dispatch->data, dispatch->d_len));
+
+            ini->entries.push_back({ section, key, std::string_view(dispatch->value, dispatch->v_len) });
             break;
         }
         default:
@@ -84,4 +178,4 @@ int ConfigINI::ListenerCallback(IniDispatch * dispatch, void * user_data)
             break;
     }
   return 0;
-}
\ No newline at end of file
+}
@@ -2,28 +2,92 @@
 #ifndef __CONFIGINI_HH__
 #define __CONFIGINI_HH__
 
-#include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <confini.h>
 
 namespace mdsd {
 
-#define ROOT_SECTION_NAME "{root}"
-typedef std::map<std::string, std::map<std::string, std::string>> IniParsedDataMap;
+/* Keys known to the config, interned first so their id is the enum value */
+typedef enum {
+    CONFIG_KEY_ALLOWED_TENANTS = 0,
+    CONFIG_KEY_PROVISIONING,
+    CONFIG_KEY_SOFT_QUOTA_CUSHION,
+    CONFIG_KEY_CPU,
+    CONFIG_KEY_CPU_MIN,
+    CONFIG_KEY_CPU_MAX,
+    CONFIG_KEY_MEMORY,
+    CONFIG_KEY_MEMORY_FLOOR,
 
+    CONFIG_KEY_LAST,    /* other keys get ids from here on */
+} ConfigKey;
+
+struct ConfigINIEntry {
+    size_t section;
+    int key;
+    std::string_view value;
+};
+
+struct ConfigINISection {
+    std::string_view name;  /* "" for the root section */
+    size_t first;           /* entries of the section are [first, first + count) */
+    size_t count;
+};
+
+/*
+ * Parsed INI file, flat and without copies.
+ *
+ * The file is mapped privately and tokenized in place by libconfini, so
+ * section names and values are string_views into the mapping. Keys are
+ * interned into small integer ids while parsing and every key of the file
+ * is one entry of a single array, grouped by section in file order. A key
+ * given twice in a section has two entries, the last one wins.
+ *
+ * The views are valid as long as the ConfigINI lives.
+ */
 class ConfigINI
 {
 public:
     ConfigINI();
     ~ConfigINI();
 
-    void Parse(const std::string& path, IniParsedDataMap& data);
+    ConfigINI(const ConfigINI&) = delete;
+    ConfigINI& operator=(const ConfigINI&) = delete;
+
+    /* Returns false when the file cannot be loaded */
+    bool Parse(const std::string& path);
+
+    /* The root section is always the first one */
+    const std::vector<ConfigINISection>& GetSections() const { return sections; }
+    const ConfigINISection *FindSection(std::string_view name) const;
+
+    const ConfigINIEntry *Begin(const ConfigINISection &section) const { return entries.data() + section.first; }
+    const ConfigINIEntry *End(const ConfigINISection &section) const { return Begin(section) + section.count; }
+
+    /* Last value of key in section, empty when not set */
+    std::string_view GetValue(const ConfigINISection &section, int key) const;
+
+    int InternKey(std::string_view name);
+    std::string_view GetKeyName(int key) const { return keyNames[key]; }
 
 private:
     static int ListenerCallback(IniDispatch * dispatch, void * user_data);
+    size_t GetSection(std::string_view name);
+    void Unmap();
+
+    char *mapping = nullptr;
+    size_t mappingSize = 0;
+
+    std::vector<ConfigINISection> sections;
+    std::vector<ConfigINIEntry> entries;
+    std::unordered_map<std::string_view, size_t> sectionIds;
+    std::unordered_map<std::string_view, int> keyIds;
+    std::vector<std::string_view> keyNames;
+    size_t lastSection = 0;
 };
 
 } // namespace mdsd
 
 #endif // __CONFIGINI_HH__
-
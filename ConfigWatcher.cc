@@ -0,0 +1,155 @@
+#include "ConfigWatcher.hh"
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <cassert>
+#include <stdexcept>
+
+using namespace mdsd;
+
+#define CONFIG_WATCH_SETTLE_MS 100 /* writes closer than this are one reload */
+#define CONFIG_WATCH_BUF_LEN 4096
+
+ConfigWatcher::ConfigWatcher(const std::string &path, const std::shared_ptr<const TenantConfigSet> &initial)
+    : path(path), snapshot(initial)
+{
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        dirName = ".";
+        fileName = path;
+    } else {
+        dirName = slash ? path.substr(0, slash) : "/";
+        fileName = path.substr(slash + 1);
+    }
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+        throw std::runtime_error("errno:" + std::to_string(errno) + ", cannot create inotify instance");
+
+    if (inotify_add_watch(inotifyFd, dirName.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        int err = errno;
+        close(inotifyFd);
+        throw std::runtime_error("errno:" + std::to_string(err) + ", cannot watch '" + dirName + "'");
+    }
+
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd < 0) {
+        int err = errno;
+        close(inotifyFd);
+        throw std::runtime_error("errno:" + std::to_string(err) + ", cannot create eventfd");
+    }
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    Stop();
+    close(stopFd);
+    close(inotifyFd);
+}
+
+void ConfigWatcher::OnReload(const ConfigReloadCallback &callback)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    reloadCallback = callback;
+}
+
+void ConfigWatcher::Start()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (thread.joinable())
+        return;
+
+    thread = std::thread(&ConfigWatcher::Run, this);
+}
+
+void ConfigWatcher::Stop()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!thread.joinable())
+        return;
+
+    /* the counter is drained after each stop, so only a signal can fail the write */
+    uint64_t one = 1;
+    ssize_t ret;
+    while ((ret = write(stopFd, &one, sizeof(one))) < 0 && errno == EINTR)
+        ;
+    assert(ret == sizeof(one));
+    thread.join();
+
+    /* drain it for a later Start() */
+    while (read(stopFd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+std::shared_ptr<const TenantConfigSet> ConfigWatcher::GetSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
+void ConfigWatcher::Run()
+{
+    struct pollfd fds[2] = {
+        { inotifyFd, POLLIN, 0 },
+        { stopFd, POLLIN, 0 },
+    };
+    alignas(struct inotify_event) char buf[CONFIG_WATCH_BUF_LEN];
+    bool pending = false;
+
+    for (;;)
+    {
+        /* once the file changed, wait for the writes to settle */
+        int n = poll(fds, 2, pending ? CONFIG_WATCH_SETTLE_MS : -1);
+        if (n < 0 && errno != EINTR)
+            return;
+
+        if (fds[1].revents & POLLIN)
+            return;
+
+        if (n == 0 && pending) {
+            pending = false;
+            Reload();
+            continue;
+        }
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        ssize_t len;
+        while ((len = read(inotifyFd, buf, sizeof(buf))) > 0)
+        {
+            for (char *cur = buf; cur < buf + len; )
+            {
+                auto *event = (struct inotify_event *)cur;
+                /* events were dropped, the file may have changed */
+                if (event->mask & IN_Q_OVERFLOW)
+                    pending = true;
+                else if (event->len && fileName == event->name)
+                    pending = true;
+                cur += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void ConfigWatcher::Reload()
+{
+    std::shared_ptr<const TenantConfigSet> next;
+
+    try {
+        next = TenantConfigSet::Load(path);
+    } catch (const std::exception &e) {
+        CONFIG_WARN("Failed to reload '" << path << "', keeping the current config: " << e.what());
+        return;
+    }
+
+    auto previous = std::atomic_load(&snapshot);
+    auto diff = TenantConfigSet::Diff(*previous, *next);
+    std::atomic_store(&snapshot, next);
+
+    if (!diff.Empty() && reloadCallback)
+        reloadCallback(*previous, *next, diff);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef __CONFIGWATCHER_HH__
+#define __CONFIGWATCHER_HH__
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "TenantConfigSet.hh"
+
+namespace mdsd {
+
+typedef std::function<void(const TenantConfigSet &from, const TenantConfigSet &to,
+                           const TenantConfigDiff &diff)> ConfigReloadCallback;
+
+/*
+ * Reloads the config file whenever it is rewritten.
+ *
+ * The directory of the file is watched with inotify, so a file replaced
+ * by a rename (as editors and config management tools do) is seen too.
+ * Writes in a burst are coalesced into one reload. The file is parsed in
+ * the watcher thread and the new set is published with an atomic pointer
+ * swap, GetSnapshot() never waits for a reload. A version that fails to
+ * load is logged and the previous one is kept.
+ */
+class ConfigWatcher
+{
+public:
+    ConfigWatcher(const std::string &path, const std::shared_ptr<const TenantConfigSet> &initial);
+    ~ConfigWatcher();
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    /* Called by the watcher thread once a new set is published, only when
+       some tenant changed. Must be set before Start(). */
+    void OnReload(const ConfigReloadCallback &callback);
+
+    void Start();
+    void Stop();
+
+    std::shared_ptr<const TenantConfigSet> GetSnapshot() const;
+
+private:
+    void Run();
+    void Reload();
+
+    const std::string path;
+    std::string dirName;
+    std::string fileName;
+    ConfigReloadCallback reloadCallback;
+
+    int inotifyFd = -1;
+    int stopFd = -1;    /* eventfd */
+    std::thread thread;
+    std::mutex lock;
+
+    std::shared_ptr<const TenantConfigSet> snapshot;
+};
+
+} // namespace mdsd
+
+#endif // __CONFIGWATCHER_HH__
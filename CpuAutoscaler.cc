@@ -0,0 +1,222 @@
+#include "CpuAutoscaler.hh"
+
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+using namespace mdsd;
+
+#define PROC_STAT_PATH "/proc/stat"
+
+CpuAutoscaler::CpuAutoscaler(const std::vector<std::shared_ptr<Cgroup>> &cgroups,
+                             const std::vector<CpuAutoscalerBounds> &bounds,
+                             const CpuAutoscalerConfig &config)
+    : config(config)
+{
+    if (cgroups.size() != bounds.size())
+        throw CGroupBaseException("CpuAutoscaler needs one bounds entry per cgroup");
+
+    for (size_t i = 0; i < cgroups.size(); i++)
+        Add(i, cgroups[i], bounds[i]);
+
+    procStatFd = open(PROC_STAT_PATH, O_RDONLY | O_CLOEXEC);
+    if (procStatFd < 0)
+        CGROUP_ERROR("errno:" << errno << ", cannot open " PROC_STAT_PATH ", tenants will not be scaled up");
+    else
+        ReadHostCpu(hostIdle, hostTotal);
+}
+
+CpuAutoscaler::~CpuAutoscaler()
+{
+    if (procStatFd >= 0)
+        close(procStatFd);
+}
+
+/* "cpu  user nice system idle iowait irq softirq steal guest guest_nice",
+   guest time is already accounted in user */
+bool CpuAutoscaler::ReadHostCpu(unsigned long long &idle, unsigned long long &total)
+{
+    char buf[CGROUP_MAX_VAL];
+    ssize_t n = pread(procStatFd, buf, sizeof(buf), 0);
+    if (n < 5 || memcmp(buf, "cpu ", 4) != 0)
+        return false;
+
+    const char *cur = buf + 4;
+    const char *end = buf + n;
+    idle = total = 0;
+    for (int field = 0; field < 8; field++)
+    {
+        unsigned long long value;
+        while (cur < end && *cur == ' ')
+            cur++;
+
+        auto res = std::from_chars(cur, end, value);
+        if (res.ec != std::errc())
+            return false;
+        cur = res.ptr;
+
+        total += value;
+        if (field == 3 || field == 4)
+            idle += value;
+    }
+
+    return true;
+}
+
+void CpuAutoscaler::Add(unsigned long long cookie, const std::shared_ptr<Cgroup> &cgroup,
+                        const CpuAutoscalerBounds &bounds)
+{
+    if (byCookie.count(cookie))
+        throw CGroupBaseException("CpuAutoscaler cookie " + std::to_string(cookie) + " added twice");
+
+    Tenant tenant;
+    tenant.cookie = cookie;
+    tenant.cgroup = cgroup;
+    tenant.bounds = bounds;
+    LoadQuota(tenant);
+
+    byCookie[cookie] = tenants.size();
+    tenants.push_back(tenant);
+}
+
+void CpuAutoscaler::Remove(unsigned long long cookie)
+{
+    auto it = byCookie.find(cookie);
+    if (it == byCookie.end())
+        return;
+
+    size_t i = it->second;
+    byCookie.erase(it);
+    if (i + 1 < tenants.size()) {
+        tenants[i] = std::move(tenants.back());
+        byCookie[tenants[i].cookie] = i;
+    }
+    tenants.pop_back();
+}
+
+void CpuAutoscaler::UpdateBounds(unsigned long long cookie, const CpuAutoscalerBounds &bounds)
+{
+    auto it = byCookie.find(cookie);
+    if (it == byCookie.end())
+        return;
+
+    Tenant &tenant = tenants[it->second];
+    tenant.bounds = bounds;
+    LoadQuota(tenant);
+}
+
+void CpuAutoscaler::LoadQuota(Tenant &tenant)
+{
+    tenant.upCount = tenant.downCount = 0;
+    try {
+        tenant.quota = tenant.cgroup->backend->GetCpuCfsQuota();
+    } catch (const CGroupBaseException &e) {
+        CGROUP_ERROR("CPU autoscaler: " << e.what());
+        tenant.quota = -1;
+    }
+
+    /* -1 on v1, "max" on v2 */
+    tenant.enabled = tenant.quota >= 0 && tenant.quota != CGROUP_CPU_QUOTA_UNLIMITED &&
+                     tenant.bounds.minQuota < tenant.bounds.maxQuota;
+}
+
+void CpuAutoscaler::Update(const CgroupSampleSnapshot &snapshot)
+{
+    if (snapshot.samples.size() != snapshot.cookies.size())
+        return;
+
+    double hostIdleRatio = 0;
+    unsigned long long idle, total;
+    if (procStatFd >= 0 && ReadHostCpu(idle, total)) {
+        if (total > hostTotal)
+            hostIdleRatio = double(idle - hostIdle) / (total - hostTotal);
+        hostIdle = idle;
+        hostTotal = total;
+    }
+
+    /* samples of tenants removed meanwhile are skipped, new ones start with this one */
+    decisions.clear();
+    for (size_t t = 0; t < snapshot.samples.size(); t++)
+    {
+        auto it = byCookie.find(snapshot.cookies[t]);
+        if (it == byCookie.end())
+            continue;
+
+        Tenant &tenant = tenants[it->second];
+        if (tenant.hasPrevious)
+            Evaluate(it->second, snapshot.samples[t], hostIdleRatio);
+        tenant.previous = snapshot.samples[t];
+        tenant.hasPrevious = true;
+    }
+
+    std::sort(decisions.begin(), decisions.end(), [](const Decision &a, const Decision &b) {
+        return a.priority > b.priority;
+    });
+    if (decisions.size() > config.writeBudget) {
+        CGROUP_DEBUG("CPU autoscaler: " << decisions.size() - config.writeBudget << " quota updates deferred");
+        decisions.resize(config.writeBudget);
+    }
+
+    for (const auto &decision : decisions)
+    {
+        Tenant &tenant = tenants[decision.tenant];
+        try {
+            tenant.cgroup->backend->SetCpuCfsQuota(decision.quota);
+        } catch (const CGroupBaseException &e) {
+            CGROUP_ERROR("CPU autoscaler: " << e.what());
+            continue;
+        }
+
+        CGROUP_DEBUG("CPU autoscaler: '" << tenant.cgroup->backend->GetRelativeBasePath(CGROUP_CONTROLLER_CPU)
+                     << "' quota " << tenant.quota << " -> " << decision.quota);
+        tenant.quota = decision.quota;
+        tenant.upCount = tenant.downCount = 0;
+    }
+}
+
+void CpuAutoscaler::Evaluate(size_t i, const CgroupUsageSample &cur, double hostIdleRatio)
+{
+    Tenant &tenant = tenants[i];
+    const CgroupUsageSample &prev = tenant.previous;
+
+    if (!tenant.enabled || !(prev.valid & cur.valid & CGROUP_SAMPLE_CPU_STAT))
+        return;
+
+    /* counters restart when the group is recreated */
+    if (cur.cpuStat.nrPeriods < prev.cpuStat.nrPeriods || cur.cpuStat.usageUsec < prev.cpuStat.usageUsec)
+        return;
+
+    /* nr_periods only counts the periods the group was runnable in */
+    unsigned long long periods = cur.cpuStat.nrPeriods - prev.cpuStat.nrPeriods;
+    double throttleRatio = periods ? double(cur.cpuStat.nrThrottled - prev.cpuStat.nrThrottled) / periods : 0;
+    double utilization = periods ? double(cur.cpuStat.usageUsec - prev.cpuStat.usageUsec) / (double(tenant.quota) * periods) : 0;
+
+    bool hostBusy = hostIdleRatio < config.minHostIdle;
+    long long floor = tenant.bounds.minQuota;
+
+    if (throttleRatio >= config.upThrottleRatio && !hostBusy) {
+        tenant.upCount++;
+        tenant.downCount = 0;
+    } else if (hostBusy && tenant.quota > tenant.bounds.baseQuota) {
+        tenant.downCount++;
+        tenant.upCount = 0;
+        floor = std::max(floor, tenant.bounds.baseQuota);
+    } else if (throttleRatio <= config.downThrottleRatio && utilization < config.downUtilization) {
+        tenant.downCount++;
+        tenant.upCount = 0;
+    } else {
+        /* in between the thresholds, keep the quota */
+        tenant.upCount = tenant.downCount = 0;
+    }
+
+    if (tenant.upCount >= config.upCycles && tenant.quota < tenant.bounds.maxQuota) {
+        long long quota = std::min<long long>(tenant.bounds.maxQuota, tenant.quota * (1 + config.upStep));
+        decisions.push_back({ i, quota, 1 + throttleRatio });
+    } else if (tenant.downCount >= config.downCycles && tenant.quota > floor) {
+        long long quota = std::max<long long>(floor, tenant.quota * (1 - config.downStep));
+        decisions.push_back({ i, quota, hostBusy ? 1.0 : 1 - utilization });
+    }
+}
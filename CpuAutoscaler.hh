@@ -0,0 +1,105 @@
+#pragma once
+#ifndef __CPUAUTOSCALER_HH__
+#define __CPUAUTOSCALER_HH__
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Cgroup.hh"
+#include "CgroupSampler.hh"
+
+namespace mdsd {
+
+/* Quotas are in usec per cfs period, as for SetCpuCfsQuota() */
+struct CpuAutoscalerBounds {
+    long long baseQuota;    /* configured quota, given back first when the host gets busy */
+    long long minQuota;
+    long long maxQuota;
+};
+
+struct CpuAutoscalerConfig {
+    double upThrottleRatio = 0.10;      /* throttled periods / periods to scale up */
+    double downThrottleRatio = 0.01;    /* ... and to scale down */
+    double downUtilization = 0.50;      /* usage / quota under which to scale down */
+    double minHostIdle = 0.20;          /* idle host cpu needed to scale up */
+    double upStep = 0.25;
+    double downStep = 0.10;
+    unsigned int upCycles = 1;          /* consecutive cycles before acting */
+    unsigned int downCycles = 5;
+    unsigned int writeBudget = 16;      /* quota writes per cycle */
+};
+
+/*
+ * Adjusts the cfs quota of tenants from their throttling.
+ *
+ * Fed with the snapshots of a CgroupSampler, it compares the cpu.stat
+ * counters of consecutive snapshots: a tenant throttled in more than
+ * upThrottleRatio of its periods gets upStep more quota, as long as the
+ * host has minHostIdle cpu left, and a tenant that is neither throttled
+ * nor using half of its quota for downCycles cycles gives downStep back.
+ * When the host gets busy, tenants above their base quota are scaled back
+ * to it. Quotas always stay within [minQuota, maxQuota].
+ *
+ * Decisions need several consecutive cycles (hysteresis) and at most
+ * writeBudget quotas are written per cycle, the most throttled tenants
+ * first. Deferred decisions are retried on the next cycle.
+ *
+ * Tenants are matched to the samples by the cookie they were added to the
+ * sampler with. Update() must not run concurrently with the sampler
+ * workers, which is the case when called from CgroupSampler::OnCycle(),
+ * nor with Add(), Remove() and UpdateBounds(): callers serialize them.
+ */
+class CpuAutoscaler
+{
+public:
+    /* cgroups are added with their index as cookie, as by the CgroupSampler constructor */
+    CpuAutoscaler(const std::vector<std::shared_ptr<Cgroup>> &cgroups,
+                  const std::vector<CpuAutoscalerBounds> &bounds,
+                  const CpuAutoscalerConfig &config = CpuAutoscalerConfig());
+    ~CpuAutoscaler();
+
+    /* The current quota is the starting point, tenants with an unlimited quota are skipped */
+    void Add(unsigned long long cookie, const std::shared_ptr<Cgroup> &cgroup, const CpuAutoscalerBounds &bounds);
+    void Remove(unsigned long long cookie);
+    /* New bounds, the quota is read again since it may have been written meanwhile */
+    void UpdateBounds(unsigned long long cookie, const CpuAutoscalerBounds &bounds);
+
+    void Update(const CgroupSampleSnapshot &snapshot);
+
+private:
+    struct Tenant {
+        unsigned long long cookie;
+        std::shared_ptr<Cgroup> cgroup;
+        CpuAutoscalerBounds bounds;
+        long long quota;
+        unsigned int upCount = 0;
+        unsigned int downCount = 0;
+        bool enabled;
+        bool hasPrevious = false;
+        CgroupUsageSample previous;
+    };
+
+    struct Decision {
+        size_t tenant;
+        long long quota;
+        double priority;
+    };
+
+    bool ReadHostCpu(unsigned long long &idle, unsigned long long &total);
+    void LoadQuota(Tenant &tenant);
+    void Evaluate(size_t i, const CgroupUsageSample &cur, double hostIdleRatio);
+
+    const CpuAutoscalerConfig config;
+    std::vector<Tenant> tenants;
+    std::unordered_map<unsigned long long, size_t> byCookie;    /* index in tenants */
+    std::vector<Decision> decisions;
+
+    int procStatFd;
+    unsigned long long hostIdle = 0;
+    unsigned long long hostTotal = 0;
+};
+
+} // namespace mdsd
+
+#endif // __CPUAUTOSCALER_HH__
@@ -0,0 +1,85 @@
+#include "LimitSet.hh"
+#include "CgroupBackend.hh"
+
+#include <sstream>
+#include <unistd.h>
+
+using namespace mdsd;
+
+bool LimitSet::Empty() const
+{
+    return !cpuQuota && !cpuPeriod && !cpuShares &&
+           !memoryHardLimit && !memorySoftLimit && !memSwapHardLimit;
+}
+
+bool LimitSet::operator==(const LimitSet &other) const
+{
+    return cpuQuota == other.cpuQuota && cpuPeriod == other.cpuPeriod && cpuShares == other.cpuShares &&
+           memoryHardLimit == other.memoryHardLimit && memorySoftLimit == other.memorySoftLimit &&
+           memSwapHardLimit == other.memSwapHardLimit;
+}
+
+static bool SameMemoryLimit(unsigned long long kb, unsigned long long current)
+{
+    static const unsigned long long pageKB = sysconf(_SC_PAGESIZE) >> 10;
+
+    /* v1 reports an unlimited value rounded down to a page too */
+    if (kb >= (unsigned long long)CGROUP_MEMORY_PARAM_UNLIMITED)
+        return current / pageKB >= (unsigned long long)CGROUP_MEMORY_PARAM_UNLIMITED / pageKB;
+
+    return kb / pageKB == current / pageKB;
+}
+
+LimitSet LimitSet::Diff(const LimitSet &current) const
+{
+    LimitSet diff;
+
+    if (cpuQuota && (!current.cpuQuota || *cpuQuota != *current.cpuQuota))
+        diff.cpuQuota = cpuQuota;
+    if (cpuPeriod && (!current.cpuPeriod || *cpuPeriod != *current.cpuPeriod))
+        diff.cpuPeriod = cpuPeriod;
+    if (cpuShares && (!current.cpuShares || *cpuShares != *current.cpuShares))
+        diff.cpuShares = cpuShares;
+
+    if (memoryHardLimit && (!current.memoryHardLimit || !SameMemoryLimit(*memoryHardLimit, *current.memoryHardLimit)))
+        diff.memoryHardLimit = memoryHardLimit;
+    if (memorySoftLimit && (!current.memorySoftLimit || !SameMemoryLimit(*memorySoftLimit, *current.memorySoftLimit)))
+        diff.memorySoftLimit = memorySoftLimit;
+    if (memSwapHardLimit && (!current.memSwapHardLimit || !SameMemoryLimit(*memSwapHardLimit, *current.memSwapHardLimit)))
+        diff.memSwapHardLimit = memSwapHardLimit;
+
+    return diff;
+}
+
+/* Per value ranges are checked by the backend, only cross checks here */
+void LimitSet::Validate() const
+{
+    for (auto kb : { memoryHardLimit, memorySoftLimit, memSwapHardLimit }) {
+        if (kb && *kb > (unsigned long long)CGROUP_MEMORY_PARAM_UNLIMITED)
+            throw CGroupMemoryException("Memory '" + std::to_string(*kb) + "' must be less than "
+                        + std::to_string(CGROUP_MEMORY_PARAM_UNLIMITED));
+    }
+
+    /* an unlimited soft limit only leaves reclaim to the hard limit */
+    if (memoryHardLimit && memorySoftLimit && *memorySoftLimit > *memoryHardLimit &&
+        *memorySoftLimit != (unsigned long long)CGROUP_MEMORY_PARAM_UNLIMITED)
+        throw CGroupMemoryException("Memory soft limit '" + std::to_string(*memorySoftLimit)
+                    + "' must not exceed hard limit '" + std::to_string(*memoryHardLimit) + "'");
+
+    if (cpuShares && *cpuShares == 0)
+        throw CGroupCPUException("cpu shares must be greater than 0");
+}
+
+std::string LimitSet::ToString() const
+{
+    std::ostringstream out;
+    if (cpuQuota) out << " cpuQuota=" << *cpuQuota;
+    if (cpuPeriod) out << " cpuPeriod=" << *cpuPeriod;
+    if (cpuShares && *cpuShares == CGROUP_CPU_SHARES_DEFAULT) out << " cpuShares=default";
+    else if (cpuShares) out << " cpuShares=" << *cpuShares;
+    if (memoryHardLimit) out << " memoryHardLimit=" << *memoryHardLimit << "KB";
+    if (memorySoftLimit) out << " memorySoftLimit=" << *memorySoftLimit << "KB";
+    if (memSwapHardLimit) out << " memSwapHardLimit=" << *memSwapHardLimit << "KB";
+
+    return out.str();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef __LIMITSET_HH__
+#define __LIMITSET_HH__
+
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace mdsd {
+
+/*
+ * A set of cpu and memory limits for one cgroup, applied in one go by
+ * CgroupBackend::SetLimits(). Only the fields that are set are written.
+ *
+ * Memory values are in KB, cpu quota and period in microseconds, as for
+ * the individual CgroupBackend setters. cpuShares may be
+ * CGROUP_CPU_SHARES_DEFAULT for the default of the backend.
+ */
+class LimitSet
+{
+public:
+    std::optional<long long> cpuQuota;
+    std::optional<unsigned long long> cpuPeriod;
+    std::optional<unsigned long long> cpuShares;
+
+    std::optional<unsigned long long> memoryHardLimit;
+    std::optional<unsigned long long> memorySoftLimit;
+    std::optional<unsigned long long> memSwapHardLimit;
+
+    bool Empty() const;
+
+    bool operator==(const LimitSet &other) const;
+    bool operator!=(const LimitSet &other) const { return !(*this == other); }
+
+    /* The limits of this set that differ from current, memory values are
+       compared in pages as the kernel rounds them down */
+    LimitSet Diff(const LimitSet &current) const;
+
+    /* Check the values against each other, throws CGroupBaseException */
+    void Validate() const;
+
+    std::string ToString() const;
+};
+
+/* One interface file write planned by CgroupBackend::PlanLimits() */
+struct CgroupLimitWrite {
+    int controller;
+    int fileType;               /* CgroupControllerFile */
+    std::string value;
+    std::string previous;       /* set when PlanLimits() read it anyway, to decide the order */
+    bool hasPrevious;
+
+    CgroupLimitWrite(int controller, int fileType, const std::string &value = std::string())
+        : controller(controller), fileType(fileType), value(value), hasPrevious(false) {}
+
+    void SetPrevious(const std::string &value)
+    {
+        previous = value;
+        hasPrevious = true;
+    }
+};
+typedef std::vector<CgroupLimitWrite> CgroupLimitPlan;
+
+} // namespace mdsd
+
+#endif // __LIMITSET_HH__
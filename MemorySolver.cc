@@ -0,0 +1,71 @@
+#include "MemorySolver.hh"
+#include "CgroupDef.hh"
+
+#include <algorithm>
+
+using namespace mdsd;
+
+std::vector<double> MemorySolver::Solve(const std::vector<MemoryDemand> &demands, double budget)
+{
+    std::vector<double> result(demands.size());
+    double totalRequest = 0;
+    double totalFloor = 0;
+
+    for (const auto &demand : demands) {
+        totalRequest += demand.request;
+        totalFloor += std::min(demand.floor, demand.request);
+    }
+
+    if (totalRequest <= budget) {
+        for (size_t i = 0; i < demands.size(); i++)
+            result[i] = demands[i].request;
+        return result;
+    }
+
+    if (totalFloor >= budget) {
+        CGROUP_ERROR("Memory floors (" << totalFloor << "MB) exceed the budget (" << budget << "MB), scaling them down");
+        for (size_t i = 0; i < demands.size(); i++)
+            result[i] = std::min(demands[i].floor, demands[i].request) * budget / totalFloor;
+        return result;
+    }
+
+    /* a tenant starts rising above its floor at floor/weight and stops at
+       request/weight, between two such breakpoints the total is linear */
+    struct Breakpoint {
+        double level;
+        double slope;
+    };
+    std::vector<Breakpoint> breakpoints;
+    breakpoints.reserve(demands.size() * 2);
+    for (const auto &demand : demands) {
+        double floor = std::min(demand.floor, demand.request);
+        breakpoints.push_back({ floor / demand.weight, demand.weight });
+        breakpoints.push_back({ demand.request / demand.weight, -demand.weight });
+    }
+    std::sort(breakpoints.begin(), breakpoints.end(), [](const Breakpoint &a, const Breakpoint &b) {
+        return a.level < b.level || (a.level == b.level && a.slope > b.slope);
+    });
+
+    double level = 0;
+    double total = totalFloor;
+    double slope = 0;
+    for (const auto &breakpoint : breakpoints)
+    {
+        double next = total + slope * (breakpoint.level - level);
+        if (next >= budget)
+            break;
+
+        total = next;
+        level = breakpoint.level;
+        slope += breakpoint.slope;
+    }
+    /* totalRequest > budget, so the loop always stops with slope > 0 */
+    level += (budget - total) / slope;
+
+    for (size_t i = 0; i < demands.size(); i++) {
+        const auto &demand = demands[i];
+        result[i] = std::min(demand.request, std::max(std::min(demand.floor, demand.request), demand.weight * level));
+    }
+
+    return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef __MEMORYSOLVER_HH__
+#define __MEMORYSOLVER_HH__
+
+#include <vector>
+
+namespace mdsd {
+
+/* What one tenant asks for, all values in MB */
+struct MemoryDemand {
+    double request;
+    double floor;       /* guaranteed share, capped to request */
+    double weight;      /* 1 + SoftQuotaCushion/100 */
+};
+
+/*
+ * Fits the memory requests of the tenants into a budget with weighted
+ * max-min fairness (water-filling).
+ *
+ * A rising water level L gives every tenant min(request, max(floor,
+ * weight * L)), L is the highest level whose allocations still fit in the
+ * budget. Tenants asking for less than their fair share keep their whole
+ * request and the rest is shared among the others in proportion to their
+ * weight, so a larger SoftQuotaCushion also buys a larger share. When the
+ * floors alone exceed the budget they are scaled down proportionally.
+ *
+ * The result applies to the soft (configured) limit, the hard limit keeps
+ * its cushion on top of it.
+ */
+class MemorySolver
+{
+public:
+    /* Returns the allocation of every demand, in order */
+    static std::vector<double> Solve(const std::vector<MemoryDemand> &demands, double budget);
+};
+
+} // namespace mdsd
+
+#endif // __MEMORYSOLVER_HH__
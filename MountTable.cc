@@ -0,0 +1,128 @@
+#include "MountTable.hh"
+#include "CgroupDef.hh"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <algorithm>
+#include <fstream>
+
+#include <boost/algorithm/string.hpp>
+
+using namespace mdsd;
+using namespace boost::algorithm;
+
+MountTable::MountTable()
+{
+    fd = open(PROC_MOUNTINFO_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        CGROUP_ERROR("errno=" << errno << " Unable to open " << PROC_MOUNTINFO_PATH);
+}
+
+MountTable::~MountTable()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+MountTable &MountTable::Instance()
+{
+    static MountTable table;
+    return table;
+}
+
+std::shared_ptr<const MountTableSnapshot> MountTable::Get()
+{
+    MountTable &table = Instance();
+    std::lock_guard<std::mutex> guard(table.lock);
+
+    if (!table.snapshot || table.Changed())
+        table.snapshot = table.Parse();
+
+    return table.snapshot;
+}
+
+/* mountinfo reports POLLERR|POLLPRI once per change of the mount table */
+bool MountTable::Changed()
+{
+    if (fd < 0)
+        return false;
+
+    struct pollfd pfd = { fd, POLLPRI, 0 };
+    if (poll(&pfd, 1, 0) < 0)
+        return false;
+
+    return pfd.revents & (POLLERR | POLLPRI);
+}
+
+/* Paths in mountinfo have space, tab, newline and backslash escaped as \ooo */
+static std::string UnescapeMountPath(const std::string &path)
+{
+    std::string out;
+    out.reserve(path.size());
+
+    for (size_t i = 0; i < path.size(); i++) {
+        if (path[i] == '\\' && i + 3 < path.size() && isdigit(path[i + 1])) {
+            out += (char)std::stoi(path.substr(i + 1, 3), nullptr, 8);
+            i += 3;
+        } else {
+            out += path[i];
+        }
+    }
+
+    return out;
+}
+
+/*
+ * 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+ * (1)(2)(3)   (4)   (5)      (6)      (7)   (8) (9)   (10)         (11)
+ */
+std::shared_ptr<const MountTableSnapshot> MountTable::Parse()
+{
+    auto table = std::make_shared<MountTableSnapshot>();
+    std::string content;
+    char buf[4096];
+    ssize_t n;
+
+    if (fd < 0 || lseek(fd, 0, SEEK_SET) < 0)
+        return table;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        content.append(buf, n);
+
+    std::vector<std::string> lines;
+    split(lines, content, is_any_of("\n"), token_compress_on);
+
+    for (const auto &line : lines)
+    {
+        std::vector<std::string> fields;
+        split(fields, line, is_any_of(" "));
+
+        auto sep = std::find(fields.begin(), fields.end(), "-");
+        if (fields.size() < 6 || sep == fields.end() || fields.end() - sep < 4)
+            continue;
+
+        MountEntry entry;
+        entry.dir = UnescapeMountPath(fields[4]);
+        entry.type = *(sep + 1);
+        entry.opts = fields[5];
+
+        /* super block options without the leading rw/ro, like /proc/mounts */
+        auto superOpts = *(sep + 3);
+        auto comma = superOpts.find(',');
+        if (comma != std::string::npos)
+            entry.opts += superOpts.substr(comma);
+
+        /* Systemd uses cgroup v2 for process tracking but no controller is
+         * available, remember which controllers are there */
+        if (entry.type == "cgroup2") {
+            std::ifstream file(entry.dir + "/cgroup.controllers");
+            getline(file, entry.controllers, '\n');
+        }
+
+        table->push_back(entry);
+    }
+
+    return table;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef __MOUNTTABLE_HH__
+#define __MOUNTTABLE_HH__
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mdsd {
+
+struct MountEntry {
+    std::string type;        /* e.g. "cgroup2" */
+    std::string dir;         /* e.g. "/sys/fs/cgroup" */
+    std::string opts;        /* mount and super block options, as in /proc/mounts */
+    std::string controllers; /* cgroup2 only: content of cgroup.controllers */
+};
+
+typedef std::vector<MountEntry> MountTableSnapshot;
+
+/*
+ * Process wide view of /proc/self/mountinfo shared by all backends.
+ *
+ * The table is parsed once and kept as an immutable snapshot, which is only
+ * rebuilt when poll() on the mountinfo fd reports that the mount table of
+ * our namespace changed.
+ */
+class MountTable
+{
+public:
+    static std::shared_ptr<const MountTableSnapshot> Get();
+
+private:
+    MountTable();
+    ~MountTable();
+
+    static MountTable &Instance();
+    bool Changed();
+    std::shared_ptr<const MountTableSnapshot> Parse();
+
+    const char* PROC_MOUNTINFO_PATH = "/proc/self/mountinfo";
+
+    int fd = -1;
+    std::mutex lock;
+    std::shared_ptr<const MountTableSnapshot> snapshot;
+};
+
+} // namespace mdsd
+
+#endif // __MOUNTTABLE_HH__
@@ -1,55 +1,106 @@
 #include "TenantConfig.hh"
 #include <iostream>
 #include <exception>
-#include <boost/algorithm/string.hpp>
+#include <charconv>
+#include <cctype>
+#include <stdexcept>
+#include <strings.h>
 
 using namespace mdsd;
 using namespace std;
-using namespace boost::algorithm;
 
-TenantConfig::TenantConfig(const std::string& name, unsigned int softquota)
-: name(name), softquota(softquota)
+TenantConfig::TenantConfig(const std::string& name, unsigned int softquota, unsigned int memoryFloor,
+                           TenantUnitMeasure memoryFloorUnit)
+: name(name), softquota(softquota), cpu(0), cpuUnit(CONFINIT_UNIT_PERCENTAGE), cpuMin(0), cpuMax(0),
+  memory(0), memoryUnit(CONFINIT_UNIT_MEGABYTE), memoryFloor(memoryFloor), memoryFloorUnit(memoryFloorUnit)
 {}
 
-int TenantConfig::ParseUnitMeasure(const std::string& val, std::string& out)
+bool TenantConfig::operator==(const TenantConfig& other) const
 {
-    std::string value = to_lower_copy(val);
-    out = value;
-    if (ends_with(value, "%")){
-        replace_all(out, "%", "");
-        return CONFINIT_UNIT_PERCENTAGE;
-    } else if(ends_with(value, "mb")) {
-        replace_all(out, "mb", "");
-        return CONFINIT_UNIT_MEGABYTE;
-    } else if(ends_with(value, "kb")) {
-        replace_all(out, "kb", "");
-        return CONFINIT_UNIT_KILOBYTE;
+    return name == other.name && softquota == other.softquota &&
+           cpu == other.cpu && cpuUnit == other.cpuUnit && cpuMin == other.cpuMin && cpuMax == other.cpuMax &&
+           memory == other.memory && memoryUnit == other.memoryUnit &&
+           memoryFloor == other.memoryFloor && memoryFloorUnit == other.memoryFloorUnit;
+}
+
+static bool EndsWithNoCase(std::string_view value, std::string_view suffix)
+{
+    return value.size() >= suffix.size() &&
+           strncasecmp(value.data() + value.size() - suffix.size(), suffix.data(), suffix.size()) == 0;
+}
+
+static std::string_view Trim(std::string_view value)
+{
+    while (!value.empty() && isspace((unsigned char)value.front()))
+        value.remove_prefix(1);
+    while (!value.empty() && isspace((unsigned char)value.back()))
+        value.remove_suffix(1);
+    return value;
+}
+
+int TenantConfig::ParseUnitMeasure(std::string_view val, unsigned int& out)
+{
+    std::string_view value = Trim(val);
+    int unit = -1;
+
+    if (EndsWithNoCase(value, "%")) {
+        unit = CONFINIT_UNIT_PERCENTAGE;
+        value.remove_suffix(1);
+    } else if (EndsWithNoCase(value, "mb")) {
+        unit = CONFINIT_UNIT_MEGABYTE;
+        value.remove_suffix(2);
+    } else if (EndsWithNoCase(value, "kb")) {
+        unit = CONFINIT_UNIT_KILOBYTE;
+        value.remove_suffix(2);
     }
 
-    return -1;
+    value = Trim(value);
+    auto res = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (res.ec != std::errc() || res.ptr != value.data() + value.size())
+        throw std::invalid_argument("invalid number '" + std::string(val) + "'");
+
+    return unit;
 }
-void TenantConfig::ApplyConfig(const std::map<std::string, std::string>& config)
+
+void TenantConfig::ApplyConfig(const ConfigINI& ini, const ConfigINISection& section)
 {
-    for (map<string, string>::const_iterator it = config.begin(); it != config.end(); ++it)
+    for (const ConfigINIEntry *entry = ini.Begin(section); entry != ini.End(section); ++entry)
     {
-        std::string value_without_unit;
-        auto unit = ParseUnitMeasure(it->second, value_without_unit);
+        unsigned int value;
 
-        if (it->first == "SoftQuotaCushion") {
-            softquota = stoul(value_without_unit);
-        }
-        else if (it->first == "CPU")
-        {
-            cpuUnit = CONFINIT_UNIT_PERCENTAGE;
-            cpu = stoul(value_without_unit);
-        }
-        else if (it->first == "Memory")
+        switch (entry->key)
         {
-            if (unit < 0)
-                CONFIG_WARN("For tenant '" << this->name << "', failing to parse unit of '"
-                    << it->first << "' field, value='" << it->second <<"', falling back to default");
-            memoryUnit = static_cast<TenantUnitMeasure>(unit >= 0 ? unit : CONFINIT_UNIT_MEGABYTE);
-            memory = stoul(value_without_unit);
+            case CONFIG_KEY_SOFT_QUOTA_CUSHION:
+                ParseUnitMeasure(entry->value, softquota);
+                break;
+            case CONFIG_KEY_CPU:
+                ParseUnitMeasure(entry->value, cpu);
+                cpuUnit = CONFINIT_UNIT_PERCENTAGE;
+                break;
+            case CONFIG_KEY_CPU_MIN:
+                ParseUnitMeasure(entry->value, cpuMin);
+                break;
+            case CONFIG_KEY_CPU_MAX:
+                ParseUnitMeasure(entry->value, cpuMax);
+                break;
+            case CONFIG_KEY_MEMORY:
+            case CONFIG_KEY_MEMORY_FLOOR:
+            {
+                int unit = ParseUnitMeasure(entry->value, value);
+                if (unit < 0)
+                    CONFIG_WARN("For tenant '" << this->name << "', failing to parse unit of '"
+                        << ini.GetKeyName(entry->key) << "' field, value='" << entry->value <<"', falling back to default");
+
+                auto measure = static_cast<TenantUnitMeasure>(unit >= 0 ? unit : CONFINIT_UNIT_MEGABYTE);
+                if (entry->key == CONFIG_KEY_MEMORY) {
+                    memoryUnit = measure;
+                    memory = value;
+                } else {
+                    memoryFloorUnit = measure;
+                    memoryFloor = value;
+                }
+                break;
+            }
         }
     }
 }
@@ -2,10 +2,12 @@
 #ifndef __TENANTCONFIG_HH__
 #define __TENANTCONFIG_HH__
 
-#include <map>
 #include <string>
+#include <string_view>
 #include <iostream>
 
+#include "ConfigINI.hh"
+
 #define CONFIG_WARN(error) std::cerr << "WARN: " << error << std::endl
 
 namespace mdsd {
@@ -23,17 +25,28 @@ public:
     unsigned int softquota;
     unsigned int cpu;
     TenantUnitMeasure cpuUnit;
+    unsigned int cpuMin;    /* autoscaler bounds, 0 when not configured */
+    unsigned int cpuMax;
     unsigned int memory;
     TenantUnitMeasure memoryUnit;
+    unsigned int memoryFloor;
+    TenantUnitMeasure memoryFloorUnit;
+
+    TenantConfig(const std::string& name, unsigned int softquota = 0, unsigned int memoryFloor = 0,
+                 TenantUnitMeasure memoryFloorUnit = CONFINIT_UNIT_MEGABYTE);
 
-    TenantConfig(const std::string& name, unsigned int softquota = 0);
+    /* "20MB", "512kb", "70%" or a bare number. Returns the unit, -1 when
+       there is none, throws std::invalid_argument when there is no number. */
+    static int ParseUnitMeasure(std::string_view val, unsigned int& out);
 
-    int ParseUnitMeasure(const std::string& val, std::string& out);
+    void ApplyConfig(const ConfigINI& ini, const ConfigINISection& section);
 
-    void ApplyConfig(const std::map<std::string, std::string>& config);
+    bool operator==(const TenantConfig& other) const;
+    bool operator!=(const TenantConfig& other) const { return !(*this == other); }
 
     void Print() {
-        std::cout << "Tenant: '" << name << "' softquota=" << softquota << " cpu=" << cpu << " memory=" << memory << std::endl;
+        std::cout << "Tenant: '" << name << "' softquota=" << softquota << " cpu=" << cpu << " memory=" << memory
+                  << " memoryFloor=" << memoryFloor << std::endl;
     }
 };
 
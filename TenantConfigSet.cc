@@ -0,0 +1,97 @@
+#include "TenantConfigSet.hh"
+#include "ConfigINI.hh"
+
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/algorithm/string.hpp>
+
+using namespace mdsd;
+using namespace boost::algorithm;
+
+std::shared_ptr<const TenantConfigSet> TenantConfigSet::Load(const std::string &path)
+{
+    auto set = std::make_shared<TenantConfigSet>();
+    ConfigINI ini;
+
+    if (!ini.Parse(path))
+        throw std::runtime_error("cannot load '" + path + "'");
+
+    unsigned int defaultSoftQuota = 0;
+    unsigned int defaultMemoryFloor = 0;
+    TenantUnitMeasure defaultMemoryFloorUnit = CONFINIT_UNIT_MEGABYTE;
+
+    try
+    {
+        // Root section
+        const ConfigINISection &root = ini.GetSections()[0];
+        std::string_view allowed = ini.GetValue(root, CONFIG_KEY_ALLOWED_TENANTS);
+        if (!allowed.empty())
+        {
+            split(set->allowedTenants, allowed, boost::is_any_of(","));
+        }
+
+        // "recreate" drops the running tenants, "reconcile" only applies the differences
+        set->recreate = iequals(ini.GetValue(root, CONFIG_KEY_PROVISIONING), "recreate");
+
+        // Global TENANTS section, the defaults are known before the tenants
+        if (const ConfigINISection *defaults = ini.FindSection("TENANTS"))
+        {
+            std::string_view value = ini.GetValue(*defaults, CONFIG_KEY_SOFT_QUOTA_CUSHION);
+            if (!value.empty())
+                TenantConfig::ParseUnitMeasure(value, defaultSoftQuota);
+
+            value = ini.GetValue(*defaults, CONFIG_KEY_MEMORY_FLOOR);
+            if (!value.empty())
+            {
+                int unit = TenantConfig::ParseUnitMeasure(value, defaultMemoryFloor);
+                defaultMemoryFloorUnit = static_cast<TenantUnitMeasure>(unit >= 0 ? unit : CONFINIT_UNIT_MEGABYTE);
+            }
+        }
+
+        // SubSection tenant config, in file order
+        set->tenants.reserve(ini.GetSections().size());
+        for (const ConfigINISection &section : ini.GetSections())
+        {
+            if (!starts_with(section.name, "TENANTS."))
+                continue;
+
+            set->tenants.emplace_back(std::string(section.name.substr(sizeof("TENANTS.") - 1)), defaultSoftQuota,
+                                      defaultMemoryFloor, defaultMemoryFloorUnit);
+            set->tenants.back().ApplyConfig(ini, section);
+        }
+    }
+    catch (const std::logic_error &e)
+    {
+        /* TenantConfig::ParseUnitMeasure */
+        throw std::runtime_error("invalid value in '" + path + "': " + e.what());
+    }
+
+    return set;
+}
+
+TenantConfigDiff TenantConfigSet::Diff(const TenantConfigSet &from, const TenantConfigSet &to)
+{
+    TenantConfigDiff diff;
+    std::unordered_map<std::string, const TenantConfig *> previous;
+
+    for (const auto &tenant : from.tenants)
+        previous[tenant.name] = &tenant;
+
+    for (size_t i = 0; i < to.tenants.size(); i++)
+    {
+        auto it = previous.find(to.tenants[i].name);
+        if (it == previous.end()) {
+            diff.added.push_back(i);
+            continue;
+        }
+
+        if (*it->second != to.tenants[i])
+            diff.changed.push_back(i);
+        previous.erase(it);
+    }
+
+    for (const auto &left : previous)
+        diff.removed.push_back(left.first);
+
+    return diff;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef __TENANTCONFIGSET_HH__
+#define __TENANTCONFIGSET_HH__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TenantConfig.hh"
+
+namespace mdsd {
+
+/* Tenants added, changed or removed between two versions of the config */
+struct TenantConfigDiff {
+    std::vector<size_t> added;          /* indexes in the new set */
+    std::vector<size_t> changed;        /* indexes in the new set */
+    std::vector<std::string> removed;   /* names */
+
+    bool Empty() const { return added.empty() && changed.empty() && removed.empty(); }
+};
+
+/*
+ * One version of config.ini: the [TENANTS.*] sections with the [TENANTS]
+ * defaults applied, and the root section settings.
+ *
+ * Never modified once loaded, a reload builds a new set.
+ */
+class TenantConfigSet
+{
+public:
+    std::vector<TenantConfig> tenants;
+    std::vector<std::string> allowedTenants;
+    bool recreate = false;              /* Provisioning = recreate */
+
+    /* Throws std::runtime_error when the file cannot be loaded or a value is invalid */
+    static std::shared_ptr<const TenantConfigSet> Load(const std::string &path);
+
+    /* Tenants are matched by name */
+    static TenantConfigDiff Diff(const TenantConfigSet &from, const TenantConfigSet &to);
+};
+
+} // namespace mdsd
+
+#endif // __TENANTCONFIGSET_HH__
@@ -0,0 +1,251 @@
+#include "TenantProvisioner.hh"
+#include "CgroupBackend.hh"
+
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace mdsd;
+using namespace std::chrono;
+
+static std::string JoinPath(const std::string &parent, const std::string &name)
+{
+    if (parent.empty() || parent.back() == '/')
+        return parent + name;
+    return parent + "/" + name;
+}
+
+TenantProvisioner::TenantProvisioner(CgroupBackendFactory &factory, unsigned int controllers, uid_t uid, gid_t gid,
+                                     unsigned int workers)
+    : factory(factory), controllers(controllers), uid(uid), gid(gid), pool(workers)
+{
+}
+
+TenantProvisionReport TenantProvisioner::Provision(const std::string &rootpath, const LimitSet &rootLimits,
+                                                   const std::vector<TenantConfig> &tenants,
+                                                   const std::vector<LimitSet> &limits,
+                                                   TenantProvisionMode mode)
+{
+    TenantProvisionReport report;
+    report.tenants.resize(tenants.size());
+    this->mode = mode;
+    this->report = &report;
+
+    nodes.clear();
+    nodes.push_back({ rootpath, &rootLimits, {}, &report.root });
+
+    std::unordered_map<std::string, size_t> byName;
+    for (size_t i = 0; i < tenants.size(); i++)
+        byName[tenants[i].name] = i + 1;
+
+    for (size_t i = 0; i < tenants.size(); i++)
+    {
+        const std::string &name = tenants[i].name;
+        nodes.push_back({ JoinPath(rootpath, name), &limits[i], {}, &report.tenants[i] });
+
+        /* the closest configured ancestor, the root otherwise */
+        size_t parent = 0;
+        for (size_t slash = name.rfind('/'); slash != std::string::npos && slash > 0; slash = name.rfind('/', slash - 1))
+        {
+            auto it = byName.find(name.substr(0, slash));
+            if (it != byName.end()) {
+                parent = it->second;
+                break;
+            }
+        }
+        nodes[parent].children.push_back(i + 1);
+    }
+
+    start = steady_clock::now();
+    pool.Submit([this] { Run(0); });
+    pool.Wait();
+    report.elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+
+    size_t failed = 0, changed = 0;
+    for (const auto &node : nodes) {
+        if (!node.result->cgroup)
+            failed++;
+        else if (node.result->changed)
+            changed++;
+    }
+    report.failed += failed;
+
+    CGROUP_DEBUG("Provisioned " << nodes.size() - failed << "/" << nodes.size() << " groups ("
+                 << changed << " changed, " << report.removed.size() << " removed) with "
+                 << pool.Size() << " workers in " << report.elapsed.count() << "us");
+    nodes.clear();
+    this->report = nullptr;
+    return report;
+}
+
+void TenantProvisioner::Run(size_t index)
+{
+    Node &node = nodes[index];
+    auto begin = steady_clock::now();
+
+    try
+    {
+        auto cgroup = factory.GetCgroup(node.path);
+        auto backend = cgroup->backend;
+        backend->DetectControllers(controllers);
+
+        if (mode == TENANT_PROVISION_RECREATE) {
+            /* the subtree goes with the root, a tenant group never exists here */
+            if (index == 0)
+                backend->Remove();
+            node.result->created = true;
+        } else {
+            node.result->created = access(backend->GetBasePath(CGROUP_CONTROLLER_MEMORY).c_str(), F_OK) < 0;
+        }
+
+        if (index == 0)
+            backend->MakeGroup();
+        else
+            backend->MakeGroup(controllers);
+
+        if (node.result->created || !backend->HasOwner(uid, gid)) {
+            cgroup->SetOwner(uid, gid);
+            node.result->changed = true;
+        }
+
+        if (!node.limits->Empty()) {
+            if (node.result->created)
+                cgroup->SetLimits(*node.limits);
+            else if (backend->ReconcileLimits(*node.limits))
+                node.result->changed = true;
+        }
+        node.result->changed |= node.result->created;
+
+        if (mode == TENANT_PROVISION_RECONCILE)
+            RemoveStale(index, *cgroup);
+
+        node.result->cgroup = cgroup;
+    }
+    catch (const std::exception &e)
+    {
+        node.result->error = e.what();
+    }
+
+    auto end = steady_clock::now();
+    node.result->elapsed = duration_cast<microseconds>(end - begin);
+    node.result->completed = duration_cast<microseconds>(end - start);
+
+    if (!node.result->cgroup) {
+        CGROUP_ERROR("Failed to provision '" << node.path << "', error:" << node.result->error);
+        for (size_t child : node.children)
+            Fail(child, "parent '" + node.path + "' failed");
+        return;
+    }
+
+    for (size_t child : node.children)
+        pool.Submit([this, child] { Run(child); });
+}
+
+/* Child groups of a node that no configured tenant lives in, removed in parallel */
+void TenantProvisioner::RemoveStale(size_t index, Cgroup &cgroup)
+{
+    const Node &node = nodes[index];
+    std::vector<std::string> names;
+    std::vector<std::string> configured;
+
+    if (node.result->created)
+        return;
+
+    for (size_t child : node.children) {
+        std::string relative = nodes[child].path.substr(node.path.size() + 1);
+        configured.push_back(relative.substr(0, relative.find('/')));
+    }
+    std::sort(configured.begin(), configured.end());
+
+    cgroup.backend->GetChildren(names);
+    for (const auto &name : names)
+    {
+        if (std::binary_search(configured.begin(), configured.end(), name))
+            continue;
+
+        std::string path = JoinPath(node.path, name);
+        pool.Submit([this, path] { RemoveGroup(path); });
+    }
+}
+
+void TenantProvisioner::RemoveGroup(const std::string &path)
+{
+    try
+    {
+        auto cgroup = factory.GetCgroup(path);
+        cgroup->backend->DetectControllers(controllers);
+        cgroup->backend->Remove();
+
+        std::lock_guard<std::mutex> guard(reportLock);
+        report->removed.push_back(path);
+    }
+    catch (const std::exception &e)
+    {
+        CGROUP_ERROR("Failed to remove '" << path << "', error:" << e.what());
+        std::lock_guard<std::mutex> guard(reportLock);
+        report->failed++;
+    }
+}
+
+TenantProvisionReport TenantProvisioner::Remove(const std::string &rootpath, const std::vector<std::string> &names,
+                                               std::chrono::milliseconds timeout)
+{
+    TenantProvisionReport report;
+    this->report = &report;
+
+    start = steady_clock::now();
+    std::vector<std::string> paths(names.size());
+    std::vector<std::shared_ptr<Cgroup>> cgroups(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        paths[i] = JoinPath(rootpath, names[i]);
+        pool.Submit([this, &paths, &cgroups, i] {
+            try
+            {
+                auto cgroup = factory.GetCgroup(paths[i]);
+                cgroup->backend->DetectControllers(controllers);
+                cgroups[i] = cgroup;
+            }
+            catch (const std::exception &e)
+            {
+                CGROUP_ERROR("Failed to open '" << paths[i] << "', error:" << e.what());
+            }
+        });
+    }
+    pool.Wait();
+
+    std::vector<Cgroup *> opened;
+    std::vector<size_t> index;
+    for (size_t i = 0; i < cgroups.size(); i++) {
+        if (cgroups[i]) {
+            opened.push_back(cgroups[i].get());
+            index.push_back(i);
+        } else {
+            report.failed++;
+        }
+    }
+
+    std::vector<std::string> errors;
+    Cgroup::TerminateAll(opened, timeout, errors, &pool);
+    for (size_t k = 0; k < opened.size(); k++) {
+        if (errors[k].empty()) {
+            report.removed.push_back(paths[index[k]]);
+        } else {
+            CGROUP_ERROR("Failed to remove '" << paths[index[k]] << "', error:" << errors[k]);
+            report.failed++;
+        }
+    }
+    report.elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+
+    this->report = nullptr;
+    return report;
+}
+
+/* The subtree of a failed group is never scheduled, so no other thread touches it */
+void TenantProvisioner::Fail(size_t index, const std::string &error)
+{
+    Node &node = nodes[index];
+
+    node.result->error = error;
+    for (size_t child : node.children)
+        Fail(child, error);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef __TENANTPROVISIONER_HH__
+#define __TENANTPROVISIONER_HH__
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Cgroup.hh"
+#include "CgroupBackendFactory.hh"
+#include "LimitSet.hh"
+#include "TenantConfig.hh"
+#include "WorkerPool.hh"
+
+namespace mdsd {
+
+typedef enum {
+    TENANT_PROVISION_RECREATE = 0,  /* remove the root group and create everything again */
+    TENANT_PROVISION_RECONCILE,     /* only change what differs from the config */
+    TENANT_PROVISION_UPDATE,        /* reconcile the given tenants, leave the other groups alone */
+} TenantProvisionMode;
+
+struct TenantProvisionResult {
+    std::shared_ptr<Cgroup> cgroup;         /* null when provisioning failed */
+    std::string error;
+    bool created = false;                   /* the group did not exist */
+    bool changed = false;                   /* created, or its owner or limits were written */
+    std::chrono::microseconds elapsed{0};   /* time spent in the steps of this group */
+    std::chrono::microseconds completed{0}; /* since the start of Provision() */
+};
+
+struct TenantProvisionReport {
+    TenantProvisionResult root;
+    std::vector<TenantProvisionResult> tenants; /* in the order of the configs */
+    std::vector<std::string> removed;           /* groups not in the config anymore */
+    size_t failed = 0;                          /* groups, removals included */
+    std::chrono::microseconds elapsed{0};
+};
+
+/*
+ * Creates the root group of the tenants and one group per tenant, each
+ * with its owner and limits.
+ *
+ * The groups form a tree: the root first, then every tenant whose parent
+ * is done, siblings being created in parallel on a worker pool. A tenant
+ * named "a/b" is a child of tenant "a" when there is one, of the root
+ * otherwise. When a group fails its whole subtree is reported failed
+ * without being attempted.
+ *
+ * In reconcile mode nothing is removed up front: existing groups are kept
+ * with their tasks, only the owner and limits that differ are written and
+ * the child groups that are not configured (anymore) are removed. A
+ * restart with an unchanged config reads the hierarchy and writes nothing.
+ */
+class TenantProvisioner
+{
+public:
+    TenantProvisioner(CgroupBackendFactory &factory, unsigned int controllers, uid_t uid, gid_t gid,
+                      unsigned int workers = 0);
+
+    /* limits[i] is applied to tenants[i], an empty LimitSet writes nothing.
+       When recreating, the root group is removed first with everything below it. */
+    TenantProvisionReport Provision(const std::string &rootpath, const LimitSet &rootLimits,
+                                    const std::vector<TenantConfig> &tenants, const std::vector<LimitSet> &limits,
+                                    TenantProvisionMode mode = TENANT_PROVISION_RECREATE);
+
+    /* Remove the groups of the named tenants, see Cgroup::TerminateAll():
+       their processes are killed and waited for until timeout, then the
+       groups are removed in parallel */
+    TenantProvisionReport Remove(const std::string &rootpath, const std::vector<std::string> &names,
+                                 std::chrono::milliseconds timeout = std::chrono::milliseconds(CGROUP_TERMINATE_TIMEOUT_MS));
+
+private:
+    struct Node {
+        std::string path;
+        const LimitSet *limits;
+        std::vector<size_t> children;
+        TenantProvisionResult *result;
+    };
+
+    void Run(size_t node);
+    void Fail(size_t node, const std::string &error);
+    void RemoveStale(size_t node, Cgroup &cgroup);
+    void RemoveGroup(const std::string &path);
+
+    CgroupBackendFactory &factory;
+    const unsigned int controllers;
+    const uid_t uid;
+    const gid_t gid;
+    WorkerPool pool;
+
+    /* only valid during Provision() */
+    std::vector<Node> nodes;
+    TenantProvisionMode mode;
+    TenantProvisionReport *report;
+    std::mutex reportLock;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace mdsd
+
+#endif // __TENANTPROVISIONER_HH__
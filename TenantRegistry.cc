@@ -0,0 +1,207 @@
+#include "TenantRegistry.hh"
+
+#include <functional>
+
+using namespace mdsd;
+
+#define TENANT_REGISTRY_MIN_TABLE 16
+
+static size_t HashName(std::string_view name)
+{
+    return std::hash<std::string_view>()(name);
+}
+
+/* inodes are mostly sequential, mix them before masking (splitmix64 finalizer) */
+size_t TenantRegistry::HashCgroupId(unsigned long long cgroupId)
+{
+    cgroupId ^= cgroupId >> 30;
+    cgroupId *= 0xbf58476d1ce4e5b9ULL;
+    cgroupId ^= cgroupId >> 27;
+    cgroupId *= 0x94d049bb133111ebULL;
+    cgroupId ^= cgroupId >> 31;
+    return cgroupId;
+}
+
+TenantRegistry::TenantRegistry(const std::string &rootpath, size_t capacity)
+    : rootpath(rootpath)
+{
+    size_t size = TENANT_REGISTRY_MIN_TABLE;
+    while (size < capacity * 2)
+        size <<= 1;
+
+    nameTable.assign(size, TENANT_ID_INVALID);
+    cgroupIdTable.assign(size, TENANT_ID_INVALID);
+    mask = size - 1;
+
+    configs.reserve(capacity);
+    cgroups.reserve(capacity);
+    cgroupIds.reserve(capacity);
+    limits.reserve(capacity);
+    samples.reserve(capacity);
+    alive.reserve(capacity);
+}
+
+TenantId TenantRegistry::Add(const TenantConfig &config, const std::shared_ptr<Cgroup> &cgroup,
+                             const LimitSet &limitSet)
+{
+    if (FindByName(config.name) != TENANT_ID_INVALID)
+        return TENANT_ID_INVALID;
+
+    if ((count + 1) * 2 > nameTable.size())
+        Grow();
+
+    unsigned long long cgroupId = cgroup ? cgroup->backend->GetCgroupId() : 0;
+    TenantId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+        configs[id] = config;
+        cgroups[id] = cgroup;
+        cgroupIds[id] = cgroupId;
+        limits[id] = limitSet;
+        samples[id] = CgroupUsageSample();
+        alive[id] = 1;
+    } else {
+        id = alive.size();
+        configs.push_back(config);
+        cgroups.push_back(cgroup);
+        cgroupIds.push_back(cgroupId);
+        limits.push_back(limitSet);
+        samples.emplace_back();
+        alive.push_back(1);
+    }
+    count++;
+
+    InsertName(id);
+    if (cgroupId)
+        InsertCgroupId(id);
+
+    return id;
+}
+
+bool TenantRegistry::Remove(TenantId id)
+{
+    if (!Contains(id))
+        return false;
+
+    EraseName(id);
+    if (cgroupIds[id])
+        EraseCgroupId(id);
+
+    /* keep the name, a free slot is never compared with it */
+    cgroups[id].reset();
+    cgroupIds[id] = 0;
+    alive[id] = 0;
+    freeIds.push_back(id);
+    count--;
+    return true;
+}
+
+TenantId TenantRegistry::FindByName(std::string_view name) const
+{
+    for (size_t slot = HashName(name) & mask; nameTable[slot] != TENANT_ID_INVALID; slot = (slot + 1) & mask)
+    {
+        TenantId id = nameTable[slot];
+        if (configs[id].name == name)
+            return id;
+    }
+
+    return TENANT_ID_INVALID;
+}
+
+TenantId TenantRegistry::FindByCgroupId(unsigned long long cgroupId) const
+{
+    if (!cgroupId)
+        return TENANT_ID_INVALID;
+
+    for (size_t slot = HashCgroupId(cgroupId) & mask; cgroupIdTable[slot] != TENANT_ID_INVALID; slot = (slot + 1) & mask)
+    {
+        TenantId id = cgroupIdTable[slot];
+        if (cgroupIds[id] == cgroupId)
+            return id;
+    }
+
+    return TENANT_ID_INVALID;
+}
+
+TenantId TenantRegistry::FindByPath(std::string_view path) const
+{
+    if (path.size() <= rootpath.size() + 1 || path.compare(0, rootpath.size(), rootpath) != 0 ||
+        path[rootpath.size()] != '/')
+        return TENANT_ID_INVALID;
+
+    path.remove_prefix(rootpath.size() + 1);
+    while (!path.empty() && path.back() == '/')
+        path.remove_suffix(1);
+
+    return FindByName(path);
+}
+
+/* Doubles both tables and inserts every tenant again */
+void TenantRegistry::Grow()
+{
+    size_t size = nameTable.size() * 2;
+
+    nameTable.assign(size, TENANT_ID_INVALID);
+    cgroupIdTable.assign(size, TENANT_ID_INVALID);
+    mask = size - 1;
+
+    ForEach([this](TenantId id) {
+        InsertName(id);
+        if (cgroupIds[id])
+            InsertCgroupId(id);
+    });
+}
+
+void TenantRegistry::InsertName(TenantId id)
+{
+    size_t slot = HashName(configs[id].name) & mask;
+    while (nameTable[slot] != TENANT_ID_INVALID)
+        slot = (slot + 1) & mask;
+    nameTable[slot] = id;
+}
+
+void TenantRegistry::InsertCgroupId(TenantId id)
+{
+    size_t slot = HashCgroupId(cgroupIds[id]) & mask;
+    while (cgroupIdTable[slot] != TENANT_ID_INVALID)
+        slot = (slot + 1) & mask;
+    cgroupIdTable[slot] = id;
+}
+
+void TenantRegistry::EraseName(TenantId id)
+{
+    size_t slot = HashName(configs[id].name) & mask;
+    while (nameTable[slot] != id)
+        slot = (slot + 1) & mask;
+    EraseSlot(nameTable, slot, true);
+}
+
+void TenantRegistry::EraseCgroupId(TenantId id)
+{
+    size_t slot = HashCgroupId(cgroupIds[id]) & mask;
+    while (cgroupIdTable[slot] != id)
+        slot = (slot + 1) & mask;
+    EraseSlot(cgroupIdTable, slot, false);
+}
+
+/*
+ * Backward shift deletion: the entries following the hole in the same
+ * run move back into it unless that would put them before their home
+ * slot, so lookups never need tombstones.
+ */
+void TenantRegistry::EraseSlot(std::vector<TenantId> &table, size_t hole, bool byName)
+{
+    for (size_t slot = (hole + 1) & mask; table[slot] != TENANT_ID_INVALID; slot = (slot + 1) & mask)
+    {
+        TenantId id = table[slot];
+        size_t home = (byName ? HashName(configs[id].name) : HashCgroupId(cgroupIds[id])) & mask;
+
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            table[hole] = id;
+            hole = slot;
+        }
+    }
+
+    table[hole] = TENANT_ID_INVALID;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef __TENANTREGISTRY_HH__
+#define __TENANTREGISTRY_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Cgroup.hh"
+#include "CgroupStat.hh"
+#include "LimitSet.hh"
+#include "TenantConfig.hh"
+
+namespace mdsd {
+
+typedef uint32_t TenantId;
+#define TENANT_ID_INVALID ((mdsd::TenantId)-1)
+
+/*
+ * The running tenants, each with a dense id.
+ *
+ * Ids go from 0 to Capacity() - 1 and stay the same while the tenant is
+ * registered, the id of a removed tenant is given to the next one added.
+ * They are meant as cookies for the event watcher and as indexes into
+ * arrays of the caller.
+ *
+ * The config, cgroup, applied limits and last usage sample of the tenants
+ * are kept in one array each, indexed by id, so going through one of them
+ * for every tenant stays in a few cache lines. Tenants are found by name,
+ * by cgroup path and by kernel cgroup id (inode of the group directory)
+ * through two open addressing tables with linear probing, kept at most
+ * half full.
+ *
+ * Not synchronized, callers sharing a registry between threads lock it.
+ */
+class TenantRegistry
+{
+public:
+    /* rootpath is the relative path of the parent group of the tenants, for FindByPath() */
+    TenantRegistry(const std::string &rootpath = "", size_t capacity = 0);
+
+    /* Returns TENANT_ID_INVALID when a tenant with that name is registered already */
+    TenantId Add(const TenantConfig &config, const std::shared_ptr<Cgroup> &cgroup,
+                 const LimitSet &limits = LimitSet());
+    bool Remove(TenantId id);
+
+    TenantId FindByName(std::string_view name) const;
+    TenantId FindByCgroupId(unsigned long long cgroupId) const;
+    /* Relative path of the group, as rootpath + "/" + name */
+    TenantId FindByPath(std::string_view path) const;
+
+    bool Contains(TenantId id) const { return id < alive.size() && alive[id]; }
+    size_t Size() const { return count; }
+    /* Upper bound of the ids */
+    size_t Capacity() const { return alive.size(); }
+
+    const std::string &GetName(TenantId id) const { return configs[id].name; }
+    const TenantConfig &GetConfig(TenantId id) const { return configs[id]; }
+    /* The name must not change */
+    void SetConfig(TenantId id, const TenantConfig &config) { configs[id] = config; }
+
+    const std::shared_ptr<Cgroup> &GetCgroup(TenantId id) const { return cgroups[id]; }
+    unsigned long long GetCgroupId(TenantId id) const { return cgroupIds[id]; }
+
+    const LimitSet &GetLimits(TenantId id) const { return limits[id]; }
+    void SetLimits(TenantId id, const LimitSet &limitSet) { limits[id] = limitSet; }
+
+    const CgroupUsageSample &GetSample(TenantId id) const { return samples[id]; }
+    void SetSample(TenantId id, const CgroupUsageSample &sample) { samples[id] = sample; }
+
+    /* Calls fn(id) for every registered tenant, in id order */
+    template <typename Fn>
+    void ForEach(Fn fn) const
+    {
+        for (TenantId id = 0; id < alive.size(); id++)
+            if (alive[id])
+                fn(id);
+    }
+
+private:
+    static size_t HashCgroupId(unsigned long long cgroupId);
+
+    void Grow();
+    void InsertName(TenantId id);
+    void InsertCgroupId(TenantId id);
+    void EraseName(TenantId id);
+    void EraseCgroupId(TenantId id);
+    void EraseSlot(std::vector<TenantId> &table, size_t slot, bool byName);
+
+    const std::string rootpath;
+
+    /* by id */
+    std::vector<TenantConfig> configs;
+    std::vector<std::shared_ptr<Cgroup>> cgroups;
+    std::vector<unsigned long long> cgroupIds;
+    std::vector<LimitSet> limits;
+    std::vector<CgroupUsageSample> samples;
+    std::vector<uint8_t> alive;
+    std::vector<TenantId> freeIds;
+    size_t count = 0;
+
+    /* open addressing, TENANT_ID_INVALID for an empty slot */
+    std::vector<TenantId> nameTable;
+    std::vector<TenantId> cgroupIdTable;
+    size_t mask = 0;
+};
+
+} // namespace mdsd
+
+#endif // __TENANTREGISTRY_HH__
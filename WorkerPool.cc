@@ -0,0 +1,62 @@
+#include "WorkerPool.hh"
+
+#include <algorithm>
+
+using namespace mdsd;
+
+WorkerPool::WorkerPool(unsigned int workers)
+{
+    unsigned int n = workers ? workers : std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < n; i++)
+        threads.emplace_back(&WorkerPool::Work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    jobCond.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void WorkerPool::Submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+        pending++;
+    }
+    jobCond.notify_one();
+}
+
+void WorkerPool::Wait()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    idleCond.wait(lk, [this] { return pending == 0; });
+}
+
+void WorkerPool::Work()
+{
+    std::unique_lock<std::mutex> lk(lock);
+    for (;;)
+    {
+        jobCond.wait(lk, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+
+        auto job = std::move(jobs.front());
+        jobs.pop_front();
+        lk.unlock();
+
+        job();
+
+        lk.lock();
+        if (--pending == 0)
+            idleCond.notify_all();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef __WORKERPOOL_HH__
+#define __WORKERPOOL_HH__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mdsd {
+
+/*
+ * Fixed set of threads running jobs in submission order.
+ *
+ * Jobs may submit more jobs, Wait() returns once the queue is empty and
+ * no job is running. Exceptions must not leave a job.
+ */
+class WorkerPool
+{
+public:
+    /* 0 workers means one per cpu */
+    WorkerPool(unsigned int workers = 0);
+    ~WorkerPool();
+
+    void Submit(std::function<void()> job);
+    void Wait();
+
+    unsigned int Size() const { return threads.size(); }
+
+private:
+    void Work();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+
+    std::mutex lock;
+    std::condition_variable jobCond;
+    std::condition_variable idleCond;
+    unsigned int pending = 0; /* queued + running */
+    bool stopping = false;
+};
+
+} // namespace mdsd
+
+#endif // __WORKERPOOL_HH__
@@ -7,13 +7,22 @@
 #include <sys/types.h> 
 #include <string.h> 
 #include <sys/wait.h>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 
 #include "CgroupBackend.hh"
 #include "CgroupBackendFactory.hh"
 #include "Cgroup.hh"
-#include "ConfigINI.hh"
+#include "CgroupSampler.hh"
+#include "CgroupEventWatcher.hh"
+#include "CpuAutoscaler.hh"
+#include "ConfigWatcher.hh"
+#include "MemorySolver.hh"
 #include "TenantConfig.hh"
+#include "TenantConfigSet.hh"
+#include "TenantProvisioner.hh"
+#include "TenantRegistry.hh"
 #include <confini.h>
 
 #include <boost/algorithm/string.hpp>
@@ -64,76 +73,113 @@ void thread_wait_for_process(std::string thread_name, int pid)
         printf("Exit status of the child was %d\n", WEXITSTATUS(status));
 }
 
-pid_t create_proc_cpu_burn()
+// Workers are this program re-executed with a worker flag, see main()
+pid_t create_proc_cpu_burn(Cgroup &cgroup)
 {
     string name = "main:cpu_burn";
-    pid_t pid = fork();
-    if (pid == 0)
-    {
-        prctl(PR_SET_NAME, (unsigned long)name.c_str(), 0, 0, 0);
-        cout << PRINT_CHILD"Running cpu burn" << endl;
-        cpu_burn();
-        exit(0);
-    }
+    pid_t pid = cgroup.Spawn("/proc/self/exe", { name, "--cpu-burn" });
 
     std::thread t(&thread_wait_for_process, name, pid);
     t.detach();
     return pid;
 }
 
-pid_t create_proc_mem_alloc(int size_mb)
+pid_t create_proc_mem_alloc(Cgroup &cgroup, int size_mb)
 {
     string name = "main:memory_alloc";
-    pid_t pid = fork();
-    if (pid == 0)
-    {
-        prctl(PR_SET_NAME, (unsigned long)name.c_str(), 0, 0, 0);
-        cout << PRINT_CHILD"Running memory alloc" << endl;
-        memory_alloc(size_mb);
-        sleep(60);
-        exit(0);
-    }
+    pid_t pid = cgroup.Spawn("/proc/self/exe", { name, "--memory-alloc", std::to_string(size_mb) });
+
     std::thread t(&thread_wait_for_process, name, pid);
     t.detach();
     return pid;
 }
 
-
-int main(int argc, char *argv[])
+// Limits of every tenant, memory fitted into budgetMB
+void plan_tenants_limits(const std::vector<TenantConfig> &tenantsConfig, double budgetMB, std::vector<LimitSet> &limits)
 {
-    ConfigINI ini;
-    IniParsedDataMap data;
-
-    ini.Parse("./config.ini", data);
+    unsigned int totalTenantsMemoryLimitFromConfigInMB = 0;
+    std::vector<MemoryDemand> tenantsMemory;
 
-    std::vector<TenantConfig> tenantsConfig;
-    unsigned int DefaultSoftQuota = 0;
-    std::vector<std::string> allowedTenantsList;
-    for (IniParsedDataMap::iterator it = data.begin(); it != data.end(); ++it)
+    for (size_t i = 0; i < tenantsConfig.size(); i++)
     {
-        auto sectionName = it->first;
-        auto sectionKeys = it->second;
-        LOG("it->first=" << it->first);
-        // Root section
-        if (it->first == std::string(ROOT_SECTION_NAME) && sectionKeys.find("AllowedTenants") != sectionKeys.end())
-        {
-            split(allowedTenantsList, sectionKeys["AllowedTenants"], boost::is_any_of(","));
-        }
-        
-        // Global TENANTS section
-        if (it->first == "TENANTS" && sectionKeys.find("SoftQuotaCushion") != sectionKeys.end())
-        {
-            DefaultSoftQuota = std::stoul(sectionKeys["SoftQuotaCushion"]);
+        const TenantConfig& tenant = tenantsConfig[i];
+
+        // Memory
+        float memory = tenant.memory;
+        if (tenant.memoryUnit == CONFINIT_UNIT_KILOBYTE) {
+            memory = CGROUP_MEM_KB_TO_MB(memory);
+        } else if (tenant.memoryUnit == CONFINIT_UNIT_PERCENTAGE) {
+            memory = budgetMB * double(memory)/100;
         }
 
-        // SubSection tenant config
-        if (starts_with(it->first, "TENANTS."))
-        {
-            TenantConfig tenant(erase_first_copy(it->first, "TENANTS."), DefaultSoftQuota);
-            tenant.ApplyConfig(it->second);
-            tenantsConfig.push_back(tenant);
+        // a percentage floor is relative to the tenant's own memory
+        float memoryFloor = tenant.memoryFloor;
+        if (tenant.memoryFloorUnit == CONFINIT_UNIT_KILOBYTE) {
+            memoryFloor = CGROUP_MEM_KB_TO_MB(memoryFloor);
+        } else if (tenant.memoryFloorUnit == CONFINIT_UNIT_PERCENTAGE) {
+            memoryFloor = memory * double(memoryFloor)/100;
         }
+
+        tenantsMemory.push_back({ memory, memoryFloor, 1 + double(tenant.softquota)/100 });
+        totalTenantsMemoryLimitFromConfigInMB += memory;
+    }
+
+    LOG("totalTenantsMemoryLimitFromConfigInMB=" << totalTenantsMemoryLimitFromConfigInMB);
+    // Re-adjust memory limits
+    auto tenantsMemoryMB = MemorySolver::Solve(tenantsMemory, budgetMB);
+
+    limits.assign(tenantsConfig.size(), LimitSet());
+    for (size_t i = 0; i < tenantsConfig.size(); i++)
+    {
+        const TenantConfig& tenant = tenantsConfig[i];
+        if (tenantsMemoryMB[i] < tenantsMemory[i].request)
+            LOG("Tenant '" << tenant.name << "' memory re-adjusted from " << tenantsMemory[i].request
+                << "MB to " << tenantsMemoryMB[i] << "MB");
+
+        Cgroup::AddCPULimitInPercentage(limits[i], tenant.cpu, tenant.softquota);
+        Cgroup::AddMemoryLimitInMB(limits[i], tenantsMemoryMB[i], tenant.softquota);
+    }
+}
+
+// Scale the cpu quota of tenants configured with CPUMin/CPUMax, in usec of the 100ms period
+CpuAutoscalerBounds tenant_cpu_bounds(const TenantConfig &tenant)
+{
+    long long base = tenant.cpu * (1 + double(tenant.softquota)/100);
+    long long min = tenant.cpuMin ? std::min<long long>(tenant.cpuMin, base) : base;
+    long long max = tenant.cpuMax ? std::max<long long>(tenant.cpuMax, base) : base;
+    return { base * 1000, min * 1000, max * 1000 };
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--cpu-burn")
+    {
+        prctl(PR_SET_NAME, (unsigned long)argv[0], 0, 0, 0);
+        cout << PRINT_CHILD"Running cpu burn" << endl;
+        cpu_burn();
+        return 0;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--memory-alloc")
+    {
+        prctl(PR_SET_NAME, (unsigned long)argv[0], 0, 0, 0);
+        cout << PRINT_CHILD"Running memory alloc" << endl;
+        memory_alloc(std::stoi(argv[2]));
+        sleep(60);
+        return 0;
     }
+
+    const std::string configPath = "./config.ini";
+    std::shared_ptr<const TenantConfigSet> config;
+    try {
+        config = TenantConfigSet::Load(configPath);
+    } catch (const std::exception &e) {
+        LOG("Failed to load the config: " << e.what());
+        return 1;
+    }
+
+    std::vector<TenantConfig> tenantsConfig = config->tenants;
+    TenantProvisionMode provisionMode = config->recreate ? TENANT_PROVISION_RECREATE : TENANT_PROVISION_RECONCILE;
     
     CgroupBackendFactory cgroupFactory = CgroupBackendFactory();
 
@@ -151,61 +197,48 @@ int main(int argc, char *argv[])
     enablingControllers |= 1 << CGROUP_CONTROLLER_MEMORY;
     std::string rootpath = fs::path(mdsdmgr->backend->GetRelativeBasePath(CGROUP_CONTROLLER_MEMORY)).append("/TENANTS");
     LOG("rootpath=" << rootpath << "");
-    auto rootCgroup = cgroupFactory.GetCgroup(rootpath);
-    rootCgroup->backend->DetectControllers(enablingControllers);
-    rootCgroup->backend->Remove();    
-    rootCgroup->backend->MakeGroup();
-    rootCgroup->SetOwner(abder_uid, abder_gid);
+
     // remove 10 MB to keep for current process
-    rootCgroup->SetMemoryLimitInMB(mdsdmgr->GetMemoryInMB()-10);
-   
-    auto maxTenantsMemoryLimitMB = rootCgroup->GetMemoryInMB();
-    unsigned int totalTenantsMemoryLimitFromConfigInMB = 0;
+    auto maxTenantsMemoryLimitMB = mdsdmgr->GetMemoryInMB() - 10;
 
-    std::vector<std::shared_ptr<Cgroup>> tenantsCgroup;
-    for (size_t i = 0; i < tenantsConfig.size(); i++)
-    {
-        TenantConfig& tenant = tenantsConfig[i];
+    for (auto &tenant : tenantsConfig)
         tenant.Print();
-        fs::path tenantpath(rootpath);
-        tenantpath /= tenant.name;
-        auto tenantCgroup = cgroupFactory.GetCgroup(tenantpath);
-        tenantCgroup->backend->DetectControllers(enablingControllers);
-        tenantCgroup->backend->Remove();
-        tenantCgroup->backend->MakeGroup(enablingControllers);
-        tenantCgroup->SetOwner(abder_uid, abder_gid);
-        // set CPU
-        tenantCgroup->SetCPULimitInPercentage(tenant.cpu, tenant.softquota);
-        
-        // set Memory
-        float memory = tenant.memory;
-        if (tenant.memoryUnit == CONFINIT_UNIT_KILOBYTE) {
-            memory = CGROUP_MEM_KB_TO_MB(memory);
-        } else if (tenant.memoryUnit == CONFINIT_UNIT_PERCENTAGE) {
-            memory = maxTenantsMemoryLimitMB * double(memory)/100;
-        }
-
-        tenantCgroup->SetMemoryLimitInMB(memory, tenant.softquota);
+    LOG("maxTenantsMemoryLimitMB=" << maxTenantsMemoryLimitMB);
 
-        totalTenantsMemoryLimitFromConfigInMB += memory;
+    LimitSet rootLimits;
+    Cgroup::AddMemoryLimitInMB(rootLimits, maxTenantsMemoryLimitMB);
 
-        // add tasks to cgroup
-        tenantCgroup->backend->AddTask(create_proc_cpu_burn());
-        tenantCgroup->backend->AddTask(create_proc_mem_alloc(100));
+    std::vector<LimitSet> tenantsLimits;
+    plan_tenants_limits(tenantsConfig, maxTenantsMemoryLimitMB, tenantsLimits);
 
-        tenantsCgroup.push_back(tenantCgroup);
+    // create (or reconcile) the root cgroup, then all tenants in parallel
+    TenantProvisioner provisioner(cgroupFactory, enablingControllers, abder_uid, abder_gid);
+    auto report = provisioner.Provision(rootpath, rootLimits, tenantsConfig, tenantsLimits, provisionMode);
+    for (const auto &removed : report.removed)
+        LOG("Removed cgroup '" << removed << "' not configured anymore");
+    if (!report.root.cgroup) {
+        LOG("Failed to create the root cgroup of tenants: " << report.root.error);
+        return 1;
     }
 
-    LOG("maxTenantsMemoryLimitMB=" << maxTenantsMemoryLimitMB);
-    LOG("totalTenantsMemoryLimitFromConfigInMB=" << totalTenantsMemoryLimitFromConfigInMB);
-    // Re-adjust memory limits
-    if (totalTenantsMemoryLimitFromConfigInMB > maxTenantsMemoryLimitMB)
+    // register the tenants provisioned, then start the tasks
+    TenantRegistry registry(rootpath, tenantsConfig.size());
+    std::mutex registryLock;    /* shared by the main, sampler and config watcher threads */
+    for (size_t i = 0; i < tenantsConfig.size(); i++)
     {
-        for (size_t i = 0; i < tenantsCgroup.size(); i++)
-        {
+        auto &result = report.tenants[i];
+        if (!result.cgroup) {
+            LOG("Tenant '" << tenantsConfig[i].name << "' not provisioned: " << result.error);
+            continue;
         }
-    }
+        LOG("Tenant '" << tenantsConfig[i].name << "' provisioned in " << result.elapsed.count() << "us"
+            << (result.created ? " (created)" : result.changed ? " (updated)" : " (unchanged)"));
 
+        registry.Add(tenantsConfig[i], result.cgroup, tenantsLimits[i]);
+
+        create_proc_cpu_burn(*result.cgroup);
+        create_proc_mem_alloc(*result.cgroup, 100);
+    }
     
     // auto cgroup = cgroupFactory.GetCgroup("/test-group");
     // cgroup->backend->Remove();
@@ -217,13 +250,162 @@ int main(int argc, char *argv[])
     // cgroup->SetCPULimitInPercentage(30);
     // cgroup->SetMemoryLimitInMB(20, 20);
 
-    // cgroup->backend->AddTask(create_proc_cpu_burn());
-    // cgroup->backend->AddTask(create_proc_cpu_burn());
-    // cgroup->backend->AddTask(create_proc_cpu_burn());
-    // cgroup->backend->AddTask(create_proc_mem_alloc(100));
-    // cgroup->backend->AddTask(create_proc_mem_alloc(100));
+    // create_proc_cpu_burn(*cgroup);
+    // create_proc_cpu_burn(*cgroup);
+    // create_proc_cpu_burn(*cgroup);
+    // create_proc_mem_alloc(*cgroup, 100);
+    // create_proc_mem_alloc(*cgroup, 100);
     
-    cout << "Sleep..." << endl;
-    sleep(1000);
+    // the sampler, the autoscaler and the event watcher follow the registry: a tenant is tracked
+    // with a cookie of its own, its id may be reused by a tenant added later
+    CpuAutoscaler autoscaler({}, {});
+    CgroupSampler sampler({}, std::chrono::milliseconds(1000));
+    CgroupEventWatcher watcher;
+
+    struct TenantTracking {
+        unsigned long long cookie;
+        int watch;
+    };
+    std::unordered_map<TenantId, TenantTracking> tracking;      /* under registryLock */
+    std::unordered_map<unsigned long long, TenantId> trackedTenants;
+    unsigned long long nextCookie = 0;
+
+    auto track = [&](TenantId id) {
+        const auto &cgroup = registry.GetCgroup(id);
+        unsigned long long cookie = nextCookie++;
+
+        sampler.Add(cgroup, cookie);
+        autoscaler.Add(cookie, cgroup, tenant_cpu_bounds(registry.GetConfig(id)));
+        tracking[id] = { cookie, watcher.Watch(*cgroup, cookie) };
+        trackedTenants[cookie] = id;
+    };
+    auto untrack = [&](TenantId id) {
+        auto it = tracking.find(id);
+        if (it == tracking.end())
+            return;
+
+        sampler.Remove(it->second.cookie);
+        autoscaler.Remove(it->second.cookie);
+        watcher.Unwatch(it->second.watch);
+        trackedTenants.erase(it->second.cookie);
+        tracking.erase(it);
+    };
+    registry.ForEach(track);
+
+    sampler.OnCycle([&](const CgroupSampleSnapshot &snapshot) {
+        std::lock_guard<std::mutex> guard(registryLock);
+        autoscaler.Update(snapshot);
+
+        // a tenant removed since the start of the cycle has no cookie anymore
+        for (size_t t = 0; t < snapshot.samples.size(); t++) {
+            auto it = trackedTenants.find(snapshot.cookies[t]);
+            if (it != trackedTenants.end())
+                registry.SetSample(it->second, snapshot.samples[t]);
+        }
+    });
+    sampler.Start();
+
+    watcher.Subscribe(CGROUP_EVENT_MASK(CGROUP_EVENT_MEMORY_OOM_KILL) | CGROUP_EVENT_MASK(CGROUP_EVENT_MEMORY_HIGH) |
+                      CGROUP_EVENT_MASK(CGROUP_EVENT_POPULATED) | CGROUP_EVENT_MASK(CGROUP_EVENT_REMOVED),
+                      [&](const CgroupEvent &event) {
+        std::lock_guard<std::mutex> guard(registryLock);
+        auto it = trackedTenants.find(event.cookie);
+        if (it == trackedTenants.end())
+            return;
+        LOG("  " << registry.GetName(it->second) << ": " << CgroupEventName(event.type)
+            << " " << event.oldValue << " -> " << event.newValue);
+    });
+
+    // apply config changes without a restart: only the tenants whose limits change are written
+    ConfigWatcher configWatcher(configPath, config);
+    configWatcher.OnReload([&](const TenantConfigSet &, const TenantConfigSet &to, const TenantConfigDiff &diff) {
+        LOG("Config reloaded: " << diff.added.size() << " added, " << diff.changed.size() << " changed, "
+            << diff.removed.size() << " removed");
+
+        std::vector<LimitSet> limits;
+        plan_tenants_limits(to.tenants, maxTenantsMemoryLimitMB, limits);
+
+        std::vector<TenantConfig> update;
+        std::vector<LimitSet> updateLimits;
+        {
+            std::lock_guard<std::mutex> guard(registryLock);
+            for (size_t i = 0; i < to.tenants.size(); i++)
+            {
+                TenantId id = registry.FindByName(to.tenants[i].name);
+                auto it = tracking.find(id);
+                if (id == TENANT_ID_INVALID || registry.GetLimits(id) != limits[i]) {
+                    update.push_back(to.tenants[i]);
+                    updateLimits.push_back(limits[i]);
+                    // not scaled while its quota is written, added back below
+                    if (it != tracking.end())
+                        autoscaler.Remove(it->second.cookie);
+                } else {
+                    registry.SetConfig(id, to.tenants[i]);
+                    if (it != tracking.end())
+                        autoscaler.UpdateBounds(it->second.cookie, tenant_cpu_bounds(to.tenants[i]));
+                }
+            }
+
+            // stop sampling and scaling the removed tenants before their groups go away
+            for (const auto &name : diff.removed) {
+                TenantId id = registry.FindByName(name);
+                untrack(id);
+                registry.Remove(id);
+            }
+        }
+
+        auto updated = provisioner.Provision(rootpath, rootLimits, update, updateLimits, TENANT_PROVISION_UPDATE);
+        auto removed = provisioner.Remove(rootpath, diff.removed);
+
+        std::lock_guard<std::mutex> guard(registryLock);
+        for (size_t i = 0; i < update.size(); i++)
+        {
+            TenantId id = registry.FindByName(update[i].name);
+            if (!updated.tenants[i].cgroup) {
+                LOG("Tenant '" << update[i].name << "' not updated: " << updated.tenants[i].error);
+            } else if (id == TENANT_ID_INVALID) {
+                id = registry.Add(update[i], updated.tenants[i].cgroup, updateLimits[i]);
+                if (id != TENANT_ID_INVALID)
+                    track(id);
+                continue;
+            } else {
+                registry.SetConfig(id, update[i]);
+                registry.SetLimits(id, updateLimits[i]);
+            }
+
+            // scaled again from the quota just written, with the new bounds
+            auto it = tracking.find(id);
+            if (it != tracking.end())
+                autoscaler.Add(it->second.cookie, registry.GetCgroup(id), tenant_cpu_bounds(registry.GetConfig(id)));
+        }
+        LOG("Config applied to " << update.size() << " tenants, " << removed.removed.size() << " removed in "
+            << updated.elapsed.count() + removed.elapsed.count() << "us");
+    });
+    configWatcher.Start();
+
+    cout << "Sampling..." << endl;
+    for (int i = 0; i < 100; i++)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (auto now = std::chrono::steady_clock::now(); now < deadline; now = std::chrono::steady_clock::now())
+            watcher.Dispatch(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+
+        auto snapshot = sampler.GetSnapshot();
+        auto stats = sampler.GetStats();
+        if (!snapshot)
+            continue;
+
+        LOG("cycle=" << snapshot->cycle << " lastCycleUs=" << stats.lastCycle.count()
+            << " maxCycleUs=" << stats.maxCycle.count() << " missed=" << stats.missedDeadlines);
+        std::lock_guard<std::mutex> guard(registryLock);
+        registry.ForEach([&registry](TenantId id) {
+            auto &sample = registry.GetSample(id);
+            LOG("  " << registry.GetName(id) << ": memory=" << sample.memoryUsage << "KB"
+                << " cpuUsageUs=" << sample.cpuStat.usageUsec << " throttled=" << sample.cpuStat.nrThrottled);
+        });
+    }
+
+    configWatcher.Stop();
+    sampler.Stop();
     return 0;
 }